@@ -14,6 +14,7 @@ class Window;
 class Trackball {
 public:
 	// NOTE(Mathijs): field of view in radians! (use glm::radians(...) to convert from degrees to radians).
+	// pWindow may be NULL for headless rendering, in which case the aspect ratio is set with setAspectRatio().
 	Trackball(Window* pWindow, float fovy, float distanceFromLookAt = 4.0f, float rotationX = 0.0f, float rotationY = 0.0f);
 	Trackball(Window* pWindow, float fovy, const glm::vec3& lookAt, float distanceFromLookAt = 4.0f, float rotationX = 0.0f, float rotationY = 0.0f);
 	~Trackball() = default;
@@ -21,6 +22,7 @@ public:
 	static void printHelp();
 
 	void disableTranslation();
+	void setAspectRatio(float aspectRatio); // Only used when there is no window.
 
 	[[nodiscard]] glm::vec3 left() const;
 	[[nodiscard]] glm::vec3 up() const;
@@ -38,6 +40,8 @@ public:
 
 private:
 
+	[[nodiscard]] float aspectRatio() const;
+
 	void mouseButtonCallback(int button, int action, int mods);
 	void mouseMoveCallback(const glm::vec2& pos);
 	void mouseScrollCallback(const glm::vec2& offset);
@@ -45,6 +49,7 @@ private:
 private:
 	const Window* m_pWindow;
 	float m_fovy;
+	float m_aspectRatio { 1.0f };
 	bool m_canTranslate { true };
 
 	glm::vec3 m_lookAt{ 0.0f }; // Point that the camera is looking at / rotating around.
@@ -29,6 +29,10 @@ Trackball::Trackball(Window* pWindow, float fovy, const glm::vec3& lookAt, float
 {
     m_rotationEulerAngles.z = 0;
 
+    // Headless camera, there is no input to listen to.
+    if (pWindow == nullptr)
+        return;
+
     pWindow->registerMouseButtonCallback(
         [this](int key, int action, int mods) {
             mouseButtonCallback(key, action, mods);
@@ -55,6 +59,16 @@ void Trackball::disableTranslation()
     m_canTranslate = false;
 }
 
+void Trackball::setAspectRatio(float aspectRatio)
+{
+    m_aspectRatio = aspectRatio;
+}
+
+float Trackball::aspectRatio() const
+{
+    return m_pWindow ? m_pWindow->aspectRatio() : m_aspectRatio;
+}
+
 void Trackball::setCamera(const glm::vec3 lookAt, const glm::vec3 rotations, const float dist)
 {
     m_lookAt = lookAt;
@@ -79,7 +93,7 @@ glm::mat4 Trackball::viewMatrix() const
 
 glm::mat4 Trackball::projectionMatrix() const
 {
-    return glm::perspective(m_fovy, m_pWindow->aspectRatio(), 0.01f, 100.0f);
+    return glm::perspective(m_fovy, aspectRatio(), 0.01f, 100.0f);
 }
 
 // Generate a ray with the origin at cameraPos, going through the given pixel (normalized coordinates between -1 and +1)
@@ -87,7 +101,7 @@ glm::mat4 Trackball::projectionMatrix() const
 Ray Trackball::generateRay(const glm::vec2& pixel) const
 {
     const float halfScreenPlaceHeight = std::tan(m_fovy / 2.0f);
-    const float halfScreenPlaceWidth = m_pWindow->aspectRatio() * halfScreenPlaceHeight;
+    const float halfScreenPlaceWidth = aspectRatio() * halfScreenPlaceHeight;
     const glm::vec3 cameraSpaceDirection = glm::normalize(glm::vec3(-pixel.x * halfScreenPlaceWidth, pixel.y * halfScreenPlaceHeight, 1.0f));
 
     Ray ray;
@@ -0,0 +1,227 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include "aov.h"
+
+AOVBuffers::AOVBuffers(const glm::ivec2 &imageResolution): resolution(imageResolution) {
+    const size_t size = size_t(resolution.x) * size_t(resolution.y);
+    albedo.resize(size, glm::vec3(0.0F));
+    normal.resize(size, glm::vec3(0.0F));
+    depth.resize(size, FLT_MAX);
+    meshId.resize(size, NO_MESH);
+    direct.resize(size, glm::vec3(0.0F));
+    indirect.resize(size, glm::vec3(0.0F));
+    nodes.resize(size, 0);
+    triangles.resize(size, 0);
+}
+
+void AOVBuffers::set(int x, int y, const AOVSample &sample) {
+    // Outside the screen
+    if (x < 0 || y < 0 || x >= resolution.x || y >= resolution.y) {
+        return;
+    }
+
+    const size_t i = size_t(y) * size_t(resolution.x) + size_t(x);
+    albedo[i] = sample.albedo;
+    normal[i] = sample.normal;
+    depth[i] = sample.depth;
+    meshId[i] = sample.meshId;
+    direct[i] = sample.direct;
+    indirect[i] = sample.indirect;
+    nodes[i] = sample.nodes;
+    triangles[i] = sample.triangles;
+}
+
+AOVSample AOVBuffers::get(int x, int y) const {
+    const size_t i = size_t(y) * size_t(resolution.x) + size_t(x);
+    return AOVSample{albedo[i], normal[i], depth[i], meshId[i], direct[i], indirect[i], nodes[i], triangles[i]};
+}
+
+// OpenEXR pixel types
+static constexpr int32_t EXR_UINT = 0;
+static constexpr int32_t EXR_FLOAT = 2;
+
+// A channel reads 4 byte values from one of the planes, stride bytes apart
+struct ExrChannel {
+    std::string name;
+    int32_t type;
+    const char *data;
+    size_t stride;
+};
+
+// OpenEXR is little endian
+class ExrBuffer {
+public:
+    void u8(uint8_t value) {
+        bytes.push_back(char(value));
+    }
+
+    void i32(int32_t value) {
+        u32(uint32_t(value));
+    }
+
+    void u32(uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            u8(uint8_t(value >> (8 * i)));
+        }
+    }
+
+    void u64(uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            u8(uint8_t(value >> (8 * i)));
+        }
+    }
+
+    void f32(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        u32(bits);
+    }
+
+    void str(const std::string &value) {
+        bytes.insert(bytes.end(), value.begin(), value.end());
+        u8(0);
+    }
+
+    void attribute(const std::string &name, const std::string &type, int32_t size) {
+        str(name);
+        str(type);
+        i32(size);
+    }
+
+    std::vector<char> bytes;
+};
+
+static void addVec3(std::vector<ExrChannel> &channels, const std::string &layer, const std::vector<glm::vec3> &plane, const char *components) {
+    for (int c = 0; c < 3; c++) {
+        const std::string name = layer.empty() ? std::string(1, components[c]) : layer + "." + components[c];
+        channels.push_back(ExrChannel{name, EXR_FLOAT, reinterpret_cast<const char *>(plane.data()) + size_t(c) * sizeof(float), sizeof(glm::vec3)});
+    }
+}
+
+void writeAOVsToFile(const Screen &screen, const AOVBuffers &aovs, const std::filesystem::path &filePath) {
+    const glm::ivec2 resolution = aovs.resolution;
+    std::vector<glm::vec3> beauty(size_t(resolution.x) * size_t(resolution.y));
+    for (int y = 0; y < resolution.y; y++) {
+        for (int x = 0; x < resolution.x; x++) {
+            beauty[size_t(y) * size_t(resolution.x) + size_t(x)] = screen.getPixel(size_t(x), size_t(y));
+        }
+    }
+
+    std::vector<ExrChannel> channels;
+    addVec3(channels, "", beauty, "RGB");
+    addVec3(channels, "albedo", aovs.albedo, "RGB");
+    addVec3(channels, "normal", aovs.normal, "XYZ");
+    addVec3(channels, "direct", aovs.direct, "RGB");
+    addVec3(channels, "indirect", aovs.indirect, "RGB");
+    channels.push_back(ExrChannel{"Z", EXR_FLOAT, reinterpret_cast<const char *>(aovs.depth.data()), sizeof(float)});
+    channels.push_back(ExrChannel{"id", EXR_UINT, reinterpret_cast<const char *>(aovs.meshId.data()), sizeof(uint32_t)});
+#ifdef USE_RAY_STATISTICS
+    channels.push_back(ExrChannel{"stats.nodes", EXR_UINT, reinterpret_cast<const char *>(aovs.nodes.data()), sizeof(uint32_t)});
+    channels.push_back(ExrChannel{"stats.triangles", EXR_UINT, reinterpret_cast<const char *>(aovs.triangles.data()), sizeof(uint32_t)});
+#endif
+    // Readers expect the channels sorted by name
+    std::sort(channels.begin(), channels.end(), [](const ExrChannel &a, const ExrChannel &b) { return a.name < b.name; });
+
+    ExrBuffer out;
+    out.u32(20000630); // Magic number
+    out.u32(2); // Version 2, single part scan line file
+
+    int32_t channelListSize = 1;
+    for (const ExrChannel &channel : channels) {
+        channelListSize += int32_t(channel.name.size()) + 1 + 16;
+    }
+    out.attribute("channels", "chlist", channelListSize);
+    for (const ExrChannel &channel : channels) {
+        out.str(channel.name);
+        out.i32(channel.type);
+        out.u32(0); // pLinear and reserved
+        out.i32(1); // x sampling
+        out.i32(1); // y sampling
+    }
+    out.u8(0);
+    out.attribute("compression", "compression", 1);
+    out.u8(0); // NO_COMPRESSION
+    for (const char *window : {"dataWindow", "displayWindow"}) {
+        out.attribute(window, "box2i", 16);
+        out.i32(0);
+        out.i32(0);
+        out.i32(resolution.x - 1);
+        out.i32(resolution.y - 1);
+    }
+    out.attribute("lineOrder", "lineOrder", 1);
+    out.u8(0); // INCREASING_Y
+    out.attribute("pixelAspectRatio", "float", 4);
+    out.f32(1.0F);
+    out.attribute("screenWindowCenter", "v2f", 8);
+    out.f32(0.0F);
+    out.f32(0.0F);
+    out.attribute("screenWindowWidth", "float", 4);
+    out.f32(1.0F);
+    out.u8(0); // End of the header
+
+    // Without compression every scan line is its own block
+    const size_t rowBytes = channels.size() * size_t(resolution.x) * 4;
+    const size_t blockBytes = 8 + rowBytes;
+    const size_t tableStart = out.bytes.size();
+    for (int y = 0; y < resolution.y; y++) {
+        out.u64(tableStart + size_t(resolution.y) * 8 + size_t(y) * blockBytes);
+    }
+
+    out.bytes.reserve(out.bytes.size() + size_t(resolution.y) * blockBytes);
+    for (int y = 0; y < resolution.y; y++) {
+        // The first scan line of the file is the top of the screen
+        const size_t row = size_t(resolution.y - 1 - y) * size_t(resolution.x);
+        out.i32(y);
+        out.i32(int32_t(rowBytes));
+        for (const ExrChannel &channel : channels) {
+            for (int x = 0; x < resolution.x; x++) {
+                uint32_t value;
+                std::memcpy(&value, channel.data + (row + size_t(x)) * channel.stride, sizeof(value));
+                out.u32(value);
+            }
+        }
+    }
+
+    std::ofstream file(filePath, std::ios::binary);
+    file.write(out.bytes.data(), std::streamsize(out.bytes.size()));
+    if (!file) {
+        throw std::runtime_error("Failed to write " + filePath.string());
+    }
+}
+
+// From black through blue, red and yellow to white at the highest count
+static void writeHeatMapToFile(const glm::ivec2 &resolution, const std::vector<uint32_t> &counts, const std::filesystem::path &filePath) {
+    const glm::vec3 ramp[] = {
+        glm::vec3(0.0F),
+        glm::vec3(0.0F, 0.0F, 1.0F),
+        glm::vec3(1.0F, 0.0F, 0.0F),
+        glm::vec3(1.0F, 1.0F, 0.0F),
+        glm::vec3(1.0F)
+    };
+    const size_t segments = sizeof(ramp) / sizeof(ramp[0]) - 1;
+    const uint32_t highest = std::max(*std::max_element(counts.begin(), counts.end()), 1U);
+
+    Screen screen{size_t(resolution.x), size_t(resolution.y)};
+    for (int y = 0; y < resolution.y; y++) {
+        for (int x = 0; x < resolution.x; x++) {
+            const float f = float(counts[size_t(y) * size_t(resolution.x) + size_t(x)]) / float(highest) * float(segments);
+            const size_t segment = std::min(size_t(f), segments - 1);
+            screen.setPixel(size_t(x), size_t(y), glm::mix(ramp[segment], ramp[segment + 1], f - float(segment)));
+        }
+    }
+    screen.writeBitmapToFile(filePath);
+}
+
+void writeHeatMapsToFile(const AOVBuffers &aovs, const std::filesystem::path &filePath) {
+    const std::filesystem::path stem = filePath.parent_path() / filePath.stem();
+    const std::string extension = filePath.has_extension() ? filePath.extension().string() : ".bmp";
+    writeHeatMapToFile(aovs.resolution, aovs.nodes, stem.string() + "-nodes" + extension);
+    writeHeatMapToFile(aovs.resolution, aovs.triangles, stem.string() + "-triangles" + extension);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cfloat>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+#include "screen.h"
+
+// Mesh ID of pixels where the camera ray missed
+static constexpr uint32_t NO_MESH = UINT32_MAX;
+
+// Arbitrary output variables of one pixel, all taken from the first hit of the camera ray.
+struct AOVSample {
+    glm::vec3 albedo { 0.0F }; // Diffuse color kd
+    glm::vec3 normal { 0.0F }; // Shading normal in world space
+    float depth = FLT_MAX; // Distance along the camera ray, FLT_MAX if the ray missed
+    uint32_t meshId = NO_MESH;
+    glm::vec3 direct { 0.0F }; // Direct light and reflections
+    glm::vec3 indirect { 0.0F }; // Diffuse interreflections
+    uint32_t nodes = 0; // Hierarchy nodes and triangles tested for the pixel, only counted with ray statistics (see ray_statistics.h)
+    uint32_t triangles = 0;
+};
+
+// One plane per render pass, stored row by row from the bottom left of the screen.
+struct AOVBuffers {
+    AOVBuffers(const glm::ivec2 &imageResolution);
+
+    void set(int x, int y, const AOVSample &sample);
+    AOVSample get(int x, int y) const;
+
+    glm::ivec2 resolution;
+    std::vector<glm::vec3> albedo;
+    std::vector<glm::vec3> normal;
+    std::vector<float> depth;
+    std::vector<uint32_t> meshId;
+    std::vector<glm::vec3> direct;
+    std::vector<glm::vec3> indirect;
+    std::vector<uint32_t> nodes;
+    std::vector<uint32_t> triangles;
+};
+
+// Writes the image and all passes to a single multi-channel OpenEXR file (uncompressed, 32 bit float channels,
+// the mesh ID as 32 bit unsigned int). Pixels without a hit have depth FLT_MAX and mesh ID 0xFFFFFFFF. Builds with ray statistics
+// also write the node and triangle tests of every pixel.
+void writeAOVsToFile(const Screen &screen, const AOVBuffers &aovs, const std::filesystem::path &filePath);
+
+// Bitmaps of the nodes and of the triangles tested for every pixel, next to filePath with -nodes and -triangles added to the name
+void writeHeatMapsToFile(const AOVBuffers &aovs, const std::filesystem::path &filePath);
@@ -0,0 +1,533 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include "bidirectional.h"
+#include "bsdf.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+static constexpr float PI = 3.14159265358979323846F;
+static constexpr float OFFSET = 0.01F;
+
+static float luminance(const glm::vec3 &color) {
+    return glm::dot(color, glm::vec3(0.2126F, 0.7152F, 0.0722F));
+}
+
+static bool isBlack(const glm::vec3 &color) {
+    return color.x <= 0.0F && color.y <= 0.0F && color.z <= 0.0F;
+}
+
+static glm::vec3 uniformSphere(const glm::vec2 &u) {
+    const float z = 1.0F - 2.0F * u.x;
+    const float r = std::sqrt(std::max(1.0F - z * z, 0.0F));
+    const float phi = 2.0F * PI * u.y;
+    return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// Vertices that were not sampled by a strategy count as impossible to sample, not as dividing by zero
+static float remap0(float f) {
+    return f != 0.0F ? f : 1.0F;
+}
+
+SplatBuffer::SplatBuffer(const glm::ivec2 &tileLower, const glm::ivec2 &tileUpper): lower(tileLower), upper(tileUpper) {
+    const glm::ivec2 size = upper - lower;
+    pixels.resize(size_t(size.x) * size_t(size.y), glm::vec3(0.0F));
+}
+
+void SplatBuffer::add(const glm::vec2 &raster, const glm::vec3 &color) {
+    const int x = int(std::floor(raster.x));
+    const int y = int(std::floor(raster.y));
+    if (x < lower.x || y < lower.y || x >= upper.x || y >= upper.y) {
+        return;
+    }
+    glm::vec3 &pixel = pixels[size_t(y - lower.y) * size_t(upper.x - lower.x) + size_t(x - lower.x)];
+    for (int c = 0; c < 3; c++) {
+#ifdef USE_OPENMP
+#pragma omp atomic
+#endif
+        pixel[c] += color[c];
+    }
+}
+
+glm::vec3 SplatBuffer::get(int x, int y) const {
+    return pixels[size_t(y - lower.y) * size_t(upper.x - lower.x) + size_t(x - lower.x)];
+}
+
+bool BidirectionalTracer::Vertex::isLight() const {
+    return type == VertexType::Light || (type == VertexType::Surface && !isBlack(material.ke));
+}
+
+BidirectionalTracer::BidirectionalTracer(const Scene &tracedScene, const BoundingVolumeHierarchy &sceneBvh, const AreaLights *areaLights, const Trackball &camera, const glm::ivec2 &imageResolution, int maxPathDepth)
+    : scene(&tracedScene), bvh(&sceneBvh), lights(areaLights != nullptr && !areaLights->empty() ? areaLights : nullptr), maxDepth(maxPathDepth), resolution(imageResolution) {
+    // The trackball does not expose its projection, so it is recovered from the rays it generates
+    origin = camera.position();
+    forward = camera.generateRay(glm::vec2(0.0F)).direction;
+    const glm::vec3 x = camera.generateRay(glm::vec2(1.0F, 0.0F)).direction;
+    const glm::vec3 y = camera.generateRay(glm::vec2(0.0F, 1.0F)).direction;
+    const glm::vec3 xPlane = x / glm::dot(x, forward) - forward;
+    const glm::vec3 yPlane = y / glm::dot(y, forward) - forward;
+    tanHalfFov = glm::vec2(glm::length(xPlane), glm::length(yPlane));
+    right = xPlane / tanHalfFov.x;
+    up = yPlane / tanHalfFov.y;
+    filmArea = 4.0F * tanHalfFov.x * tanHalfFov.y;
+
+    float total = 0.0F;
+    for (const PointLight &light : scene->pointLights) {
+        total += 4.0F * PI * std::max(luminance(light.color), 0.0F);
+        lightCdf.push_back(total);
+    }
+    total += lights != nullptr ? lights->power() : 0.0F;
+    lightCdf.push_back(total);
+}
+
+bool BidirectionalTracer::project(const glm::vec3 &point, glm::vec2 &raster, float &cosTheta) const {
+    const glm::vec3 v = point - origin;
+    const float z = glm::dot(v, forward);
+    if (z <= 0.0F) {
+        return false;
+    }
+    const glm::vec2 normalized = glm::vec2(glm::dot(v, right) / (z * tanHalfFov.x), glm::dot(v, up) / (z * tanHalfFov.y));
+    if (std::fabs(normalized.x) > 1.0F || std::fabs(normalized.y) > 1.0F) {
+        return false;
+    }
+    raster = (normalized + 1.0F) / 2.0F * glm::vec2(resolution);
+    cosTheta = z / glm::length(v);
+    return true;
+}
+
+float BidirectionalTracer::lightProbability(size_t light) const {
+    const float total = lightCdf.back();
+    if (total <= 0.0F) {
+        return 0.0F;
+    }
+    return (lightCdf[light] - (light == 0 ? 0.0F : lightCdf[light - 1])) / total;
+}
+
+glm::vec3 BidirectionalTracer::brdf(const Vertex &vertex, const glm::vec3 &outgoing, const glm::vec3 &incoming) const {
+    // Surfaces only reflect on the side the path arrived from
+    const float cosOut = glm::dot(outgoing, vertex.normal);
+    const float cosIn = glm::dot(incoming, vertex.normal);
+    if (vertex.type != VertexType::Surface || cosOut <= 0.0F || cosIn <= 0.0F) {
+        return glm::vec3(0.0F);
+    }
+    glm::vec3 out = vertex.material.kd / PI;
+    if (!isBlack(vertex.material.ks)) {
+        const float shininess = std::max(vertex.material.shininess, 0.0F);
+        const float cosHalf = std::max(glm::dot(glm::normalize(outgoing + incoming), vertex.normal), 0.0F);
+        out += vertex.material.ks * (shininess + 8.0F) / (8.0F * PI) * std::pow(cosHalf, shininess);
+    }
+    return out;
+}
+
+// Density per unit area at next of sampling it from vertex, which was reached from previous
+float BidirectionalTracer::pdfArea(const Vertex &vertex, const Vertex *previous, const Vertex &next) const {
+    if (vertex.type == VertexType::Light) {
+        return pdfLight(vertex, next);
+    }
+    const glm::vec3 offset = next.position - vertex.position;
+    const float distance2 = glm::dot(offset, offset);
+    if (distance2 <= 0.0F) {
+        return 0.0F;
+    }
+    const glm::vec3 direction = offset / std::sqrt(distance2);
+
+    float pdf;
+    if (vertex.type == VertexType::Camera) {
+        const float cosTheta = glm::dot(direction, forward);
+        if (cosTheta <= 0.0F) {
+            return 0.0F;
+        }
+        pdf = 1.0F / (filmArea * cosTheta * cosTheta * cosTheta);
+    } else {
+        if (previous == nullptr) {
+            return 0.0F;
+        }
+        const BSDF bsdf = BSDF{vertex.material, vertex.normal, glm::normalize(previous->position - vertex.position)};
+        pdf = bsdf.pdf(direction);
+    }
+
+    // Solid angle to area
+    pdf /= distance2;
+    if (next.normal != glm::vec3(0.0F)) {
+        pdf *= std::fabs(glm::dot(next.normal, direction));
+    }
+    return pdf;
+}
+
+// Density per unit area at next of a light emitting towards it
+float BidirectionalTracer::pdfLight(const Vertex &light, const Vertex &next) const {
+    const glm::vec3 offset = next.position - light.position;
+    const float distance2 = glm::dot(offset, offset);
+    if (distance2 <= 0.0F) {
+        return 0.0F;
+    }
+    const glm::vec3 direction = offset / std::sqrt(distance2);
+    // Point lights emit uniformly over the sphere, area lights cosine weighted on both sides
+    float pdf = light.pointLight ? 1.0F / (4.0F * PI) : std::fabs(glm::dot(light.normal, direction)) / (2.0F * PI);
+    pdf /= distance2;
+    if (next.normal != glm::vec3(0.0F)) {
+        pdf *= std::fabs(glm::dot(next.normal, direction));
+    }
+    return pdf;
+}
+
+// Density per unit area of picking the position of the light vertex when starting a light path
+float BidirectionalTracer::pdfLightOrigin(const Vertex &light) const {
+    if (light.pointLight) {
+        // Only reached for sampled point lights, their position is fixed
+        return lightProbability(light.meshIdx);
+    }
+    if (lights == nullptr) {
+        return 0.0F;
+    }
+    return lightProbability(lightCdf.size() - 1) * lights->pdf(light.meshIdx);
+}
+
+bool BidirectionalTracer::visible(const Vertex &a, const Vertex &b) const {
+    const glm::vec3 offset = b.position - a.position;
+    const float distance = glm::length(offset);
+    if (distance <= 2.0F * OFFSET) {
+        return true;
+    }
+    const glm::vec3 direction = offset / distance;
+    Ray ray = Ray{a.position + direction * OFFSET, direction, distance - 2.0F * OFFSET};
+    HitInfo hitInfo;
+    return !trace(*bvh, ray, hitInfo, RayType::Shadow);
+}
+
+// Extends the path from its last vertex until it leaves the scene, a BSDF sample fails or it has maxVertices vertices
+int BidirectionalTracer::randomWalk(PathSampler &sampler, Ray ray, glm::vec3 beta, float pdf, int maxVertices, std::vector<Vertex> &path) const {
+    int added = 0;
+    while (int(path.size()) < maxVertices) {
+        HitInfo hitInfo;
+        const RayType type = added == 0 && path.back().type == VertexType::Camera ? RayType::Camera : RayType::Indirect;
+        if (!trace(*bvh, ray, hitInfo, type)) {
+            break;
+        }
+        Vertex vertex;
+        vertex.type = VertexType::Surface;
+        vertex.position = ray.origin + ray.direction * ray.t;
+        vertex.normal = hitInfo.normal;
+        vertex.beta = beta;
+        vertex.emission = hitInfo.material.ke;
+        vertex.material = hitInfo.material;
+        vertex.meshIdx = hitInfo.meshIdx;
+        vertex.pdfFwd = 0.0F;
+        vertex.pdfRev = 0.0F;
+        vertex.pointLight = false;
+        const float distance2 = ray.t * ray.t;
+        vertex.pdfFwd = pdf * std::fabs(glm::dot(vertex.normal, ray.direction)) / distance2;
+        path.push_back(vertex);
+        added++;
+        if (int(path.size()) >= maxVertices) {
+            break;
+        }
+
+        const glm::vec3 outgoing = -ray.direction;
+        const BSDF bsdf = BSDF{vertex.material, vertex.normal, outgoing};
+        const BSDFSample sample = bsdf.sample(sampler.next2D());
+        if (sample.pdf <= 0.0F) {
+            break;
+        }
+        const glm::vec3 f = brdf(vertex, outgoing, sample.direction);
+        if (isBlack(f)) {
+            break;
+        }
+        beta *= f * glm::dot(sample.direction, vertex.normal) / sample.pdf;
+        pdf = sample.pdf;
+
+        // The same step sampled backwards, from the new direction to the previous vertex
+        Vertex &previous = path[path.size() - 2];
+        const float reverse = BSDF{vertex.material, vertex.normal, sample.direction}.pdf(outgoing);
+        previous.pdfRev = reverse / distance2;
+        if (previous.normal != glm::vec3(0.0F)) {
+            previous.pdfRev *= std::fabs(glm::dot(previous.normal, outgoing));
+        }
+
+        ray = Ray{vertex.position + sample.direction * OFFSET, sample.direction};
+    }
+    return added;
+}
+
+void BidirectionalTracer::cameraSubpath(const glm::vec2 &normalizedPixelPos, PathSampler &sampler, std::vector<Vertex> &path) const {
+    Vertex camera;
+    camera.type = VertexType::Camera;
+    camera.position = origin;
+    camera.normal = glm::vec3(0.0F);
+    camera.beta = glm::vec3(1.0F);
+    camera.emission = glm::vec3(0.0F);
+    camera.meshIdx = 0;
+    camera.pdfFwd = 1.0F;
+    camera.pdfRev = 0.0F;
+    camera.pointLight = false;
+    path.push_back(camera);
+
+    const glm::vec3 direction = glm::normalize(
+        forward + normalizedPixelPos.x * tanHalfFov.x * right + normalizedPixelPos.y * tanHalfFov.y * up);
+    const float cosTheta = glm::dot(direction, forward);
+    // The importance of the camera is chosen so that the throughput of camera rays is 1
+    const float pdf = 1.0F / (filmArea * cosTheta * cosTheta * cosTheta);
+    randomWalk(sampler, Ray{origin, direction}, glm::vec3(1.0F), pdf, maxDepth + 2, path);
+}
+
+void BidirectionalTracer::lightSubpath(PathSampler &sampler, std::vector<Vertex> &path) const {
+    const float total = lightCdf.back();
+    if (total <= 0.0F) {
+        return;
+    }
+    const glm::vec2 u = sampler.next2D();
+    const size_t light = std::min(size_t(std::upper_bound(lightCdf.begin(), lightCdf.end(), u.x * total) - lightCdf.begin()), lightCdf.size() - 1);
+    const float lightPdf = lightProbability(light);
+
+    Vertex vertex;
+    vertex.type = VertexType::Light;
+    vertex.pdfRev = 0.0F;
+    glm::vec3 direction;
+    float pdfDirection;
+    float cosTheta = 1.0F;
+    if (light < scene->pointLights.size()) {
+        const PointLight &pointLight = scene->pointLights[light];
+        vertex.position = pointLight.position;
+        vertex.normal = glm::vec3(0.0F);
+        vertex.emission = pointLight.color;
+        vertex.meshIdx = light;
+        vertex.pointLight = true;
+        vertex.pdfFwd = lightPdf;
+        direction = uniformSphere(sampler.next2D());
+        pdfDirection = 1.0F / (4.0F * PI);
+    } else {
+        const glm::vec2 pick = sampler.next2D();
+        const glm::vec2 point = sampler.next2D();
+        const LightSample sample = lights->sample(pick, point);
+        // Either side of the light, cosine weighted
+        const glm::vec3 normal = u.y < 0.5F ? sample.normal : -sample.normal;
+        vertex.position = sample.position;
+        vertex.normal = normal;
+        vertex.emission = sample.emission;
+        vertex.meshIdx = 0;
+        vertex.pointLight = false;
+        vertex.pdfFwd = lightPdf * sample.pdf;
+        direction = BSDF{Material{}, normal, normal}.sample(sampler.next2D()).direction;
+        cosTheta = glm::dot(direction, normal);
+        pdfDirection = cosTheta / (2.0F * PI);
+        if (pdfDirection <= 0.0F) {
+            return;
+        }
+    }
+    if (vertex.pdfFwd <= 0.0F) {
+        return;
+    }
+    vertex.beta = vertex.emission / vertex.pdfFwd;
+    path.push_back(vertex);
+
+    const glm::vec3 beta = vertex.emission * cosTheta / (vertex.pdfFwd * pdfDirection);
+    randomWalk(sampler, Ray{vertex.position + direction * OFFSET, direction}, beta, pdfDirection, maxDepth + 1, path);
+}
+
+glm::vec3 BidirectionalTracer::connect(const std::vector<Vertex> &lightPath, const std::vector<Vertex> &cameraPath, int s, int t, PathSampler &sampler, glm::vec2 &raster) const {
+    const Vertex &pt = cameraPath[size_t(t - 1)];
+    glm::vec3 color = glm::vec3(0.0F);
+    Vertex sampled;
+    sampled.pdfRev = 0.0F;
+
+    if (s == 0) {
+        // The camera path found a light by itself
+        if (!pt.isLight() || t < 2) {
+            return color;
+        }
+        color = pt.beta * pt.emission;
+    } else if (t == 1) {
+        // The light path is seen by the camera
+        const Vertex &qs = lightPath[size_t(s - 1)];
+        float cosTheta;
+        if (qs.type != VertexType::Surface || !project(qs.position, raster, cosTheta)) {
+            return color;
+        }
+        sampled = cameraPath[0];
+        const glm::vec3 offset = sampled.position - qs.position;
+        const float distance2 = glm::dot(offset, offset);
+        const glm::vec3 direction = offset / std::sqrt(distance2);
+        const glm::vec3 f = brdf(qs, glm::normalize(lightPath[size_t(s - 2)].position - qs.position), direction);
+        if (isBlack(f)) {
+            return color;
+        }
+        const float importance = 1.0F / (filmArea * cosTheta * cosTheta * cosTheta * cosTheta);
+        color = qs.beta * f * std::fabs(glm::dot(qs.normal, direction)) * importance * cosTheta / distance2;
+        if (isBlack(color) || !visible(qs, sampled)) {
+            return glm::vec3(0.0F);
+        }
+    } else if (s == 1) {
+        // Next-event estimation: a new point on a light
+        if (pt.type != VertexType::Surface || lightCdf.back() <= 0.0F) {
+            return color;
+        }
+        const glm::vec2 u = sampler.next2D();
+        const glm::vec2 v = sampler.next2D();
+        const size_t light = std::min(size_t(std::upper_bound(lightCdf.begin(), lightCdf.end(), u.x * lightCdf.back()) - lightCdf.begin()), lightCdf.size() - 1);
+        const float lightPdf = lightProbability(light);
+        sampled.type = VertexType::Light;
+        float pdfPosition;
+        if (light < scene->pointLights.size()) {
+            const PointLight &pointLight = scene->pointLights[light];
+            sampled.position = pointLight.position;
+            sampled.normal = glm::vec3(0.0F);
+            sampled.emission = pointLight.color;
+            sampled.meshIdx = light;
+            sampled.pointLight = true;
+            pdfPosition = 1.0F;
+        } else {
+            // The light was picked with u.x, so u.y is still free to pick the triangle
+            const LightSample sample = lights->sample(glm::vec2(u.y, 0.0F), v);
+            sampled.position = sample.position;
+            sampled.normal = sample.normal;
+            sampled.emission = sample.emission;
+            sampled.meshIdx = 0;
+            sampled.pointLight = false;
+            pdfPosition = sample.pdf;
+        }
+        sampled.pdfFwd = lightPdf * pdfPosition;
+        if (sampled.pdfFwd <= 0.0F) {
+            return color;
+        }
+        sampled.beta = sampled.emission / sampled.pdfFwd;
+
+        const glm::vec3 offset = sampled.position - pt.position;
+        const float distance2 = glm::dot(offset, offset);
+        const glm::vec3 direction = offset / std::sqrt(distance2);
+        const glm::vec3 f = brdf(pt, glm::normalize(cameraPath[size_t(t - 2)].position - pt.position), direction);
+        // Geometry term, point lights have no area
+        float geometry = glm::dot(pt.normal, direction) / distance2;
+        if (!sampled.pointLight) {
+            geometry *= std::fabs(glm::dot(sampled.normal, direction));
+        }
+        color = pt.beta * f * sampled.beta * geometry;
+        if (isBlack(color) || !visible(pt, sampled)) {
+            return glm::vec3(0.0F);
+        }
+    } else {
+        // Both subpaths continue through the connecting edge
+        const Vertex &qs = lightPath[size_t(s - 1)];
+        if (qs.type != VertexType::Surface || pt.type != VertexType::Surface) {
+            return color;
+        }
+        const glm::vec3 offset = pt.position - qs.position;
+        const float distance2 = glm::dot(offset, offset);
+        const glm::vec3 direction = offset / std::sqrt(distance2);
+        const glm::vec3 fq = brdf(qs, glm::normalize(lightPath[size_t(s - 2)].position - qs.position), direction);
+        const glm::vec3 fp = brdf(pt, glm::normalize(cameraPath[size_t(t - 2)].position - pt.position), -direction);
+        const float geometry = std::fabs(glm::dot(qs.normal, direction)) * std::fabs(glm::dot(pt.normal, direction)) / distance2;
+        color = qs.beta * fq * fp * pt.beta * geometry;
+        if (isBlack(color) || !visible(qs, pt)) {
+            return glm::vec3(0.0F);
+        }
+    }
+
+    if (isBlack(color)) {
+        return color;
+    }
+    // The weight temporarily changes the vertices at the connection, so it works on copies
+    std::vector<Vertex> lightCopy{lightPath.begin(), lightPath.begin() + s};
+    std::vector<Vertex> cameraCopy{cameraPath.begin(), cameraPath.begin() + t};
+    return color * misWeight(lightCopy, cameraCopy, sampled, s, t);
+}
+
+float BidirectionalTracer::misWeight(std::vector<Vertex> &lightPath, std::vector<Vertex> &cameraPath, const Vertex &sampled, int s, int t) const {
+    if (s + t == 2) {
+        return 1.0F;
+    }
+
+    Vertex *qs = s > 0 ? &lightPath[size_t(s - 1)] : nullptr;
+    Vertex *pt = t > 0 ? &cameraPath[size_t(t - 1)] : nullptr;
+    Vertex *qsMinus = s > 1 ? &lightPath[size_t(s - 2)] : nullptr;
+    Vertex *ptMinus = t > 1 ? &cameraPath[size_t(t - 2)] : nullptr;
+
+    // Vertices sampled by the connection itself replace the ones of the subpath
+    if (s == 1) {
+        *qs = sampled;
+    } else if (t == 1) {
+        *pt = sampled;
+    }
+
+    // Densities of the vertices at the connection if the path had been sampled from the other side
+    pt->pdfRev = s > 0 ? pdfArea(*qs, qsMinus, *pt) : pdfLightOrigin(*pt);
+    if (ptMinus != nullptr) {
+        ptMinus->pdfRev = s > 0 ? pdfArea(*pt, qs, *ptMinus) : pdfLight(*pt, *ptMinus);
+    }
+    if (qs != nullptr) {
+        qs->pdfRev = pdfArea(*pt, ptMinus, *qs);
+    }
+    if (qsMinus != nullptr) {
+        qsMinus->pdfRev = pdfArea(*qs, pt, *qsMinus);
+    }
+
+    // Ratios of the densities of the other strategies to this one. The pinhole camera can not be hit (no t = 0) and
+    // point lights can not be hit either.
+    float sum = 0.0F;
+    float ratio = 1.0F;
+    for (int i = t - 1; i > 0; i--) {
+        ratio *= remap0(cameraPath[size_t(i)].pdfRev) / remap0(cameraPath[size_t(i)].pdfFwd);
+        sum += ratio;
+    }
+    ratio = 1.0F;
+    for (int i = s - 1; i >= 0; i--) {
+        ratio *= remap0(lightPath[size_t(i)].pdfRev) / remap0(lightPath[size_t(i)].pdfFwd);
+        if (i > 0 || !lightPath[0].pointLight) {
+            sum += ratio;
+        }
+    }
+    return 1.0F / (1.0F + sum);
+}
+
+glm::vec3 BidirectionalTracer::sample(const glm::vec2 &normalizedPixelPos, PathSampler &cameraSampler, PathSampler &lightSampler, SplatBuffer &splats, PrimaryHit &primary, float &depth) const {
+    std::vector<Vertex> cameraPath;
+    std::vector<Vertex> lightPath;
+    cameraSubpath(normalizedPixelPos, cameraSampler, cameraPath);
+    lightSubpath(lightSampler, lightPath);
+
+    primary.hitInfo.meshIdx = SIZE_MAX;
+    primary.direct = glm::vec3(0.0F);
+    primary.indirect = glm::vec3(0.0F);
+    depth = FLT_MAX;
+    if (cameraPath.size() > 1) {
+        const Vertex &hit = cameraPath[1];
+        primary.hitInfo.normal = hit.normal;
+        primary.hitInfo.material = hit.material;
+        primary.hitInfo.meshIdx = hit.meshIdx;
+        depth = glm::length(hit.position - origin);
+    }
+
+    glm::vec3 color = glm::vec3(0.0F);
+    const int cameraVertices = int(cameraPath.size());
+    const int lightVertices = int(lightPath.size());
+    for (int t = 1; t <= cameraVertices; t++) {
+        for (int s = 0; s <= lightVertices; s++) {
+            const int length = s + t - 2;
+            if ((s == 1 && t == 1) || length < 0 || length > maxDepth) {
+                continue;
+            }
+            glm::vec2 raster;
+            const glm::vec3 contribution = connect(lightPath, cameraPath, s, t, cameraSampler, raster);
+            if (t == 1) {
+                // The raster position is only known if the light path was projected onto the film
+                if (!isBlack(contribution)) {
+                    splats.add(raster, contribution);
+                }
+                continue;
+            }
+            color += contribution;
+            // Emission and direct light of the first hit, like the passes of get_color
+            if (length <= 1) {
+                primary.direct += contribution;
+            } else {
+                primary.indirect += contribution;
+            }
+        }
+    }
+    return color;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <vector>
+#include "bounding_volume_hierarchy.h"
+#include "illumination.h"
+#include "lights.h"
+#include "sampler.h"
+#include "scene.h"
+#include "trackball.h"
+
+// Light that light paths bring to pixels other than the one being rendered, by connecting to the camera.
+// Only pixels in [lower, upper) are kept. Can be added to from many threads.
+class SplatBuffer {
+public:
+    SplatBuffer(const glm::ivec2 &lower, const glm::ivec2 &upper);
+
+    void add(const glm::vec2 &raster, const glm::vec3 &color);
+
+    glm::vec3 get(int x, int y) const;
+
+private:
+    glm::ivec2 lower;
+    glm::ivec2 upper;
+    std::vector<glm::vec3> pixels;
+};
+
+// Bidirectional path tracing as in "Robust Monte Carlo Methods for Light Transport Simulation" (Veach 1997), following the
+// structure of PBRT: a camera subpath and a light subpath per sample, connected at every pair of vertices and weighted with
+// the balance heuristic over all strategies that could have made the same path.
+// Unlike get_color this is physically based: kd and ks are reflected as they are, the light transforms are not applied,
+// and point lights fall off with the square of the distance.
+class BidirectionalTracer {
+public:
+    BidirectionalTracer(const Scene &scene, const BoundingVolumeHierarchy &bvh, const AreaLights *lights, const Trackball &camera, const glm::ivec2 &resolution, int maxDepth);
+
+    // Light reaching the camera through the point with normalized coordinates (see Trackball::generateRay). Connections to the
+    // camera are added to splats instead. The first hit of the camera ray is returned in primary.
+    glm::vec3 sample(const glm::vec2 &normalizedPixelPos, PathSampler &cameraSampler, PathSampler &lightSampler, SplatBuffer &splats, PrimaryHit &primary, float &depth) const;
+
+private:
+    enum class VertexType {
+        Camera,
+        Light,
+        Surface
+    };
+
+    struct Vertex {
+        VertexType type;
+        glm::vec3 position;
+        glm::vec3 normal; // Zero for the camera and point lights, faces the previous vertex on surfaces
+        glm::vec3 beta; // Throughput of the subpath up to this vertex
+        glm::vec3 emission; // Radiance of area lights, intensity of point lights
+        Material material;
+        size_t meshIdx;
+        float pdfFwd; // Density per unit area of sampling this vertex from the previous one
+        float pdfRev; // The same if the subpath was sampled in the other direction
+        bool pointLight;
+
+        bool isLight() const;
+    };
+
+    int randomWalk(PathSampler &sampler, Ray ray, glm::vec3 beta, float pdf, int maxVertices, std::vector<Vertex> &path) const;
+    void cameraSubpath(const glm::vec2 &normalizedPixelPos, PathSampler &sampler, std::vector<Vertex> &path) const;
+    void lightSubpath(PathSampler &sampler, std::vector<Vertex> &path) const;
+
+    // Strategy with s light and t camera vertices. For t == 1 the raster position of the light vertex is set if the result is not black.
+    glm::vec3 connect(const std::vector<Vertex> &lightPath, const std::vector<Vertex> &cameraPath, int s, int t, PathSampler &sampler, glm::vec2 &raster) const;
+    float misWeight(std::vector<Vertex> &lightPath, std::vector<Vertex> &cameraPath, const Vertex &sampled, int s, int t) const;
+
+    glm::vec3 brdf(const Vertex &vertex, const glm::vec3 &outgoing, const glm::vec3 &incoming) const;
+    float pdfArea(const Vertex &vertex, const Vertex *previous, const Vertex &next) const;
+    float pdfLight(const Vertex &light, const Vertex &next) const;
+    float pdfLightOrigin(const Vertex &light) const;
+    float lightProbability(size_t light) const;
+    bool visible(const Vertex &a, const Vertex &b) const;
+
+    // Raster position of the point and the cosine with the viewing direction, false if it is not in front of the camera
+    bool project(const glm::vec3 &point, glm::vec2 &raster, float &cosTheta) const;
+
+    const Scene *scene;
+    const BoundingVolumeHierarchy *bvh;
+    const AreaLights *lights;
+    int maxDepth;
+    glm::ivec2 resolution;
+    glm::vec3 origin;
+    glm::vec3 forward;
+    glm::vec3 right; // Towards normalized x = +1
+    glm::vec3 up; // Towards normalized y = +1
+    glm::vec2 tanHalfFov;
+    float filmArea; // Of the image on a plane at distance 1
+    std::vector<float> lightCdf; // Point lights by power, all area lights together last
+};
@@ -1,5 +1,6 @@
 #include "bounding_volume_hierarchy.h"
 #include "draw.h"
+#include "ray_statistics.h"
 
 static constexpr size_t BVH_SPLIT_STEPS = 16;
 static constexpr size_t BVH_MAX_DEPTH = 1 << 4;
@@ -20,7 +21,7 @@ static inline void resize(AxisAlignedBox &aabb, const glm::vec3 &vec) {
 static inline AxisAlignedBox toBox(const Mesh &mesh, const Triangle &triangle) {
     AxisAlignedBox aabb = AxisAlignedBox{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
     for (size_t i = 0; i < 3; i++) {
-        resize(aabb, mesh.vertices[triangle[i]].position);
+        resize(aabb, mesh.positions[triangle[i]]);
     }
     return aabb;
 }
@@ -32,7 +33,7 @@ BoundingVolumeHierarchy::BoundingVolumeHierarchy(const Scene *scene) {
     const std::vector<Mesh> &meshes = scene->meshes;
     for (size_t i = 0; i < meshes.size(); i++) {
         const Mesh &mesh = meshes[i];
-        const std::vector<Triangle> &triangles = mesh.triangles;
+        const MeshArray<Triangle> &triangles = mesh.triangles;
 
         for (size_t j = 0; j < triangles.size(); j++) {
             AxisAlignedBox box = toBox(meshes[i], triangles[j]);
@@ -76,41 +77,88 @@ size_t BoundingVolumeHierarchy::numLevels() const {
 }
 
 bool BoundingVolumeHierarchy::intersect(Ray &ray, HitInfo &hitInfo) const {
+    PrimitiveHit hit;
+    if (!traverse(ray, hit)) {
+        return false;
+    }
+
+    // The surface is only built for the closest hit
+    const Mesh &mesh = scene->meshes[hit.meshIdx];
+    const Triangle &triangle = mesh.triangles[hit.triangleIdx];
+    const glm::vec3 &v0 = mesh.positions[triangle[0]];
+    const glm::vec3 &v1 = mesh.positions[triangle[1]];
+    const glm::vec3 &v2 = mesh.positions[triangle[2]];
+    hitInfo.normal = trianglePlane(v0, v1, v2).normal;
+    // Turn the normal if it faces away from the ray origin
+    if (glm::dot(glm::normalize(ray.direction), hitInfo.normal) > 0.0F) {
+        hitInfo.normal *= -1;
+    }
+    hitInfo.material = mesh.material;
+    hitInfo.meshIdx = hit.meshIdx;
+    hitInfo.triangleIdx = hit.triangleIdx;
+    hitInfo.barycentric = triangleBarycentric(v0, v1, v2, ray.origin + ray.direction * ray.t);
+    return true;
+}
+
+bool BoundingVolumeHierarchy::traverse(Ray &ray, PrimitiveHit &hit) const {
     // Ray does not intersect this node
     // There is a chance the ray is inside the bounding box, so it does not intersect any face
     // This copy of the ray goes off to infinity, so it must intersect a face if the original ray is inside the bounding box
     Ray copy{ray.origin, ray.direction};
+    COUNT_RAY_STATISTIC(nodes, 1);
     if (!intersectRayWithShape(aabb, copy)) {
         return false;
     }
 
     // These bools are all marked as const so they are forcibly evaluated
     // This is because we care about the closest triangle we intersect, not just any triangle
-    const bool lh = left == NULL ? false : left->intersect(ray, hitInfo);
-    const bool rh = right == NULL ? false : right->intersect(ray, hitInfo);
-    const bool hit = intersectTriangles(ray, hitInfo);
+    const bool lh = left == NULL ? false : left->traverse(ray, hit);
+    const bool rh = right == NULL ? false : right->traverse(ray, hit);
+    const bool th = intersectTriangles(ray, hit);
 
-    return lh || rh || hit;
+    return lh || rh || th;
 }
 
-bool BoundingVolumeHierarchy::intersectTriangles(Ray &ray, HitInfo &hitInfo) const {
-    bool hit = false;
+bool BoundingVolumeHierarchy::intersectTriangles(Ray &ray, PrimitiveHit &hit) const {
+    if (blockCount == 0) {
+        return false;
+    }
 
-    // Triangles in this hierarchy
-    for (const auto [mi, ti] : indices) {
+    // All triangles in this hierarchy at once
+    COUNT_RAY_STATISTIC(triangles, indices.size());
+    const int64_t index = kernel(blocks.data(), blockCount, &ray.origin.x, &ray.direction.x, &ray.t);
+    if (index < 0) {
+        return false;
+    }
+    const auto &[mi, ti] = indices[size_t(index)];
+    hit = PrimitiveHit{mi, ti};
+    return true;
+}
+
+void BoundingVolumeHierarchy::buildLeaf(const std::vector<std::tuple<AxisAlignedBox, size_t, size_t>> &boxes) {
+    for (const auto &[_, mi, ti] : boxes) {
+        indices.push_back({mi, ti});
+    }
+
+    const TriangleKernelInfo info = triangleKernel(indices.size());
+    const size_t width = info.width;
+    kernel = info.intersect;
+    blockCount = (indices.size() + width - 1) / width;
+    blocks.assign(blockCount * 9 * width, 0.0F);
+    for (size_t i = 0; i < indices.size(); i++) {
+        const auto &[mi, ti] = indices[i];
         const Mesh &mesh = scene->meshes[mi];
         const Triangle &triangle = mesh.triangles[ti];
-        const Vertex &v0 = mesh.vertices[triangle[0]];
-        const Vertex &v1 = mesh.vertices[triangle[1]];
-        const Vertex &v2 = mesh.vertices[triangle[2]];
-        if (intersectRayWithTriangle(v0.position, v1.position, v2.position, ray, hitInfo)) {
-            hitInfo.material = mesh.material;
-            hitInfo.meshIdx = mi;
-            hit = true;
+        const glm::vec3 &v0 = mesh.positions[triangle[0]];
+        const glm::vec3 e1 = mesh.positions[triangle[1]] - v0;
+        const glm::vec3 e2 = mesh.positions[triangle[2]] - v0;
+        float *block = blocks.data() + (i / width) * 9 * width + i % width;
+        for (size_t j = 0; j < 3; j++) {
+            block[j * width] = v0[j];
+            block[(3 + j) * width] = e1[j];
+            block[(6 + j) * width] = e2[j];
         }
     }
-
-    return hit;
 }
 
 BoundingVolumeHierarchy::BoundingVolumeHierarchy() {
@@ -130,9 +178,7 @@ void BoundingVolumeHierarchy::populateTree(const std::vector<std::tuple<AxisAlig
 
     // If this needs to be a leaf
     if (boxes.size() <= BVH_LEAF_TRIANGLE_COUNT || depth == BVH_MAX_DEPTH) {
-        for (const auto &[_, mi, ti] : boxes) {
-            indices.push_back({mi, ti});
-        }
+        buildLeaf(boxes);
         return;
     }
 
@@ -201,9 +247,7 @@ void BoundingVolumeHierarchy::populateTree(const std::vector<std::tuple<AxisAlig
     // We do not find a good split so we just create one leaf node with all triangles
     // This should not really happen
     if (bestC == FLT_MAX) {
-        for (const auto &[box, mi, ti] : boxes) {
-            indices.push_back({mi, ti});
-        }
+        buildLeaf(boxes);
         return;
     }
 
@@ -2,6 +2,7 @@
 
 #include "ray_tracing.h"
 #include "scene.h"
+#include "simd.h"
 
 class BoundingVolumeHierarchy {
 public:
@@ -13,18 +14,33 @@ public:
 
     size_t numLevels() const;
 
+    // Leaves hitInfo as it is if the ray does not hit anything
     bool intersect(Ray &ray, HitInfo &hitInfo) const;
 
-    bool intersectTriangles(Ray &ray, HitInfo &hitInfo) const;
-
 private:
+    // All traversal keeps of the closest hit so far, t is in the ray
+    struct PrimitiveHit {
+        size_t meshIdx;
+        size_t triangleIdx;
+    };
+
     BoundingVolumeHierarchy();
 
+    bool traverse(Ray &ray, PrimitiveHit &hit) const;
+
+    bool intersectTriangles(Ray &ray, PrimitiveHit &hit) const;
+
+    void buildLeaf(const std::vector<std::tuple<AxisAlignedBox, size_t, size_t>> &boxes);
+
     void populateTree(const std::vector<std::tuple<AxisAlignedBox, size_t, size_t>> &boxes, size_t depth);
 
     const Scene *scene = NULL;
     AxisAlignedBox aabb = AxisAlignedBox{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
     std::vector<std::tuple<size_t, size_t>> indices;
+    // Triangles of a leaf in the layout of its kernel (see simd.h), padded to whole blocks
+    std::vector<float> blocks;
+    size_t blockCount = 0;
+    TriangleKernel kernel = NULL;
     BoundingVolumeHierarchy *left = NULL;
     BoundingVolumeHierarchy *right = NULL;
 };
@@ -0,0 +1,84 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+#include "bsdf.h"
+
+static constexpr float PI = 3.14159265358979323846F;
+
+static float luminance(const glm::vec3 &color) {
+    return glm::dot(color, glm::vec3(0.2126F, 0.7152F, 0.0722F));
+}
+
+BSDF::BSDF(const Material &material, const glm::vec3 &surfaceNormal, const glm::vec3 &outgoingDirection)
+    : normal(surfaceNormal), outgoing(outgoingDirection), ks(material.ks), shininess(std::max(material.shininess, 0.0F)) {
+    if (std::fabs(normal.x) > std::fabs(normal.y)) {
+        tangent = glm::vec3(normal.z, 0.0F, -normal.x);
+    } else {
+        tangent = glm::vec3(0.0F, -normal.z, normal.y);
+    }
+    tangent = glm::normalize(tangent);
+    bitangent = glm::cross(normal, tangent);
+
+    const float diffuseEnergy = luminance(material.kd);
+    const float specularEnergy = luminance(material.ks);
+    specular = specularEnergy > 0.0F ? specularEnergy / (diffuseEnergy + specularEnergy) : 0.0F;
+}
+
+glm::vec3 BSDF::toWorld(const glm::vec3 &v) const {
+    return v.x * bitangent + v.y * normal + v.z * tangent;
+}
+
+BSDFSample BSDF::sample(const glm::vec2 &u) const {
+    glm::vec3 direction;
+    if (u.x < specular) {
+        // Half vector distributed like cos^n around the normal, reflected around it
+        const float u1 = u.x / specular;
+        const float cosTheta = std::pow(u1, 1.0F / (shininess + 1.0F));
+        const float sinTheta = std::sqrt(std::max(1.0F - cosTheta * cosTheta, 0.0F));
+        const float phi = 2.0F * PI * u.y;
+        const glm::vec3 half = toWorld(glm::vec3(sinTheta * std::cos(phi), cosTheta, sinTheta * std::sin(phi)));
+        direction = 2.0F * glm::dot(outgoing, half) * half - outgoing;
+    } else {
+        // Cosine weighted (Malley's method)
+        const float u1 = (u.x - specular) / (1.0F - specular);
+        const float r = std::sqrt(u1);
+        const float phi = 2.0F * PI * u.y;
+        direction = toWorld(glm::vec3(r * std::cos(phi), std::sqrt(std::max(1.0F - u1, 0.0F)), r * std::sin(phi)));
+    }
+    direction = glm::normalize(direction);
+    return BSDFSample{direction, glm::dot(direction, normal) > 0.0F ? pdf(direction) : 0.0F};
+}
+
+float BSDF::pdf(const glm::vec3 &direction) const {
+    const float cosTheta = glm::dot(direction, normal);
+    if (cosTheta <= 0.0F) {
+        return 0.0F;
+    }
+
+    float out = (1.0F - specular) * cosTheta / PI;
+    if (specular > 0.0F) {
+        const glm::vec3 half = glm::normalize(direction + outgoing);
+        const float cosHalf = std::max(glm::dot(half, normal), 0.0F);
+        const float halfPdf = (shininess + 1.0F) / (2.0F * PI) * std::pow(cosHalf, shininess);
+        out += specular * halfPdf / (4.0F * std::max(glm::dot(outgoing, half), 1e-6F));
+    }
+    return out;
+}
+
+glm::vec3 BSDF::eval(const glm::vec3 &direction) const {
+    const float cosTheta = glm::dot(direction, normal);
+    if (cosTheta <= 0.0F) {
+        return glm::vec3(0.0F);
+    }
+
+    // The lobes are summed, how often each of them is sampled only matters for the pdf
+    glm::vec3 out = glm::vec3(1.0F / PI);
+    if (specular > 0.0F) {
+        const float cosHalf = std::max(glm::dot(glm::normalize(direction + outgoing), normal), 0.0F);
+        out += ks * (shininess + 8.0F) / (8.0F * PI) * std::pow(cosHalf, shininess);
+    }
+    return out * cosTheta;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include "mesh.h"
+
+struct BSDFSample {
+    glm::vec3 direction;
+    float pdf; // Per unit solid angle, 0 if the sample is below the surface
+};
+
+// Reflection of indirect light at a hit: a white Lambert lobe (the color of indirect light is up to the transforms) plus a
+// normalized Blinn-Phong lobe of color ks. Directions are sampled from one of the lobes, picked by the energy of kd and ks.
+// get_color reflects ks with a mirror ray, so it only uses the Lambert lobe (a default Material).
+class BSDF {
+public:
+    // Outgoing points away from the surface, towards where the light goes
+    BSDF(const Material &material, const glm::vec3 &normal, const glm::vec3 &outgoing);
+
+    BSDFSample sample(const glm::vec2 &u) const;
+
+    float pdf(const glm::vec3 &direction) const;
+
+    // BRDF times the cosine of the direction with the normal
+    glm::vec3 eval(const glm::vec3 &direction) const;
+
+private:
+    glm::vec3 toWorld(const glm::vec3 &v) const;
+
+    glm::vec3 normal;
+    glm::vec3 tangent;
+    glm::vec3 bitangent;
+    glm::vec3 outgoing;
+    glm::vec3 ks;
+    float shininess;
+    float specular; // Probability of sampling the Blinn-Phong lobe
+};
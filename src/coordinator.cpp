@@ -0,0 +1,413 @@
+#include <cerrno>
+#include <cstdint>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "coordinator.h"
+#include "profiler.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+#ifndef _WIN32
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// A tile that fails this many times aborts the render
+static constexpr size_t MAX_TILE_ATTEMPTS = 3;
+// Sent once by a worker when it is set up, its first tile only counts against the timeout from then on
+static constexpr char WORKER_READY = 'R';
+
+// Sent by a worker in front of the pixels of a finished tile.
+// Workers always run on the same machine, so native byte order and padding are fine.
+struct TileHeader {
+    int32_t lower[2];
+    int32_t upper[2];
+    uint64_t rays;
+    RayStatistics statistics;
+};
+
+// Followed by one of these for every pixel of the tile, row by row
+struct TilePixel {
+    glm::vec3 color;
+    AOVSample aovs;
+};
+
+static size_t tileBytes(const Tile &tile) {
+    const glm::ivec2 size = tile.upper - tile.lower;
+    return sizeof(TileHeader) + size_t(size.x) * size_t(size.y) * sizeof(TilePixel);
+}
+
+int runWorker(const RenderJob &job, const std::filesystem::path &dataDir) {
+    const Scene scene = loadJobScene(job, dataDir);
+    const BoundingVolumeHierarchy bvh{&scene};
+    const AreaLights lights{&scene};
+    const PointLightTree pointLights{&scene};
+    const Trackball camera = jobCamera(job);
+    Transforms transforms = identityTransforms(scene);
+    ShadingData data = ShadingData{false, job.depth, job.samples, &transforms, job.sampler, job.jitter, &lights, &pointLights, job.lightSamples};
+    data.mode = job.mode;
+    // Every worker shoots the same photons
+    const std::optional<PhotonMap> photons = jobPhotonMap(job, scene, bvh, lights, transforms);
+    data.photons = photons ? &*photons : nullptr;
+    // Records are shared by the tiles of a worker, not between workers
+    const std::unique_ptr<IrradianceCache> cache = jobIrradianceCache(job, scene);
+    data.irradiance_cache = cache.get();
+    // Traced before the guide so its training uses them too
+    const std::unique_ptr<ShadowMaps> shadowMaps = jobShadowMaps(job, scene, bvh);
+    data.shadow_maps = shadowMaps.get();
+    // Every worker trains its own guide on the whole image
+    const std::unique_ptr<PathGuide> guide = jobPathGuide(job, scene, camera, bvh, data);
+    data.guide = guide.get();
+    Screen screen{size_t(job.width), size_t(job.height)};
+    AOVBuffers aovs{screen.resolution()};
+    std::cout.put(WORKER_READY);
+    std::cout.flush();
+
+    // One tile per line: "lower.x lower.y upper.x upper.y", the coordinator closes stdin when it is done
+    Tile tile;
+    while (std::cin >> tile.lower.x >> tile.lower.y >> tile.upper.x >> tile.upper.y) {
+        tile.lower = glm::clamp(tile.lower, glm::ivec2(0), screen.resolution());
+        tile.upper = glm::clamp(tile.upper, tile.lower, screen.resolution());
+        const RenderStats stats = renderTile(scene, camera, bvh, data, job.seed.value_or(0), tile, screen, &aovs);
+
+        TileHeader header{{tile.lower.x, tile.lower.y}, {tile.upper.x, tile.upper.y}, stats.rays, stats.statistics};
+        std::vector<TilePixel> pixels;
+        pixels.reserve(stats.pixels);
+        for (int y = tile.lower.y; y < tile.upper.y; y++) {
+            for (int x = tile.lower.x; x < tile.upper.x; x++) {
+                pixels.push_back(TilePixel{screen.getPixel(size_t(x), size_t(y)), aovs.get(x, y)});
+            }
+        }
+        std::cout.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        std::cout.write(reinterpret_cast<const char *>(pixels.data()), std::streamsize(pixels.size() * sizeof(TilePixel)));
+        std::cout.flush();
+        if (!std::cout) {
+            // The coordinator went away
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+#ifndef _WIN32
+
+struct Worker {
+    pid_t pid = -1;
+    int input = -1; // Tile commands to the worker
+    int output = -1; // Results from the worker
+    std::optional<size_t> tile; // Tile being rendered
+    ProfileClock::time_point started; // When the process was started
+    bool ready = false; // Done with loading the scene and everything else before the first tile
+    ProfileClock::time_point tileStart; // When the tile was handed out, or when the worker got ready for its first tile
+    std::vector<char> buffer;
+};
+
+static bool spawnWorker(const std::vector<std::string> &args, Worker &worker) {
+    int toWorker[2];
+    int fromWorker[2];
+    if (pipe(toWorker) != 0) {
+        return false;
+    }
+    if (pipe(fromWorker) != 0) {
+        close(toWorker[0]);
+        close(toWorker[1]);
+        return false;
+    }
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        for (int fd : {toWorker[0], toWorker[1], fromWorker[0], fromWorker[1]}) {
+            close(fd);
+        }
+        return false;
+    }
+
+    if (pid == 0) {
+        dup2(toWorker[0], STDIN_FILENO);
+        dup2(fromWorker[1], STDOUT_FILENO);
+        for (int fd : {toWorker[0], toWorker[1], fromWorker[0], fromWorker[1]}) {
+            close(fd);
+        }
+        std::vector<char *> argv;
+        for (const std::string &arg : args) {
+            argv.push_back(const_cast<char *>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        execvp(argv[0], argv.data());
+        std::cerr << "Failed to start worker " << args[0] << ": " << std::strerror(errno) << std::endl;
+        _exit(127);
+    }
+
+    close(toWorker[0]);
+    close(fromWorker[1]);
+    // Workers started later must not inherit these, otherwise a pipe does not close when its worker dies
+    fcntl(toWorker[1], F_SETFD, FD_CLOEXEC);
+    fcntl(fromWorker[0], F_SETFD, FD_CLOEXEC);
+
+    worker.pid = pid;
+    worker.input = toWorker[1];
+    worker.output = fromWorker[0];
+    worker.started = ProfileClock::now();
+    worker.ready = false;
+    worker.tile.reset();
+    worker.buffer.clear();
+    return true;
+}
+
+static void stopWorker(Worker &worker, const bool kill) {
+    if (worker.pid < 0) {
+        return;
+    }
+    close(worker.input);
+    close(worker.output);
+    if (kill) {
+        ::kill(worker.pid, SIGKILL);
+    }
+    waitpid(worker.pid, nullptr, 0);
+    worker.pid = -1;
+}
+
+static bool writeAll(int fd, const std::string &str) {
+    size_t written = 0;
+    while (written < str.size()) {
+        const ssize_t n = write(fd, str.data() + written, str.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += size_t(n);
+    }
+    return true;
+}
+
+static std::vector<Tile> splitTiles(const glm::ivec2 &resolution, int tileSize) {
+    std::vector<Tile> tiles;
+    // Start at the top of the image, that is where the first pixels of the bitmap are
+    for (int y = resolution.y; y > 0; y -= tileSize) {
+        for (int x = 0; x < resolution.x; x += tileSize) {
+            tiles.push_back(Tile{glm::ivec2(x, std::max(0, y - tileSize)), glm::ivec2(std::min(resolution.x, x + tileSize), y)});
+        }
+    }
+    return tiles;
+}
+
+RenderStats renderWithWorkers(const RenderJob &job, Screen &screen, AOVBuffers *aovs, CoordinatorStats &stats, const ProgressOutput &progress) {
+    // Both use pixels of the whole image for every pixel, so tiles rendered separately would not add up to the same image
+    if (job.restir) {
+        throw std::runtime_error("ReSTIR reuses the reservoirs of neighbouring pixels and cannot be rendered with --workers");
+    }
+    if (job.mode == RenderMode::Bidirectional) {
+        throw std::runtime_error("Bidirectional path tracing splats light paths onto the whole image and cannot be rendered with --workers");
+    }
+    // Writing to a worker that died must not kill the coordinator
+    std::signal(SIGPIPE, SIG_IGN);
+
+    RenderJob workerJob = job;
+    if (workerJob.threads == 0) {
+        // Spread the cores over the workers instead of every worker using all of them
+        workerJob.threads = std::max(1, int(std::thread::hardware_concurrency()) / job.workers);
+    }
+    const std::vector<std::string> args = workerArguments(workerJob);
+
+    const std::vector<Tile> tiles = splitTiles(screen.resolution(), job.tileSize);
+    std::vector<size_t> attempts(tiles.size(), 0);
+    std::deque<size_t> pending;
+    for (size_t i = 0; i < tiles.size(); i++) {
+        pending.push_back(i);
+    }
+
+    stats = CoordinatorStats{tiles.size(), 0};
+    RenderStats renderStats{0, 0, RayStatistics{}};
+    size_t finished = 0;
+
+    std::vector<Worker> workers(size_t(job.workers));
+    for (Worker &worker : workers) {
+        if (!spawnWorker(args, worker)) {
+            std::cerr << "Failed to start a worker process: " << std::strerror(errno) << std::endl;
+        }
+    }
+
+    auto fail = [&](Worker &worker) {
+        stopWorker(worker, true);
+        if (worker.tile) {
+            const size_t tile = *worker.tile;
+            worker.tile.reset();
+            if (++attempts[tile] >= MAX_TILE_ATTEMPTS) {
+                for (Worker &w : workers) {
+                    stopWorker(w, true);
+                }
+                throw std::runtime_error("Tile " + std::to_string(tile) + " failed " + std::to_string(attempts[tile]) + " times, giving up.");
+            }
+            stats.retries++;
+            pending.push_front(tile);
+        }
+        if (!spawnWorker(args, worker)) {
+            std::cerr << "Failed to restart a worker process: " << std::strerror(errno) << std::endl;
+        }
+    };
+
+    // Same progress output as a render in one process, counted as the tiles come in
+    const glm::ivec2 resolution = screen.resolution();
+    RenderProgress counters{size_t(resolution.x) * size_t(resolution.y), size_t(job.photons > 0 ? std::max(job.photonPasses, 1) : 1)};
+    const ProgressReporter reporter{counters, progress};
+
+    const std::chrono::seconds tileTimeout{job.tileTimeout};
+    while (finished < tiles.size()) {
+        // Restart workers that are stuck, their tiles are handed out again
+        if (job.tileTimeout > 0) {
+            for (Worker &worker : workers) {
+                if (worker.pid >= 0 && worker.ready && worker.tile && ProfileClock::now() - worker.tileStart >= tileTimeout) {
+                    std::cerr << "Worker " << worker.pid << " took longer than " << job.tileTimeout << " s for its tile, retrying." << std::endl;
+                    fail(worker);
+                }
+            }
+        }
+
+        // Hand out tiles to idle workers
+        for (Worker &worker : workers) {
+            if (worker.pid < 0 || worker.tile || pending.empty()) {
+                continue;
+            }
+            worker.tile = pending.front();
+            worker.tileStart = ProfileClock::now();
+            pending.pop_front();
+            const Tile &tile = tiles[*worker.tile];
+            const std::string command = std::to_string(tile.lower.x) + " " + std::to_string(tile.lower.y) + " " + std::to_string(tile.upper.x) + " " + std::to_string(tile.upper.y) + "\n";
+            if (!writeAll(worker.input, command)) {
+                fail(worker);
+            }
+        }
+
+        // Wait at most until the first worker runs out of time
+        std::vector<pollfd> fds;
+        std::vector<Worker *> polled;
+        int timeout = -1;
+        const ProfileClock::time_point now = ProfileClock::now();
+        for (Worker &worker : workers) {
+            if (worker.pid >= 0 && worker.tile) {
+                fds.push_back(pollfd{worker.output, POLLIN, 0});
+                polled.push_back(&worker);
+                if (job.tileTimeout > 0 && worker.ready) {
+                    const ProfileClock::duration left = worker.tileStart + tileTimeout - now;
+                    const int milliseconds = int(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::milliseconds>(left).count() + 1));
+                    timeout = timeout < 0 ? milliseconds : std::min(timeout, milliseconds);
+                }
+            }
+        }
+        if (fds.empty()) {
+            throw std::runtime_error("No worker processes left.");
+        }
+        if (poll(fds.data(), fds.size(), timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("poll failed: ") + std::strerror(errno));
+        }
+
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            Worker &worker = *polled[i];
+            if (!worker.ready) {
+                // Setup can take far longer than a tile, so the timeout of the tile starts now
+                char ready = 0;
+                const ssize_t n = read(worker.output, &ready, 1);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0 || ready != WORKER_READY) {
+                    std::cerr << "Worker " << worker.pid << " failed while setting up, retrying its tile." << std::endl;
+                    fail(worker);
+                    continue;
+                }
+                worker.ready = true;
+                worker.tileStart = ProfileClock::now();
+                profileEvent("worker setup", worker.started, worker.tileStart, uint32_t(&worker - workers.data()) + 1);
+                continue;
+            }
+            const Tile &tile = tiles[*worker.tile];
+            const size_t expected = tileBytes(tile);
+
+            const size_t offset = worker.buffer.size();
+            worker.buffer.resize(expected);
+            const ssize_t n = read(worker.output, worker.buffer.data() + offset, expected - offset);
+            if (n < 0 && errno == EINTR) {
+                worker.buffer.resize(offset);
+                continue;
+            }
+            if (n <= 0) {
+                std::cerr << "Worker " << worker.pid << " failed, retrying its tile." << std::endl;
+                fail(worker);
+                continue;
+            }
+            worker.buffer.resize(offset + size_t(n));
+            if (worker.buffer.size() < expected) {
+                continue;
+            }
+
+            TileHeader header;
+            std::memcpy(&header, worker.buffer.data(), sizeof(header));
+            if (header.lower[0] != tile.lower.x || header.lower[1] != tile.lower.y || header.upper[0] != tile.upper.x || header.upper[1] != tile.upper.y) {
+                std::cerr << "Worker " << worker.pid << " sent the wrong tile, retrying." << std::endl;
+                fail(worker);
+                continue;
+            }
+
+            // Merge the tile into the final image
+            const char *pixels = worker.buffer.data() + sizeof(header);
+            for (int y = tile.lower.y; y < tile.upper.y; y++) {
+                for (int x = tile.lower.x; x < tile.upper.x; x++) {
+                    TilePixel pixel;
+                    std::memcpy(&pixel, pixels, sizeof(pixel));
+                    pixels += sizeof(pixel);
+                    screen.setPixel(size_t(x), size_t(y), pixel.color);
+                    if (aovs != nullptr) {
+                        aovs->set(x, y, pixel.aovs);
+                    }
+                }
+            }
+            const glm::ivec2 size = tile.upper - tile.lower;
+            renderStats.pixels += size_t(size.x) * size_t(size.y);
+            renderStats.rays += header.rays;
+            counters.add(size_t(size.x) * size_t(size.y), header.rays);
+            renderStats.statistics += header.statistics;
+            // Every worker has a timeline of its own in the profile
+            profileEvent("tile", worker.tileStart, ProfileClock::now(), uint32_t(&worker - workers.data()) + 1);
+            worker.tile.reset();
+            worker.buffer.clear();
+
+            finished++;
+        }
+    }
+
+    // Closing stdin lets the workers exit
+    for (Worker &worker : workers) {
+        stopWorker(worker, false);
+    }
+    return renderStats;
+}
+
+#else
+
+RenderStats renderWithWorkers(const RenderJob &job, Screen &screen, AOVBuffers *aovs, CoordinatorStats &stats, const ProgressOutput &progress) {
+    (void) job;
+    (void) screen;
+    (void) aovs;
+    (void) stats;
+    (void) progress;
+    throw std::runtime_error("Worker processes are not supported on this platform.");
+}
+
+#endif
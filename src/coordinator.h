@@ -0,0 +1,20 @@
+#pragma once
+
+#include <filesystem>
+#include "headless.h"
+#include "render.h"
+#include "screen.h"
+
+struct CoordinatorStats {
+    size_t tiles;
+    size_t retries;
+};
+
+// Splits the image into tiles and renders them in job.workers local worker processes which communicate over pipes.
+// A worker that fails is restarted and its tile is handed out again, a tile that keeps failing aborts the render.
+// The render passes are filled as well if given. Progress is reported to the given output as the tiles come in.
+RenderStats renderWithWorkers(const RenderJob &job, Screen &screen, AOVBuffers *aovs, CoordinatorStats &stats, const ProgressOutput &progress = ProgressOutput{});
+
+// Worker process: loads the scene once and writes a ready byte to stdout, then renders the tiles it reads from stdin and writes
+// the pixels to stdout.
+int runWorker(const RenderJob &job, const std::filesystem::path &dataDir);
@@ -0,0 +1,91 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <cfloat>
+#include <cmath>
+#include "denoiser.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+// B3 spline, the 5x5 filter is the outer product of these weights
+static constexpr float KERNEL[5] = {1.0F / 16.0F, 1.0F / 4.0F, 3.0F / 8.0F, 1.0F / 4.0F, 1.0F / 16.0F};
+
+static inline float distance2(const glm::vec3 &a, const glm::vec3 &b) {
+    const glm::vec3 d = a - b;
+    return glm::dot(d, d);
+}
+
+void denoise(Screen &screen, const AOVBuffers &aovs, const DenoiseSettings &settings) {
+    const glm::ivec2 resolution = aovs.resolution;
+    const size_t size = size_t(resolution.x) * size_t(resolution.y);
+
+    std::vector<glm::vec3> in(size);
+    std::vector<glm::vec3> out(size);
+    for (int y = 0; y < resolution.y; y++) {
+        for (int x = 0; x < resolution.x; x++) {
+            in[size_t(y) * size_t(resolution.x) + size_t(x)] = screen.getPixel(size_t(x), size_t(y));
+        }
+    }
+
+    // Negative inverse variances, so every weight is a single exp
+    const float normalFactor = -1.0F / (settings.normalSigma * settings.normalSigma);
+    const float albedoFactor = -1.0F / (settings.albedoSigma * settings.albedoSigma);
+    const float depthFactor = -1.0F / settings.depthSigma;
+
+    for (int iteration = 0; iteration < settings.iterations; iteration++) {
+        const int step = 1 << iteration;
+        // Details get smaller relative to the filter size, so colors should be more alike every iteration
+        const float colorSigma = settings.colorSigma / float(step);
+        const float colorFactor = -1.0F / (colorSigma * colorSigma);
+
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+        for (int y = 0; y < resolution.y; y++) {
+            for (int x = 0; x < resolution.x; x++) {
+                const size_t i = size_t(y) * size_t(resolution.x) + size_t(x);
+                const glm::vec3 color = in[i];
+                const glm::vec3 normal = aovs.normal[i];
+                const glm::vec3 albedo = aovs.albedo[i];
+                const float depth = aovs.depth[i];
+                const float depthScale = depthFactor / (std::max(depth, 1E-3F) * float(step));
+
+                glm::vec3 sum{0.0F};
+                float weights = 0.0F;
+                for (int dy = -2; dy <= 2; dy++) {
+                    const int qy = y + dy * step;
+                    if (qy < 0 || qy >= resolution.y) {
+                        continue;
+                    }
+                    for (int dx = -2; dx <= 2; dx++) {
+                        const int qx = x + dx * step;
+                        if (qx < 0 || qx >= resolution.x) {
+                            continue;
+                        }
+                        const size_t j = size_t(qy) * size_t(resolution.x) + size_t(qx);
+
+                        const float exponent = colorFactor * distance2(in[j], color)
+                            + normalFactor * distance2(aovs.normal[j], normal)
+                            + albedoFactor * distance2(aovs.albedo[j], albedo)
+                            + depthScale * std::abs(aovs.depth[j] - depth);
+                        const float weight = KERNEL[dx + 2] * KERNEL[dy + 2] * std::exp(exponent);
+                        sum += weight * in[j];
+                        weights += weight;
+                    }
+                }
+
+                // The center pixel always has a weight > 0
+                out[i] = sum / weights;
+            }
+        }
+        std::swap(in, out);
+    }
+
+    for (int y = 0; y < resolution.y; y++) {
+        for (int x = 0; x < resolution.x; x++) {
+            screen.setPixel(size_t(x), size_t(y), in[size_t(y) * size_t(resolution.x) + size_t(x)]);
+        }
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "aov.h"
+#include "screen.h"
+
+struct DenoiseSettings {
+    int iterations = 5; // Filter radius is 2^(iterations + 1) pixels
+    float colorSigma = 0.5F;
+    float normalSigma = 0.3F;
+    float depthSigma = 0.1F; // Relative to the depth of the center pixel
+    float albedoSigma = 0.1F;
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) guided by the albedo, normal and depth passes.
+void denoise(Screen &screen, const AOVBuffers &aovs, const DenoiseSettings &settings);
@@ -36,9 +36,8 @@ void drawMesh(const Mesh& mesh) {
     glBegin(GL_TRIANGLES);
     for (const Triangle &triangleIndex : mesh.triangles) {
         for (size_t i = 0; i < 3; i++) {
-            const Vertex &vertex = mesh.vertices[triangleIndex[i]];
-            glNormal3fv(glm::value_ptr(vertex.normal)); // Normal.
-            glVertex3fv(glm::value_ptr(vertex.position)); // Position.
+            glNormal3fv(glm::value_ptr(mesh.normals[triangleIndex[i]])); // Normal.
+            glVertex3fv(glm::value_ptr(mesh.positions[triangleIndex[i]])); // Position.
         }
     }
     glEnd();
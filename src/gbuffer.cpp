@@ -0,0 +1,36 @@
+#include "gbuffer.h"
+
+bool GBuffer::Key::operator==(const Key &other) const {
+    // Without jitter every ray goes through the corner of its pixel, whatever the samples are
+    const bool sameOffsets = jitter == other.jitter && (!jitter || (sampler == other.sampler && seed == other.seed));
+    return view == other.view && projection == other.projection && resolution == other.resolution && sameOffsets;
+}
+
+void GBuffer::update(const Trackball &camera, const glm::ivec2 &resolution, SamplerType sampler, bool jitter, unsigned int seed) {
+    const Key current = Key{camera.viewMatrix(), camera.projectionMatrix(), resolution, sampler, jitter, seed};
+    if (current == key && !entries.empty()) {
+        return;
+    }
+    key = current;
+    entries.assign(size_t(resolution.x) * size_t(resolution.y), Entry{});
+}
+
+bool GBuffer::get(const Scene &scene, int x, int y, Ray &ray, HitInfo &hitInfo) const {
+    const Entry &entry = entries[size_t(y) * size_t(key.resolution.x) + size_t(x)];
+    if (!entry.traced) {
+        return false;
+    }
+    ray = entry.ray;
+    hitInfo = entry.hitInfo;
+    if (hitInfo.meshIdx != SIZE_MAX) {
+        hitInfo.material = scene.meshes[hitInfo.meshIdx].material;
+    }
+    return true;
+}
+
+void GBuffer::set(int x, int y, const Ray &ray, const HitInfo &hitInfo) {
+    Entry &entry = entries[size_t(y) * size_t(key.resolution.x) + size_t(x)];
+    entry.ray = ray;
+    entry.hitInfo = hitInfo;
+    entry.traced = true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <vector>
+#include "ray_tracing.h"
+#include "sampler.h"
+#include "scene.h"
+#include "trackball.h"
+
+// First hits of the camera rays of every pixel, kept between renders so that moving lights or editing materials only needs shading and
+// secondary rays. The hits depend on the camera and the offsets of the rays in the pixels; the material is looked up again every time.
+// With jitter the offsets come from the seed, so renders with another seed every frame (the progressive preview) are not cached.
+// The geometry of a scene never changes, a new scene needs a new buffer.
+class GBuffer {
+public:
+    // Forgets all hits if the camera, the resolution or the pixel offsets changed since they were traced
+    void update(const Trackball &camera, const glm::ivec2 &resolution, SamplerType sampler, bool jitter, unsigned int seed);
+
+    // Camera ray of the pixel with t set to the hit, false if it was not traced yet. meshIdx is SIZE_MAX if the ray missed.
+    bool get(const Scene &scene, int x, int y, Ray &ray, HitInfo &hitInfo) const;
+
+    // Can be called from many threads for different pixels
+    void set(int x, int y, const Ray &ray, const HitInfo &hitInfo);
+
+private:
+    struct Key {
+        glm::mat4 view { 1.0F };
+        glm::mat4 projection { 1.0F };
+        glm::ivec2 resolution { 0 };
+        SamplerType sampler = SamplerType::Random;
+        bool jitter = false;
+        unsigned int seed = 0;
+
+        bool operator==(const Key &other) const;
+    };
+
+    struct Entry {
+        Ray ray;
+        HitInfo hitInfo;
+        bool traced = false;
+    };
+
+    Key key;
+    std::vector<Entry> entries;
+};
@@ -0,0 +1,721 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/trigonometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include "bounding_volume_hierarchy.h"
+#include "coordinator.h"
+#include "denoiser.h"
+#include "headless.h"
+#include "illumination.h"
+#include "profiler.h"
+#include "render.h"
+#include "scene_file.h"
+#include "screen.h"
+#include "trackball.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [--headless] [--job <file>] [options]" << std::endl;
+    std::cerr << "Without --headless or --job the interactive application is started." << std::endl;
+    std::cerr << "Options (also accepted as \"key = value\" lines in a job file):" << std::endl;
+    std::cerr << "  --scene <name|file>     CornellBox, a mesh file or a binary .scene file (default CornellBox)" << std::endl;
+    std::cerr << "  --trust-scene <0|1>     Load a .scene file without checking its triangle indices, only for files you wrote (default 0)" << std::endl;
+    std::cerr << "  --light <x,y,z[,r,g,b]> Point light, may be repeated (default: lights of the scene)" << std::endl;
+    std::cerr << "  --width <pixels>        (default 800)" << std::endl;
+    std::cerr << "  --height <pixels>       (default 800)" << std::endl;
+    std::cerr << "  --depth <traces>        (default 3)" << std::endl;
+    std::cerr << "  --samples <count>       (default 32)" << std::endl;
+    std::cerr << "  --light-samples <count> Point lights shaded per hit, picked by a light hierarchy when there are more (default 4)" << std::endl;
+    std::cerr << "  --seed <value>          (default: time based)" << std::endl;
+    std::cerr << "  --sampler <name>        random, halton, sobol or blue-noise (default random)" << std::endl;
+    std::cerr << "  --jitter <0|1>          Random position inside each pixel (default 0)" << std::endl;
+    std::cerr << "  --denoise <0|1>         Denoise the image guided by albedo, normal and depth (default 0)" << std::endl;
+    std::cerr << "  --photons <count>       Photons per pass, replaces traced indirect light by a photon map (default 0)" << std::endl;
+    std::cerr << "  --photon-passes <count> Passes of progressive photon mapping with a shrinking radius (default 1)" << std::endl;
+    std::cerr << "  --photon-radius <r>     Photon gather radius of the first pass (default 0.05)" << std::endl;
+    std::cerr << "  --irradiance-cache <a>  Interpolate diffuse indirect light from cached records, smaller is more accurate (default 0: off)" << std::endl;
+    std::cerr << "  --cache-rays <count>    Hemisphere rays per irradiance cache record (default 256)" << std::endl;
+    std::cerr << "  --guiding <passes>      Learn where indirect light comes from in this many training passes (default 0: off)" << std::endl;
+    std::cerr << "  --restir <0|1>          Pick the point lights at the first hit by spatial reservoir resampling, one shadow ray per pixel (default 0)" << std::endl;
+    std::cerr << "  --shadow-maps <texels>  Answer most point light shadow rays from cube maps of this resolution per face (default 0: off)" << std::endl;
+    std::cerr << "  --simd <name>           Highest instruction set of the ray/triangle tests: auto, scalar, sse4.2, avx2 or avx512 (default auto)" << std::endl;
+    std::cerr << "  --mode <name>           path, wavefront (the same image, traced in batches) or bidirectional, samples are paths per pixel for bidirectional (default path)" << std::endl;
+    std::cerr << "  --look-at <x,y,z>       (default 0,0,0)" << std::endl;
+    std::cerr << "  --rotation <x,y,z>      Euler angles in degrees (default 20,20,0)" << std::endl;
+    std::cerr << "  --distance <d>          Distance to the look at point (default 3)" << std::endl;
+    std::cerr << "  --fov <degrees>         Vertical field of view (default 50)" << std::endl;
+    std::cerr << "  --output <file>         Bitmap to write (default render.bmp)" << std::endl;
+    std::cerr << "  --aovs <file>           Also write depth, normal, albedo, mesh ID, direct and indirect passes to an OpenEXR file" << std::endl;
+    std::cerr << "  --profile <file>        Also write a timeline of the render phases per thread as Chrome trace events (JSON)" << std::endl;
+    std::cerr << "  --progress-log <file>   Also write the progress, ETA, rays/s and samples/s four times a second as JSON lines" << std::endl;
+    std::cerr << "  --heat-maps <file>      Also write bitmaps of the BVH nodes and triangles tested per pixel (file-nodes.bmp, file-triangles.bmp)," << std::endl;
+    std::cerr << "                          only in builds with the CMake option RAY_STATISTICS" << std::endl;
+    std::cerr << "  --convert <file.scene>  Write the scene with its lights to a binary scene file instead of rendering" << std::endl;
+    std::cerr << "  --threads <count>       Render threads per process (default: all cores)" << std::endl;
+    std::cerr << "  --workers <count>       Render tiles in this many local worker processes (default 0)" << std::endl;
+    std::cerr << "  --tile-size <pixels>    Tile size for the worker processes (default 64)" << std::endl;
+    std::cerr << "  --tile-timeout <s>      Restart a worker that takes longer for a tile, 0 waits forever (default 600)" << std::endl;
+}
+
+static std::vector<float> parseFloats(const std::string &key, const std::string &value) {
+    std::vector<float> out;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        try {
+            size_t end;
+            out.push_back(std::stof(item, &end));
+            if (item.find_first_not_of(" \t", end) != std::string::npos) {
+                throw std::invalid_argument(item);
+            }
+        } catch (const std::logic_error &) {
+            throw std::runtime_error("Invalid number \"" + item + "\" for " + key);
+        }
+    }
+    return out;
+}
+
+static float parseFloat(const std::string &key, const std::string &value) {
+    std::vector<float> floats = parseFloats(key, value);
+    if (floats.size() != 1) {
+        throw std::runtime_error(key + " expects a single number");
+    }
+    return floats[0];
+}
+
+static glm::vec3 parseVec3(const std::string &key, const std::string &value) {
+    std::vector<float> floats = parseFloats(key, value);
+    if (floats.size() != 3) {
+        throw std::runtime_error(key + " expects three comma separated numbers");
+    }
+    return glm::vec3(floats[0], floats[1], floats[2]);
+}
+
+static long long parseInteger(const std::string &key, const std::string &value, long long min, long long max) {
+    long long out;
+    try {
+        size_t end;
+        out = std::stoll(value, &end);
+        if (end != value.size()) {
+            throw std::invalid_argument(value);
+        }
+    } catch (const std::logic_error &) {
+        throw std::runtime_error("Invalid integer \"" + value + "\" for " + key);
+    }
+    if (out < min || out > max) {
+        throw std::runtime_error(key + " must be between " + std::to_string(min) + " and " + std::to_string(max));
+    }
+    return out;
+}
+
+// Finite numbers in [min, max], or in (min, max) if exclusive. An infinite max leaves the range open at the top.
+static float parseFloat(const std::string &key, const std::string &value, float min, float max, bool exclusive) {
+    const float out = parseFloat(key, value);
+    if (!std::isfinite(out)) {
+        throw std::runtime_error(key + " must be a finite number");
+    }
+    const bool inRange = exclusive ? out > min && out < max : out >= min && out <= max;
+    if (!inRange) {
+        std::ostringstream message;
+        message << key << " must be " << (exclusive ? "greater than " : "at least ") << min;
+        if (std::isfinite(max)) {
+            message << " and " << (exclusive ? "less than " : "at most ") << max;
+        }
+        throw std::runtime_error(message.str());
+    }
+    return out;
+}
+
+static const char *renderModeName(RenderMode mode) {
+    switch (mode) {
+        case RenderMode::Bidirectional: return "bidirectional";
+        case RenderMode::Wavefront: return "wavefront";
+        default: return "path";
+    }
+}
+
+static void applyOption(RenderJob &job, const std::string &key, const std::string &value) {
+    if (key == "scene") {
+        job.scene = value;
+    } else if (key == "trust-scene") {
+        job.trustScene = parseInteger(key, value, 0, 1) != 0;
+    } else if (key == "light") {
+        std::vector<float> floats = parseFloats(key, value);
+        if (floats.size() != 3 && floats.size() != 6) {
+            throw std::runtime_error("light expects x,y,z or x,y,z,r,g,b");
+        }
+        glm::vec3 color = floats.size() == 6 ? glm::vec3(floats[3], floats[4], floats[5]) : glm::vec3(1.0F);
+        job.lights.push_back(PointLight{glm::vec3(floats[0], floats[1], floats[2]), color});
+    } else if (key == "width") {
+        job.width = int(parseInteger(key, value, 1, 1 << 16));
+    } else if (key == "height") {
+        job.height = int(parseInteger(key, value, 1, 1 << 16));
+    } else if (key == "depth") {
+        job.depth = int(parseInteger(key, value, 1, 64));
+    } else if (key == "samples") {
+        job.samples = int(parseInteger(key, value, 0, 1 << 16));
+    } else if (key == "light-samples") {
+        job.lightSamples = int(parseInteger(key, value, 1, INT_MAX));
+    } else if (key == "seed") {
+        job.seed = static_cast<unsigned int>(parseInteger(key, value, 0, UINT_MAX));
+    } else if (key == "sampler") {
+        const std::optional<SamplerType> sampler = samplerFromName(value);
+        if (!sampler) {
+            throw std::runtime_error("Unknown sampler " + value);
+        }
+        job.sampler = *sampler;
+    } else if (key == "jitter") {
+        job.jitter = parseInteger(key, value, 0, 1) != 0;
+    } else if (key == "denoise") {
+        job.denoise = parseInteger(key, value, 0, 1) != 0;
+    } else if (key == "photons") {
+        job.photons = size_t(parseInteger(key, value, 0, INT_MAX));
+    } else if (key == "photon-passes") {
+        job.photonPasses = int(parseInteger(key, value, 1, 1 << 12));
+    } else if (key == "photon-radius") {
+        job.photonRadius = parseFloat(key, value, 0.0F, INFINITY, true);
+    } else if (key == "irradiance-cache") {
+        job.irradianceCache = parseFloat(key, value, 0.0F, INFINITY, false);
+    } else if (key == "cache-rays") {
+        job.cacheRays = int(parseInteger(key, value, 1, 1 << 16));
+    } else if (key == "guiding") {
+        job.guidingIterations = int(parseInteger(key, value, 0, 16));
+    } else if (key == "restir") {
+        job.restir = parseInteger(key, value, 0, 1) != 0;
+    } else if (key == "shadow-maps") {
+        job.shadowMaps = int(parseInteger(key, value, 0, 1 << 13));
+    } else if (key == "simd") {
+        const SimdLevel levels[] = {SimdLevel::Scalar, SimdLevel::SSE42, SimdLevel::AVX2, SimdLevel::AVX512};
+        const auto level = std::find_if(std::begin(levels), std::end(levels), [&](SimdLevel l) { return value == simdLevelName(l); });
+        if (value == "auto") {
+            job.simd = SimdLevel::AVX512;
+        } else if (level != std::end(levels)) {
+            job.simd = *level;
+        } else {
+            throw std::runtime_error("Unknown instruction set " + value);
+        }
+    } else if (key == "mode") {
+        if (value == renderModeName(RenderMode::PathTracing)) {
+            job.mode = RenderMode::PathTracing;
+        } else if (value == renderModeName(RenderMode::Bidirectional)) {
+            job.mode = RenderMode::Bidirectional;
+        } else if (value == renderModeName(RenderMode::Wavefront)) {
+            job.mode = RenderMode::Wavefront;
+        } else {
+            throw std::runtime_error("Unknown render mode " + value);
+        }
+    } else if (key == "look-at") {
+        job.lookAt = parseVec3(key, value);
+    } else if (key == "rotation") {
+        job.rotation = parseVec3(key, value);
+    } else if (key == "distance") {
+        job.distance = parseFloat(key, value, 0.0F, INFINITY, false);
+    } else if (key == "fov") {
+        job.fov = parseFloat(key, value, 0.0F, 180.0F, true);
+    } else if (key == "output") {
+        job.output = value;
+    } else if (key == "aovs") {
+        job.aovs = value;
+    } else if (key == "profile") {
+        job.profile = value;
+    } else if (key == "progress-log") {
+        job.progressLog = value;
+    } else if (key == "heat-maps") {
+#ifndef USE_RAY_STATISTICS
+        throw std::runtime_error("Heat maps need a build with the CMake option RAY_STATISTICS.");
+#endif
+        job.heatMaps = value;
+    } else if (key == "convert") {
+        job.convert = value;
+    } else if (key == "threads") {
+        job.threads = int(parseInteger(key, value, 0, 1 << 12));
+    } else if (key == "workers") {
+        job.workers = int(parseInteger(key, value, 0, 1 << 12));
+    } else if (key == "tile-size") {
+        job.tileSize = int(parseInteger(key, value, 1, 1 << 16));
+    } else if (key == "tile-timeout") {
+        job.tileTimeout = int(parseInteger(key, value, 0, INT_MAX));
+    } else {
+        throw std::runtime_error("Unknown option " + key);
+    }
+}
+
+static std::string trim(const std::string &str) {
+    const size_t begin = str.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    const size_t end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+}
+
+static void applyJobFile(RenderJob &job, const std::filesystem::path &file) {
+    std::ifstream stream(file);
+    if (!stream) {
+        throw std::runtime_error("Job file " + file.string() + " could not be opened.");
+    }
+
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(stream, line)) {
+        lineNumber++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) {
+            continue;
+        }
+
+        const size_t separator = line.find('=');
+        if (separator == std::string::npos) {
+            throw std::runtime_error(file.string() + ":" + std::to_string(lineNumber) + ": expected \"key = value\"");
+        }
+        applyOption(job, trim(line.substr(0, separator)), trim(line.substr(separator + 1)));
+    }
+}
+
+std::optional<RenderJob> parseCommandLine(int argc, char *argv[], const std::filesystem::path &outputDir) {
+    bool headless = false;
+    bool worker = false;
+    std::optional<std::filesystem::path> jobFile;
+    std::vector<std::tuple<std::string, std::string>> options;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0) {
+            printUsage(argv[0]);
+            throw std::runtime_error("Unexpected argument " + arg);
+        }
+        arg = arg.substr(2);
+
+        if (arg == "help") {
+            printUsage(argv[0]);
+            std::exit(EXIT_SUCCESS);
+        }
+        if (arg == "headless") {
+            headless = true;
+            continue;
+        }
+        if (arg == "worker") {
+            worker = true;
+            continue;
+        }
+
+        // Both "--key value" and "--key=value" are accepted
+        std::string value;
+        const size_t separator = arg.find('=');
+        if (separator != std::string::npos) {
+            value = arg.substr(separator + 1);
+            arg = arg.substr(0, separator);
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        } else {
+            throw std::runtime_error("Missing value for --" + arg);
+        }
+
+        if (arg == "job") {
+            jobFile = value;
+        } else {
+            options.push_back({arg, value});
+        }
+    }
+
+    if (!headless && !jobFile) {
+        if (!options.empty()) {
+            printUsage(argv[0]);
+            throw std::runtime_error("Render options require --headless or --job");
+        }
+        return {};
+    }
+
+    RenderJob job;
+    job.worker = worker;
+    job.executable = argv[0];
+    if (jobFile) {
+        applyJobFile(job, *jobFile);
+    }
+
+    // Lights on the command line replace the lights of the job file instead of adding to them
+    bool commandLineLights = false;
+    for (const auto &[key, value] : options) {
+        if (key == "light" && !commandLineLights) {
+            job.lights.clear();
+            commandLineLights = true;
+        }
+        applyOption(job, key, value);
+    }
+
+    if (job.output.empty()) {
+        job.output = outputDir / "render.bmp";
+    }
+    return job;
+}
+
+std::vector<std::string> workerArguments(const RenderJob &job) {
+    auto str = [](auto value) {
+        std::ostringstream stream;
+        stream << std::setprecision(9) << value;
+        return stream.str();
+    };
+    auto vec3 = [&](const glm::vec3 &v) { return str(v.x) + "," + str(v.y) + "," + str(v.z); };
+
+    std::vector<std::string> args{
+        job.executable.string(), "--headless", "--worker",
+        "--scene", job.scene,
+        "--trust-scene", str(int(job.trustScene)),
+        "--width", str(job.width),
+        "--height", str(job.height),
+        "--depth", str(job.depth),
+        "--samples", str(job.samples),
+        "--light-samples", str(job.lightSamples),
+        "--sampler", samplerName(job.sampler),
+        "--jitter", str(int(job.jitter)),
+        "--photons", str(job.photons),
+        "--photon-passes", str(job.photonPasses),
+        "--photon-radius", str(job.photonRadius),
+        "--irradiance-cache", str(job.irradianceCache),
+        "--cache-rays", str(job.cacheRays),
+        "--guiding", str(job.guidingIterations),
+        "--mode", renderModeName(job.mode),
+        "--restir", str(int(job.restir)),
+        "--shadow-maps", str(job.shadowMaps),
+        "--simd", simdLevelName(job.simd),
+        "--look-at", vec3(job.lookAt),
+        "--rotation", vec3(job.rotation),
+        "--distance", str(job.distance),
+        "--fov", str(job.fov),
+        "--threads", str(job.threads)
+    };
+    // All workers need the same seed to render a consistent image
+    if (job.seed) {
+        args.insert(args.end(), {"--seed", str(*job.seed)});
+    }
+    for (const PointLight &light : job.lights) {
+        args.insert(args.end(), {"--light", vec3(light.position) + "," + vec3(light.color)});
+    }
+    return args;
+}
+
+static std::string jsonString(const std::string &str) {
+    std::string out = "\"";
+    for (const char c : str) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default: out += c; break;
+        }
+    }
+    return out + "\"";
+}
+
+#ifdef USE_RAY_STATISTICS
+static std::string statisticsJson(const RayStatistics &statistics) {
+    const size_t rays = statistics.totalRays();
+    std::ostringstream stream;
+    stream << "{"
+           << "\"camera_rays\": " << statistics.rays[size_t(RayType::Camera)] << ", "
+           << "\"shadow_rays\": " << statistics.rays[size_t(RayType::Shadow)] << ", "
+           << "\"reflection_rays\": " << statistics.rays[size_t(RayType::Reflection)] << ", "
+           << "\"indirect_rays\": " << statistics.rays[size_t(RayType::Indirect)] << ", "
+           << "\"hits\": " << statistics.hits << ", "
+           << "\"nodes\": " << statistics.nodes << ", "
+           << "\"triangles\": " << statistics.triangles << ", "
+           << "\"nodes_per_ray\": " << (rays > 0 ? double(statistics.nodes) / double(rays) : 0.0) << ", "
+           << "\"triangles_per_ray\": " << (rays > 0 ? double(statistics.triangles) / double(rays) : 0.0)
+           << "}";
+    return stream.str();
+}
+#endif
+
+Scene loadJobScene(const RenderJob &job, const std::filesystem::path &dataDir) {
+    Scene scene;
+    if (job.scene == "CornellBox") {
+        scene = loadScene(SceneType::CornellBox, dataDir);
+    } else if (isSceneFile(job.scene)) {
+        // Already normalized when it was converted, the meshes view the mapped file
+        scene = loadSceneFile(job.scene, job.trustScene);
+    } else {
+        // Converting only writes the meshes out, so they are not pooled first
+        scene.meshes = loadMesh(job.scene, true, job.convert.empty());
+    }
+
+    if (!job.lights.empty()) {
+        scene.pointLights = job.lights;
+    }
+    if (scene.pointLights.empty()) {
+        std::cerr << "Warning: the scene has no lights, use --light to add one." << std::endl;
+    }
+    return scene;
+}
+
+Trackball jobCamera(const RenderJob &job) {
+    Trackball camera{nullptr, glm::radians(job.fov), job.distance};
+    camera.setAspectRatio(float(job.width) / float(job.height));
+    camera.setCamera(job.lookAt, glm::radians(job.rotation), job.distance);
+    return camera;
+}
+
+Transforms identityTransforms(const Scene &scene) {
+    const size_t meshCount = scene.meshes.size();
+    return Transforms(meshCount, std::vector<std::tuple<glm::vec3, glm::vec3>>(meshCount, std::tuple(glm::vec3(1.0F), glm::vec3(0.0F))));
+}
+
+std::optional<PhotonMap> jobPhotonMap(const RenderJob &job, const Scene &scene, const BoundingVolumeHierarchy &bvh, const AreaLights &lights, const Transforms &transforms) {
+    if (job.photons == 0) {
+        return {};
+    }
+    PhotonSettings settings;
+    settings.photons = job.photons;
+    settings.passes = job.photonPasses;
+    settings.radius = job.photonRadius;
+    settings.bounces = indirect_bounces(job.depth);
+    return PhotonMap{scene, bvh, lights, transforms, settings, job.sampler, job.seed.value_or(0)};
+}
+
+std::unique_ptr<IrradianceCache> jobIrradianceCache(const RenderJob &job, const Scene &scene) {
+    if (job.irradianceCache <= 0.0F) {
+        return nullptr;
+    }
+    IrradianceCacheSettings settings;
+    settings.accuracy = job.irradianceCache;
+    settings.rays = job.cacheRays;
+    return std::make_unique<IrradianceCache>(scene, settings);
+}
+
+std::unique_ptr<ReservoirBuffer> jobReservoirs(const RenderJob &job) {
+    if (!job.restir) {
+        return nullptr;
+    }
+    return std::make_unique<ReservoirBuffer>(glm::ivec2(job.width, job.height), ReSTIRSettings{});
+}
+
+std::unique_ptr<ShadowMaps> jobShadowMaps(const RenderJob &job, const Scene &scene, const BoundingVolumeHierarchy &bvh) {
+    if (job.shadowMaps <= 0) {
+        return nullptr;
+    }
+    ShadowMapSettings settings;
+    settings.resolution = job.shadowMaps;
+    std::unique_ptr<ShadowMaps> maps = std::make_unique<ShadowMaps>(settings);
+    maps->update(scene, bvh);
+    return maps;
+}
+
+std::unique_ptr<PathGuide> jobPathGuide(const RenderJob &job, const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data) {
+    if (job.guidingIterations <= 0) {
+        return nullptr;
+    }
+    GuidingSettings settings;
+    settings.iterations = job.guidingIterations;
+    std::unique_ptr<PathGuide> guide = std::make_unique<PathGuide>(scene, settings);
+    // The progress log belongs to the render, and workers leave the console to the coordinator
+    ProgressOutput progress;
+    progress.console = !job.worker;
+    progress.label = "Training path guide";
+    trainPathGuide(scene, camera, bvh, data, job.seed.value_or(0), glm::ivec2(job.width, job.height), *guide, progress);
+    return guide;
+}
+
+int renderHeadless(const RenderJob &job, const std::filesystem::path &dataDir) {
+#ifdef USE_OPENMP
+    if (job.threads > 0) {
+        omp_set_num_threads(job.threads);
+    }
+#endif
+    // Before any hierarchy is built, the kernels are picked when the leaves are
+    limitSimdLevel(job.simd);
+    if (job.worker) {
+        return runWorker(job, dataDir);
+    }
+
+    using clock = ProfileClock;
+    auto seconds = [](clock::time_point from, clock::time_point to) { return std::chrono::duration<double>(to - from).count(); };
+    if (!job.profile.empty()) {
+        startProfile();
+    }
+    const clock::time_point start = clock::now();
+
+    if (!job.convert.empty()) {
+        const Scene scene = loadJobScene(job, dataDir);
+        const clock::time_point loaded = clock::now();
+        writeSceneFile(scene, job.convert);
+        size_t triangles = 0;
+        for (const Mesh &mesh : scene.meshes) {
+            triangles += mesh.triangles.size();
+        }
+        std::cout << "{"
+                  << "\"scene\": " << jsonString(job.scene) << ", "
+                  << "\"output\": " << jsonString(job.convert.string()) << ", "
+                  << "\"meshes\": " << scene.meshes.size() << ", "
+                  << "\"triangles\": " << triangles << ", "
+                  << "\"lights\": " << scene.pointLights.size() << ", "
+                  << "\"load_seconds\": " << seconds(start, loaded) << ", "
+                  << "\"write_seconds\": " << seconds(loaded, clock::now())
+                  << "}" << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    RenderJob resolved = job;
+    if (!resolved.seed) {
+        resolved.seed = static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count());
+    }
+    const unsigned int seed = *resolved.seed;
+
+    Screen screen{size_t(job.width), size_t(job.height)};
+    std::optional<AOVBuffers> aovs;
+    if (job.denoise || !job.aovs.empty() || !job.heatMaps.empty()) {
+        aovs.emplace(screen.resolution());
+    }
+    RenderStats stats;
+    double loadSeconds = 0.0;
+    double bvhSeconds = 0.0;
+    double photonSeconds = 0.0;
+    size_t cacheRecords = 0;
+    double guidingSeconds = 0.0;
+    double shadowMapSeconds = 0.0;
+    double renderSeconds;
+    CoordinatorStats coordinatorStats{};
+    if (job.workers > 0) {
+        // The workers load the scene themselves
+        const clock::time_point renderStart = clock::now();
+        ProgressOutput progress;
+        progress.log = job.progressLog;
+        stats = renderWithWorkers(resolved, screen, aovs ? &*aovs : nullptr, coordinatorStats, progress);
+        const clock::time_point rendered = clock::now();
+        renderSeconds = seconds(renderStart, rendered);
+        profileEvent("render", renderStart, rendered);
+    } else {
+        const Scene scene = loadJobScene(job, dataDir);
+        const clock::time_point loaded = clock::now();
+        const BoundingVolumeHierarchy bvh{&scene};
+        const clock::time_point built = clock::now();
+        loadSeconds = seconds(start, loaded);
+        bvhSeconds = seconds(loaded, built);
+        profileEvent("load scene", start, loaded);
+        profileEvent("build BVH", loaded, built);
+
+        const Trackball camera = jobCamera(job);
+        const AreaLights lights{&scene};
+        const PointLightTree pointLights{&scene};
+        Transforms transforms = identityTransforms(scene);
+        ShadingData data = ShadingData{false, job.depth, job.samples, &transforms, job.sampler, job.jitter, &lights, &pointLights, job.lightSamples};
+        data.mode = job.mode;
+
+        const clock::time_point photonStart = clock::now();
+        const std::optional<PhotonMap> photons = jobPhotonMap(resolved, scene, bvh, lights, transforms);
+        const clock::time_point photonEnd = clock::now();
+        photonSeconds = seconds(photonStart, photonEnd);
+        if (photons) {
+            profileEvent("photon map", photonStart, photonEnd);
+        }
+        data.photons = photons ? &*photons : nullptr;
+        const std::unique_ptr<IrradianceCache> cache = jobIrradianceCache(resolved, scene);
+        data.irradiance_cache = cache.get();
+        const std::unique_ptr<ReservoirBuffer> reservoirs = jobReservoirs(resolved);
+        data.restir = reservoirs.get();
+        const clock::time_point shadowMapStart = clock::now();
+        const std::unique_ptr<ShadowMaps> shadowMaps = jobShadowMaps(resolved, scene, bvh);
+        const clock::time_point shadowMapEnd = clock::now();
+        shadowMapSeconds = seconds(shadowMapStart, shadowMapEnd);
+        if (shadowMaps) {
+            profileEvent("shadow maps", shadowMapStart, shadowMapEnd);
+        }
+        data.shadow_maps = shadowMaps.get();
+
+        const clock::time_point guidingStart = clock::now();
+        const std::unique_ptr<PathGuide> guide = jobPathGuide(resolved, scene, camera, bvh, data);
+        const clock::time_point guidingEnd = clock::now();
+        guidingSeconds = seconds(guidingStart, guidingEnd);
+        if (guide) {
+            profileEvent("train path guide", guidingStart, guidingEnd);
+        }
+        data.guide = guide.get();
+
+        const clock::time_point renderStart = clock::now();
+        ProgressOutput progress;
+        progress.log = job.progressLog;
+        stats = renderRayTracing(scene, camera, bvh, data, seed, screen, aovs ? &*aovs : nullptr, progress);
+        const clock::time_point rendered = clock::now();
+        renderSeconds = seconds(renderStart, rendered);
+        profileEvent("render", renderStart, rendered);
+        cacheRecords = cache ? cache->size() : 0;
+    }
+
+    double denoiseSeconds = 0.0;
+    if (job.denoise) {
+        const clock::time_point denoiseStart = clock::now();
+        denoise(screen, *aovs, DenoiseSettings{});
+        const clock::time_point denoised = clock::now();
+        denoiseSeconds = seconds(denoiseStart, denoised);
+        profileEvent("denoise", denoiseStart, denoised);
+    }
+    {
+        PROFILE_SCOPE("write images");
+        screen.writeBitmapToFile(job.output);
+        if (!job.aovs.empty()) {
+            writeAOVsToFile(screen, *aovs, job.aovs);
+        }
+        if (!job.heatMaps.empty()) {
+            writeHeatMapsToFile(*aovs, job.heatMaps);
+        }
+    }
+    const clock::time_point end = clock::now();
+    if (!job.profile.empty()) {
+        writeProfile(job.profile);
+    }
+
+    // stdout only contains the statistics so it can be piped into other tools, everything else goes to stderr
+    std::cout << "{"
+              << "\"scene\": " << jsonString(job.scene) << ", "
+              << "\"output\": " << jsonString(job.output.string()) << ", "
+              << "\"aovs\": " << jsonString(job.aovs.string()) << ", "
+              << "\"profile\": " << jsonString(job.profile.string()) << ", "
+              << "\"width\": " << job.width << ", "
+              << "\"height\": " << job.height << ", "
+              << "\"depth\": " << job.depth << ", "
+              << "\"samples\": " << job.samples << ", "
+              << "\"light_samples\": " << job.lightSamples << ", "
+              << "\"photons\": " << job.photons << ", "
+              << "\"photon_passes\": " << job.photonPasses << ", "
+              << "\"irradiance_cache\": " << job.irradianceCache << ", "
+              << "\"cache_records\": " << cacheRecords << ", "
+              << "\"guiding\": " << job.guidingIterations << ", "
+              << "\"restir\": " << (job.restir ? "true" : "false") << ", "
+              << "\"shadow_maps\": " << job.shadowMaps << ", "
+              << "\"simd\": " << jsonString(simdLevelName(simdLevel())) << ", "
+              << "\"mode\": " << jsonString(renderModeName(job.mode)) << ", "
+              << "\"seed\": " << seed << ", "
+              << "\"sampler\": " << jsonString(samplerName(job.sampler)) << ", "
+              << "\"workers\": " << job.workers << ", "
+              << "\"tiles\": " << coordinatorStats.tiles << ", "
+              << "\"retries\": " << coordinatorStats.retries << ", "
+              << "\"load_seconds\": " << loadSeconds << ", "
+              << "\"bvh_seconds\": " << bvhSeconds << ", "
+              << "\"photon_seconds\": " << photonSeconds << ", "
+              << "\"guiding_seconds\": " << guidingSeconds << ", "
+              << "\"shadow_map_seconds\": " << shadowMapSeconds << ", "
+              << "\"render_seconds\": " << renderSeconds << ", "
+              << "\"denoise_seconds\": " << denoiseSeconds << ", "
+              << "\"wall_seconds\": " << seconds(start, end) << ", "
+#ifdef USE_RAY_STATISTICS
+              << "\"ray_statistics\": " << statisticsJson(stats.statistics) << ", "
+#endif
+              << "\"pixels\": " << stats.pixels << ", "
+              << "\"rays\": " << stats.rays << ", "
+              << "\"rays_per_second\": " << (renderSeconds > 0.0 ? double(stats.rays) / renderSeconds : 0.0)
+              << "}" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "illumination.h"
+#include "irradiance_cache.h"
+#include "path_guiding.h"
+#include "photon_map.h"
+#include "sampler.h"
+#include "scene.h"
+#include "shadow_maps.h"
+#include "simd.h"
+#include "trackball.h"
+
+// Everything needed to render one image without a window.
+// The defaults match the interactive application.
+struct RenderJob {
+    std::string scene = "CornellBox"; // Scene name or path to a mesh file
+    bool trustScene = false; // Skip checking the triangles of a binary scene file, so it loads without reading them
+    std::vector<PointLight> lights; // Replaces the lights of the scene if not empty
+    int width = 800;
+    int height = 800;
+    int depth = 3;
+    int samples = 32;
+    int lightSamples = 4; // Point lights shaded per hit when the scene has more lights than this
+    std::optional<unsigned int> seed; // Time based if not set
+    SamplerType sampler = SamplerType::Random;
+    bool jitter = false;
+    bool denoise = false;
+    size_t photons = 0; // Photons per pass, indirect light comes from a photon map if not 0
+    int photonPasses = 1; // Progressive photon mapping if more than one
+    float photonRadius = 0.05F;
+    float irradianceCache = 0.0F; // Accuracy of the irradiance cache, indirect light is traced at every hit if 0
+    int cacheRays = 256; // Hemisphere rays per irradiance cache record
+    int guidingIterations = 0; // Training passes of path guiding, off if 0
+    RenderMode mode = RenderMode::PathTracing;
+    bool restir = false; // Point lights at the first hit are picked by reservoir resampling
+    int shadowMaps = 0; // Resolution of the shadow cube maps of the point lights, shadow rays only if 0
+    SimdLevel simd = SimdLevel::AVX512; // Highest instruction set of the ray/triangle kernels, lower if the CPU does not support it
+    glm::vec3 lookAt{0.0F};
+    glm::vec3 rotation{20.0F, 20.0F, 0.0F}; // Euler angles in degrees
+    float distance = 3.0F;
+    float fov = 50.0F; // Vertical field of view in degrees
+    std::filesystem::path output;
+    std::filesystem::path aovs; // Multi-channel OpenEXR file with the render passes, not written if empty
+    std::filesystem::path profile; // Chrome trace of the phases and threads of the render, not written if empty
+    std::filesystem::path progressLog; // Progress, ETA and throughput of the render as a JSON object per line, not written if empty
+    std::filesystem::path heatMaps; // Bitmaps of the nodes and triangles tested per pixel, needs a build with ray statistics
+    std::filesystem::path convert; // Write the scene to this binary scene file instead of rendering
+    int threads = 0; // Render threads per process, 0 uses all cores
+    int workers = 0; // Split the image into tiles rendered by this many local worker processes
+    int tileSize = 64;
+    int tileTimeout = 600; // Seconds a worker may take for a tile before it is restarted, 0 waits forever
+    bool worker = false; // Set for the processes started by the coordinator
+    std::filesystem::path executable; // Used to start the worker processes
+};
+
+using Transforms = std::vector<std::vector<std::tuple<glm::vec3, glm::vec3>>>;
+
+void printUsage(const char *program);
+
+// Returns a job if the command line asks for a headless render (--headless or --job), otherwise the
+// application should start interactively. Options given on the command line override those in the job file.
+std::optional<RenderJob> parseCommandLine(int argc, char *argv[], const std::filesystem::path &outputDir);
+
+// Command line that starts a worker process for the job, the inverse of parseCommandLine.
+std::vector<std::string> workerArguments(const RenderJob &job);
+
+Scene loadJobScene(const RenderJob &job, const std::filesystem::path &dataDir);
+
+Trackball jobCamera(const RenderJob &job);
+
+Transforms identityTransforms(const Scene &scene);
+
+// Photons of the job, none if it does not use photon mapping
+std::optional<PhotonMap> jobPhotonMap(const RenderJob &job, const Scene &scene, const BoundingVolumeHierarchy &bvh, const AreaLights &lights, const Transforms &transforms);
+
+// Empty irradiance cache of the job, none if it does not use one
+std::unique_ptr<IrradianceCache> jobIrradianceCache(const RenderJob &job, const Scene &scene);
+
+// Reservoirs for the image of the job, none if it does not use ReSTIR
+std::unique_ptr<ReservoirBuffer> jobReservoirs(const RenderJob &job);
+
+// Shadow maps of the point lights of the job, none if it does not use them
+std::unique_ptr<ShadowMaps> jobShadowMaps(const RenderJob &job, const Scene &scene, const BoundingVolumeHierarchy &bvh);
+
+// Path guide of the job trained for the shading data, none if it does not use path guiding
+std::unique_ptr<PathGuide> jobPathGuide(const RenderJob &job, const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data);
+
+// Renders the job without an OpenGL context, writes the image and prints statistics as JSON to stdout.
+int renderHeadless(const RenderJob &job, const std::filesystem::path &dataDir);
@@ -1,9 +1,13 @@
 #include "disable_all_warnings.h"
 DISABLE_WARNINGS_PUSH()
 #include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
 DISABLE_WARNINGS_POP()
+#include <cfloat>
+#include <cmath>
 #include <iostream>
-#include <random>
+#include <vector>
+#include "bsdf.h"
 #include "draw.h"
 #include "illumination.h"
 #ifdef USE_OPENMP
@@ -11,30 +15,71 @@ DISABLE_WARNINGS_POP()
 #endif
 
 static constexpr const float OFFSET = 0.01F;
-static constexpr const float M_PI = 3.14159265358979323846F;
+static constexpr const float PI = 3.14159265358979323846F;
 static constexpr const size_t INVALID_INDEX = (size_t) -1;
 
-bool is_shadow(const BoundingVolumeHierarchy &bvh, const glm::vec3 &point, const glm::vec3 &light, const glm::vec3 &normal, const bool debug) {
+// Per thread so the counter does not get shared between the render threads
+static thread_local size_t ray_count = 0;
+
+size_t traced_rays() {
+	return ray_count;
+}
+
+static float luminance(const glm::vec3 &color) {
+	return glm::dot(color, glm::vec3(0.2126F, 0.7152F, 0.0722F));
+}
+
+bool trace(const BoundingVolumeHierarchy &bvh, Ray &ray, HitInfo &hitInfo, const RayType type) {
+	ray_count++;
+	COUNT_RAY_STATISTIC(rays[size_t(type)], 1);
+	const bool hit = bvh.intersect(ray, hitInfo);
+	COUNT_RAY_STATISTIC(hits, hit ? 1 : 0);
+	return hit;
+}
+
+bool shadow_ray(const glm::vec3 &point, const glm::vec3 &light, const glm::vec3 &normal, Ray &ray) {
 	glm::vec3 direction = light - point;
 	glm::vec3 directionn = glm::normalize(direction);
-	Ray ray = Ray{point + directionn * OFFSET, directionn, glm::length(direction) - 2.0F * OFFSET};
+	ray = Ray{point + directionn * OFFSET, directionn, glm::length(direction) - 2.0F * OFFSET};
+	return glm::dot(directionn, normal) >= 0.0F;
+}
+
+// The integrator is compiled once per policy, so renders contain no drawing code and test no debug flag along the paths
+struct Production {
+	static constexpr bool debug = false;
+};
 
+// The ray debugger of the interactive window: every ray is drawn, hemisphere samples are only shown and not traced
+struct DebugRays {
+	static constexpr bool debug = true;
+};
+
+template <typename Policy>
+static void draw_ray(const Ray &ray, const glm::vec3 &color) {
+	if constexpr (Policy::debug) {
+		drawRay(ray, color);
+	}
+}
+
+template <typename Policy>
+static bool is_shadow(const BoundingVolumeHierarchy &bvh, const glm::vec3 &point, const glm::vec3 &light, const glm::vec3 &normal) {
+	Ray ray;
 	HitInfo hitInfo;
 
 	// Light is not visible
-	if (glm::dot(directionn, normal) < 0.0F || bvh.intersect(ray, hitInfo)) {
-		if (debug) {
-			drawRay(ray, glm::vec3(1.0F, 0.0F, 0.0F));
-		}
+	if (!shadow_ray(point, light, normal, ray) || trace(bvh, ray, hitInfo, RayType::Shadow)) {
+		draw_ray<Policy>(ray, glm::vec3(1.0F, 0.0F, 0.0F));
 		return true;
 	}
 
-	if (debug) {
-		drawRay(ray, glm::vec3(0.0F, 1.0F, 1.0F));
-	}
+	draw_ray<Policy>(ray, glm::vec3(0.0F, 1.0F, 1.0F));
 	return false;
 }
 
+bool is_shadow(const BoundingVolumeHierarchy &bvh, const glm::vec3 &point, const glm::vec3 &light, const glm::vec3 &normal, const bool debug) {
+	return debug ? is_shadow<DebugRays>(bvh, point, light, normal) : is_shadow<Production>(bvh, point, light, normal);
+}
+
 static glm::vec3 shader_lambert(const glm::vec3 &position, const glm::vec3 &normal, const Material &material, const PointLight &light) {
 	float factor = glm::dot(glm::normalize(light.position - position), normal);
 	glm::vec3 color = factor * material.kd * light.color;
@@ -47,72 +92,239 @@ static glm::vec3 shader_blinn_phong_specular(const glm::vec3 &position, const gl
 		return glm::vec3(0.0F);
 	}
 	float factor = glm::dot(glm::normalize(v + glm::normalize(camera - position)), normal);
-	glm::vec3 color = std::powf(factor, material.shininess) * material.ks * light.color;
+	glm::vec3 color = std::pow(factor, material.shininess) * material.ks * light.color;
 	return glm::clamp(color, 0.0F, 1.0F);
 }
 
-static glm::vec3 shader(const Scene &scene, const BoundingVolumeHierarchy &bvh, const Ray &ray, const HitInfo &hitInfo, const glm::vec3 &camera, const bool debug) {
+glm::vec3 point_light_contribution(const glm::vec3 &point, const glm::vec3 &normal, const Material &material, const PointLight &light, const glm::vec3 &camera) {
+	return shader_lambert(point, normal, material, light) + shader_blinn_phong_specular(point, normal, material, light, camera);
+}
+
+// The shadow maps answer most shadow queries of point lights without a ray, debug rays always trace theirs to draw them
+template <typename Policy>
+static bool point_light_shadow(const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const glm::vec3 &point, const glm::vec3 &normal, const size_t mesh, const size_t light) {
+	const glm::vec3 &position = scene.pointLights[light].position;
+	if (!Policy::debug && data.shadow_maps != nullptr && glm::dot(position - point, normal) >= 0.0F) {
+		const ShadowMaps::Visibility visibility = data.shadow_maps->lookup(light, position, point, normal, mesh);
+		if (visibility != ShadowMaps::Visibility::Unknown) {
+			return visibility == ShadowMaps::Visibility::Shadowed;
+		}
+	}
+	return is_shadow<Policy>(bvh, point, position, normal);
+}
+
+template <typename Policy>
+static glm::vec3 shader_point_light(const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const glm::vec3 &point, const HitInfo &hitInfo, const size_t index, const glm::vec3 &camera) {
+	const PointLight &light = scene.pointLights[index];
+	if (point_light_shadow<Policy>(scene, bvh, data, point, hitInfo.normal, hitInfo.meshIdx, index)) {
+		return glm::vec3(0.0F);
+	}
+	return point_light_contribution(point, hitInfo.normal, hitInfo.material, light, camera);
+}
+
+template <typename Policy>
+static glm::vec3 shader(const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, PathSampler &sampler, const Ray &ray, const HitInfo &hitInfo, const glm::vec3 &camera) {
 	glm::vec3 point = ray.origin + ray.direction * ray.t;
 	glm::vec3 color = glm::vec3(0.0F);
 
-	for (const PointLight &light : scene.pointLights) {
-		if (!is_shadow(bvh, point, light.position, hitInfo.normal, debug)) {
-			color += shader_lambert(point, hitInfo.normal, hitInfo.material, light);
-			color += shader_blinn_phong_specular(point, hitInfo.normal, hitInfo.material, light, camera);
+	// With many lights only a few are shaded, picked in proportion to their contribution
+	if (data.point_lights != nullptr && scene.pointLights.size() > size_t(data.light_samples)) {
+		for (int i = 0; i < data.light_samples; i++) {
+			float pdf;
+			const size_t light = data.point_lights->sample(point, hitInfo.normal, sampler.next2D().x, pdf);
+			if (pdf > 0.0F) {
+				color += shader_point_light<Policy>(scene, bvh, data, point, hitInfo, light, camera) / (pdf * float(data.light_samples));
+			}
 		}
+		return glm::clamp(color, 0.0F, 1.0F);
+	}
+
+	for (size_t light = 0; light < scene.pointLights.size(); light++) {
+		color += shader_point_light<Policy>(scene, bvh, data, point, hitInfo, light, camera);
 	}
 
 	return glm::clamp(color, 0.0F, 1.0F);
 }
 
-static glm::vec3 random_hemisphere_vector(std::default_random_engine &rng) {
-	std::uniform_real_distribution<float> uniform(0.0F, 1.0F);
-	float u1 = uniform(rng);
-	float u2 = uniform(rng);
+DirectionSampler::DirectionSampler(const BSDF &surface_bsdf, const PathGuide *path_guide, const glm::vec3 &position, const glm::vec3 &surface_normal) : bsdf(surface_bsdf), guide(path_guide), leaf(path_guide != nullptr ? path_guide->leaf(position) : 0), normal(surface_normal) {}
+
+BSDFSample DirectionSampler::sample(glm::vec2 u) const {
+	if (guide == nullptr) {
+		return bsdf.sample(u);
+	}
+	const float fraction = guide->settings().bsdfFraction;
+	glm::vec3 direction;
+	if (u.x < fraction) {
+		u.x /= fraction;
+		direction = bsdf.sample(u).direction;
+	} else {
+		u.x = std::min((u.x - fraction) / (1.0F - fraction), 1.0F - FLT_EPSILON / 2.0F);
+		direction = guide->sample(leaf, u);
+	}
+	return BSDFSample{direction, glm::dot(direction, normal) > 0.0F ? pdf(direction) : 0.0F};
+}
+
+float DirectionSampler::pdf(const glm::vec3 &direction) const {
+	if (guide == nullptr) {
+		return bsdf.pdf(direction);
+	}
+	const float fraction = guide->settings().bsdfFraction;
+	return fraction * bsdf.pdf(direction) + (1.0F - fraction) * guide->pdf(leaf, direction);
+}
+
+float mis_weight(const float pdf, const float other_pdf) {
+	const float a = pdf * pdf;
+	const float b = other_pdf * other_pdf;
+	return a + b > 0.0F ? a / (a + b) : 0.0F;
+}
+
+bool area_light_estimate(const ShadingData &data, const glm::vec3 &position, const glm::vec3 &normal, PathSampler &sampler, const DirectionSampler *directions, glm::vec3 &estimate, glm::vec3 &light_position) {
+	const glm::vec2 u = sampler.next2D();
+	const glm::vec2 v = sampler.next2D();
+	const LightSample light = data.lights->sample(u, v);
 
-	float st = std::sqrtf(1.0F - u1 * u1);
-	float phi = 2.0F * M_PI * u2;
-	float x = st * std::cosf(phi);
-	float z = st * std::sinf(phi);
+	glm::vec3 direction = light.position - position;
+	const float distance2 = glm::dot(direction, direction);
+	direction = glm::normalize(direction);
+	const float cos_surface = glm::dot(normal, direction);
+	const float cos_light = std::fabs(glm::dot(light.normal, direction));
+	if (cos_surface <= 0.0F || cos_light <= 0.0F || light.pdf <= 0.0F) {
+		return false;
+	}
+
+	// Density with respect to solid angle
+	const float pdf = light.pdf * distance2 / cos_light;
+	const float weight = directions != nullptr ? mis_weight(pdf, directions->pdf(direction)) : 1.0F;
+	estimate = weight * light.emission * cos_surface / pdf;
+	light_position = light.position;
+	return true;
+}
 
-	return glm::vec3(x, u1, z);
+// Next-event estimation with its shadow ray
+template <typename Policy>
+static glm::vec3 sample_area_light(const ShadingData &data, const BoundingVolumeHierarchy &bvh, const glm::vec3 &position, const glm::vec3 &normal, PathSampler &sampler, const DirectionSampler *directions) {
+	glm::vec3 estimate;
+	glm::vec3 light;
+	if (!area_light_estimate(data, position, normal, sampler, directions, estimate, light) || is_shadow<Policy>(bvh, position, light, normal)) {
+		return glm::vec3(0.0F);
+	}
+	return estimate;
 }
 
-static glm::vec3 random_hemisphere_vector(std::default_random_engine &rng, const glm::vec3 &normal) {
-	glm::vec3 v = random_hemisphere_vector(rng);
+// If emission is not set, light emitted by the surface that is hit is left to the caller
+template <typename Policy>
+static glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, PathSampler &sampler, Ray &ray, HitInfo &hitInfo, const size_t depth, const bool emission, PrimaryHit *primary);
 
-	glm::vec3 nt;
-	if (std::fabsf(normal.x) > std::fabsf(normal.y)) {
-		nt = glm::vec3(normal.z, 0.0F, -normal.x);
+// Tangent and bitangent around the normal
+static void tangent_frame(const glm::vec3 &normal, glm::vec3 &tangent, glm::vec3 &bitangent) {
+	if (std::fabs(normal.x) > std::fabs(normal.y)) {
+		tangent = glm::normalize(glm::vec3(normal.z, 0.0F, -normal.x));
 	} else {
-		nt = glm::vec3(0.0F, -normal.z, normal.y);
+		tangent = glm::normalize(glm::vec3(0.0F, -normal.z, normal.y));
 	}
-	nt = glm::normalize(nt);
-	glm::vec3 nb = glm::cross(normal, nt);
+	bitangent = glm::cross(normal, tangent);
+}
 
-	float x = v.x * nb.x + v.y * normal.x + v.z * nt.x;
-	float y = v.x * nb.y + v.y * normal.y + v.z * nt.y;
-	float z = v.x * nb.z + v.y * normal.z + v.z * nt.z;
+// New irradiance cache record from cosine weighted rays, stratified in rings (theta) and sectors (phi) so the
+// gradients can be estimated from the differences between neighbouring cells ("Irradiance Gradients", Ward and Heckbert 1992)
+template <typename Policy>
+static IrradianceRecord irradiance_record(const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, PathSampler &sampler, const glm::vec3 &position, const HitInfo &hitInfo, const size_t depth) {
+	const int rays = std::max(data.irradiance_cache->settings().rays, 1);
+	const int rings = std::max(1, int(std::lround(std::sqrt(float(rays) / PI))));
+	const int sectors = std::max(1, rays / rings);
+	const int cells = rings * sectors;
+	const glm::vec3 &normal = hitInfo.normal;
+	glm::vec3 tangent;
+	glm::vec3 bitangent;
+	tangent_frame(normal, tangent, bitangent);
 
-	return glm::vec3(x, y, z);
+	std::vector<glm::vec3> radiance(static_cast<size_t>(cells));
+	std::vector<float> distance(static_cast<size_t>(cells));
+	glm::vec3 irradiance = glm::vec3(0.0F);
+	glm::mat3 rotational = glm::mat3(0.0F);
+	float inverse_distance = 0.0F;
+	for (int j = 0; j < rings; j++) {
+		for (int k = 0; k < sectors; k++) {
+			const size_t cell = size_t(j * sectors + k);
+			PathSampler sample_sampler = sampler.branch(uint32_t(cell), uint32_t(cells));
+			const glm::vec2 u = sample_sampler.next2D();
+			const float sin_theta = std::sqrt((float(j) + u.x) / float(rings));
+			const float cos_theta = std::sqrt(std::max(1.0F - sin_theta * sin_theta, 0.0F));
+			const float phi = 2.0F * PI * (float(k) + u.y) / float(sectors);
+			const glm::vec3 dir = sin_theta * (std::cos(phi) * tangent + std::sin(phi) * bitangent) + cos_theta * normal;
+
+			Ray sampleRay = Ray{position + dir * OFFSET, dir};
+			HitInfo sample_hitInfo;
+			sample_hitInfo.meshIdx = INVALID_INDEX;
+			glm::vec3 color = get_color<Policy>(position, scene, bvh, data, sample_sampler, sampleRay, sample_hitInfo, depth, false, nullptr);
+			if (sample_hitInfo.meshIdx != INVALID_INDEX) {
+				const auto &[scalar, offset] = (*data.transforms)[sample_hitInfo.meshIdx][hitInfo.meshIdx];
+				color = scalar * color + offset;
+				distance[cell] = sampleRay.t;
+				inverse_distance += 1.0F / sampleRay.t;
+			} else {
+				distance[cell] = FLT_MAX;
+			}
+			radiance[cell] = color;
+			irradiance += color;
+
+			// Rotating the normal around v (phi + pi/2) turns it towards this direction
+			const glm::vec3 v = -std::sin(phi) * tangent + std::cos(phi) * bitangent;
+			rotational += glm::outerProduct(sin_theta / std::max(cos_theta, 1e-3F) * color, v);
+		}
+	}
+
+	// Moving the point shifts the walls between the cells, the light of one cell then moves into its neighbour
+	glm::mat3 translational = glm::mat3(0.0F);
+	for (int k = 0; k < sectors; k++) {
+		const float phi = 2.0F * PI * (float(k) + 0.5F) / float(sectors);
+		const glm::vec3 u = std::cos(phi) * tangent + std::sin(phi) * bitangent;
+		const float phi_wall = 2.0F * PI * float(k) / float(sectors);
+		const glm::vec3 v = -std::sin(phi_wall) * tangent + std::cos(phi_wall) * bitangent;
+		const int previous = (k + sectors - 1) % sectors;
+		for (int j = 0; j < rings; j++) {
+			const float sin_lower = std::sqrt(float(j) / float(rings));
+			const float sin_upper = std::sqrt(float(j + 1) / float(rings));
+			const size_t cell = size_t(j * sectors + k);
+			if (j > 0) {
+				const size_t below = cell - size_t(sectors);
+				const float r = std::min(distance[cell], distance[below]);
+				const float factor = 2.0F * PI / float(sectors) * sin_lower * (1.0F - sin_lower * sin_lower) / r;
+				translational += glm::outerProduct(factor * (radiance[cell] - radiance[below]), u);
+			}
+			const size_t beside = size_t(j * sectors + previous);
+			const float r = std::min(distance[cell], distance[beside]);
+			translational += glm::outerProduct((sin_upper - sin_lower) / r * (radiance[cell] - radiance[beside]), v);
+		}
+	}
+
+	const float scale = PI / float(cells);
+	const float radius = inverse_distance > 0.0F ? float(cells) / inverse_distance : FLT_MAX;
+	return IrradianceRecord{position, normal, irradiance * scale, rotational * scale, translational, radius, hitInfo.meshIdx};
 }
 
-static glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, std::default_random_engine &rng, Ray &ray, HitInfo &hitInfo, const size_t depth) {
+template <typename Policy>
+static glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, PathSampler &sampler, Ray &ray, HitInfo &hitInfo, const size_t depth, const bool emission, PrimaryHit *primary) {
+	// The first hit may be known from an earlier render with the same camera
+	const bool known_hit = depth == 0 && data.primary_hit != nullptr;
+	if (known_hit) {
+		hitInfo = *data.primary_hit;
+	}
+
+	// Only mirror reflections add the emission of what they hit
+	const RayType type = depth == 0 ? RayType::Camera : emission ? RayType::Reflection : RayType::Indirect;
+
 	// Ray miss
-	if (depth >= data.max_traces || !bvh.intersect(ray, hitInfo)) {
+	if (depth >= data.max_traces || (known_hit ? hitInfo.meshIdx == INVALID_INDEX : !trace(bvh, ray, hitInfo, type))) {
 		// Draw a red debug ray if the ray missed.
-		if (data.debug) {
-			drawRay(ray, glm::vec3(1.0F, 0.0F, 0.0F));
-		}
+		draw_ray<Policy>(ray, glm::vec3(1.0F, 0.0F, 0.0F));
 
 		// Set the color of the pixel to black if the ray misses.
 		return glm::vec3(0.0F);
 	}
 
 	// Draw a white debug ray.
-	if (data.debug) {
-		drawRay(ray, glm::vec3(1.0F));
-	}
+	draw_ray<Policy>(ray, glm::vec3(1.0F));
 
 	glm::vec3 position = ray.origin + ray.direction * ray.t;
 	size_t new_depth = depth + 1;
@@ -120,14 +332,15 @@ static glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const Bo
 
 	// Direct color
 
-	glm::vec3 direct = shader(scene, bvh, ray, hitInfo, camera, data.debug);
+	// The point lights at the first hit may have been resampled for the whole image already
+	glm::vec3 direct = depth == 0 && data.primary_direct != nullptr ? *data.primary_direct : shader<Policy>(scene, bvh, data, sampler, ray, hitInfo, camera);
 	// If Ks is not black (glm::vec3{0, 0, 0} has magnitude 0)
 	if (glm::length(hitInfo.material.ks) > 0.0F) {
 		// Reflection of ray direction over the given normal
 		glm::vec3 reflectionDir = glm::normalize(ray.direction - 2.0F * glm::dot(ray.direction, hitInfo.normal) * hitInfo.normal);
 		Ray reflRay = Ray{position + reflectionDir * OFFSET, reflectionDir};
 		HitInfo new_hitInfo;
-		glm::vec3 reflColor = get_color(position, scene, bvh, data, rng, reflRay, new_hitInfo, new_depth);
+		glm::vec3 reflColor = get_color<Policy>(position, scene, bvh, data, sampler, reflRay, new_hitInfo, new_depth, true, nullptr);
 		glm::vec3 color =  hitInfo.material.ks * reflColor;
 		//if (reflRay.t < std::numeric_limits<float>::max()) {
 		//	color /= reflRay.t * reflRay.t;
@@ -137,45 +350,140 @@ static glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const Bo
 
 	// Indirect color
 
+	const bool area_lights = data.lights != nullptr && !data.lights->empty();
+	// Whether BSDF samples are traced, and can find lights themselves
+	const bool traced_samples = !Policy::debug && sample_depth < size_t(data.max_traces);
+	// ks is reflected by the mirror ray above, so the samples only carry the diffuse lobe
+	const BSDF bsdf = BSDF{Material{}, hitInfo.normal, -ray.direction};
+	const DirectionSampler directions = DirectionSampler{bsdf, data.guide, position, hitInfo.normal};
+	// Light from area lights, found both by sampling the lights and by BSDF samples that hit them
+	glm::vec3 emitted = glm::vec3(0.0F);
 	glm::vec3 indirect = glm::vec3(0.0F);
-	for (int i = 0; i < data.samples; i++) {
-		glm::vec3 dir = random_hemisphere_vector(rng, hitInfo.normal);
-		Ray sampleRay = Ray{position + dir * OFFSET, dir};
-	
-		// We only compute outside of debug draw
-		if (data.debug) {
-			Ray sampleRayLen1 = Ray{sampleRay.origin, sampleRay.direction, 0.1F};
-			drawRay(sampleRayLen1, glm::vec3(1.0F, 1.0F, 0.0F));
-		} else {
-			HitInfo sample_hitInfo;
-			sample_hitInfo.meshIdx = INVALID_INDEX;
-			glm::vec3 color = get_color(position, scene, bvh, data, rng, sampleRay, sample_hitInfo, sample_depth);
-			float factor = glm::dot(hitInfo.normal, dir);
+	// The cache only holds the irradiance, which is all a surface without specular reflection needs
+	const bool cached = data.irradiance_cache != nullptr && traced_samples && data.samples > 0 && glm::length(hitInfo.material.ks) == 0.0F;
+	if (data.photons != nullptr || cached) {
+		if (data.photons != nullptr) {
+			// Photons carry the light of the hemisphere samples, transforms included, so the irradiance is used like theirs
+			indirect = data.photons->irradiance(position, hitInfo.normal, data.photon_pass);
+		} else if (!data.irradiance_cache->lookup(position, hitInfo.normal, hitInfo.meshIdx, indirect)) {
+			// No record close enough, this point gets a new one
+			const IrradianceRecord record = irradiance_record<Policy>(scene, bvh, data, sampler, position, hitInfo, sample_depth);
+			data.irradiance_cache->insert(record);
+			indirect = record.irradiance;
+		}
+		// Area lights are not part of the cached or photon irradiance, they are sampled directly
+		if (area_lights) {
+			const int light_samples = std::max(data.samples, 1);
+			for (int i = 0; i < light_samples; i++) {
+				PathSampler sample_sampler = sampler.branch(uint32_t(i), uint32_t(light_samples));
+				emitted += sample_area_light<Policy>(data, bvh, position, hitInfo.normal, sample_sampler, nullptr);
+			}
+			emitted /= light_samples;
+		}
+	} else {
+		for (int i = 0; i < data.samples; i++) {
+			// Every sample continues its own path, stratified against the other samples of this vertex
+			PathSampler sample_sampler = sampler.branch(uint32_t(i), uint32_t(data.samples));
+			const BSDFSample sample = directions.sample(sample_sampler.next2D());
+			glm::vec3 dir = sample.direction;
+			Ray sampleRay = Ray{position + dir * OFFSET, dir};
+			if (area_lights) {
+				emitted += sample_area_light<Policy>(data, bvh, position, hitInfo.normal, sample_sampler, traced_samples ? &directions : nullptr);
+			}
 
-			// Transform
-			// Note that the resulting color is not clamped to [0, 1] on purpose
-			if (sample_hitInfo.meshIdx != INVALID_INDEX) {
-				const auto &[scalar, offset] = (*data.transforms)[sample_hitInfo.meshIdx][hitInfo.meshIdx];
-				color = scalar * color + offset;
+			// Below the surface, contributes nothing
+			if (sample.pdf <= 0.0F) {
+				continue;
+			}
+
+			// We only compute outside of debug draw
+			if constexpr (Policy::debug) {
+				Ray sampleRayLen1 = Ray{sampleRay.origin, sampleRay.direction, 0.1F};
+				drawRay(sampleRayLen1, glm::vec3(1.0F, 1.0F, 0.0F));
+			} else {
+				HitInfo sample_hitInfo;
+				sample_hitInfo.meshIdx = INVALID_INDEX;
+				glm::vec3 color = get_color<Policy>(position, scene, bvh, data, sample_sampler, sampleRay, sample_hitInfo, sample_depth, false, nullptr);
+				float factor = glm::dot(hitInfo.normal, dir);
+
+				// The sample found a light
+				if (sample_hitInfo.meshIdx != INVALID_INDEX && glm::length(sample_hitInfo.material.ke) > 0.0F) {
+					float weight = 1.0F;
+					if (area_lights) {
+						const float light_pdf = data.lights->pdf(sample_hitInfo.meshIdx) * sampleRay.t * sampleRay.t / std::fabs(glm::dot(sample_hitInfo.normal, dir));
+						weight = mis_weight(sample.pdf, light_pdf);
+					}
+					emitted += weight * sample_hitInfo.material.ke * factor / sample.pdf;
+				}
+
+				// Transform
+				// Note that the resulting color is not clamped to [0, 1] on purpose
+				if (sample_hitInfo.meshIdx != INVALID_INDEX) {
+					const auto &[scalar, offset] = (*data.transforms)[sample_hitInfo.meshIdx][hitInfo.meshIdx];
+					color = scalar * color + offset;
+				}
+
+				// Training passes teach the guide where light arrives from, emitters included
+				if (data.guide_training) {
+					const glm::vec3 incident = sample_hitInfo.meshIdx != INVALID_INDEX ? color + sample_hitInfo.material.ke : color;
+					data.guide->record(directions.leaf, dir, luminance(incident) / sample.pdf);
+				}
+
+				//if (sampleRay.t < std::numeric_limits<float>::max()) {
+				//	factor /= sampleRay.t * sampleRay.t;
+				//}
+				indirect += bsdf.eval(dir) * color / sample.pdf;
 			}
+		}
 
-			//if (sampleRay.t < std::numeric_limits<float>::max()) {
-			//	factor /= sampleRay.t * sampleRay.t;
-			//}
-			indirect += factor * color;
+		if (data.samples != 0) {
+			indirect /= data.samples;
+			indirect *= PI; // Divided by PI again below
+			emitted /= data.samples;
+		} else if (area_lights) {
+			// Without BSDF samples the lights are only found by sampling them
+			emitted = sample_area_light<Policy>(data, bvh, position, hitInfo.normal, sampler, nullptr);
 		}
 	}
+	// Area lights are direct light, so they are reflected like the point lights in shader()
+	direct += hitInfo.material.kd * emitted;
+
+	// Light emitted towards the ray origin
+	const glm::vec3 own_emission = emission ? hitInfo.material.ke : glm::vec3(0.0F);
 
-	if (data.samples != 0) {
-		indirect /= data.samples;
-		indirect *= 2.0F * M_PI;
+	// Render passes of the camera ray
+	if (primary != nullptr) {
+		primary->direct = direct / PI + own_emission;
+		primary->indirect = indirect / PI;
 	}
 
-	glm::vec3 color = (direct + indirect) / M_PI; /** hitInfo.material.kd*/ /// M_PI;
+	glm::vec3 color = (direct + indirect) / PI + own_emission; /** hitInfo.material.kd*/ /// PI;
 	return glm::clamp(color, 0.0F, 1.0F);
 }
 
-glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, std::default_random_engine &rng, Ray &ray) {
+int indirect_bounces(const int max_traces) {
+	// get_color traces the samples of a hit at depth d at max(d + 1, max_traces - 2)
+	int bounces = 0;
+	for (int depth = std::max(1, max_traces - 2); depth < max_traces; depth = std::max(depth + 1, max_traces - 2)) {
+		bounces++;
+	}
+	return bounces;
+}
+
+glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, PathSampler &sampler, Ray &ray) {
 	HitInfo hitInfo;
-	return get_color(camera, scene, bvh, data, rng, ray, hitInfo, 0);
+	if (data.debug) {
+		return get_color<DebugRays>(camera, scene, bvh, data, sampler, ray, hitInfo, 0, true, nullptr);
+	}
+	return get_color<Production>(camera, scene, bvh, data, sampler, ray, hitInfo, 0, true, nullptr);
+}
+
+glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, PathSampler &sampler, Ray &ray, PrimaryHit &primary) {
+	primary.hitInfo.meshIdx = INVALID_INDEX;
+	primary.direct = glm::vec3(0.0F);
+	primary.indirect = glm::vec3(0.0F);
+	if (data.debug) {
+		return get_color<DebugRays>(camera, scene, bvh, data, sampler, ray, primary.hitInfo, 0, true, &primary);
+	}
+	return get_color<Production>(camera, scene, bvh, data, sampler, ray, primary.hitInfo, 0, true, &primary);
 }
@@ -5,16 +5,95 @@ DISABLE_WARNINGS_PUSH()
 #include <glm/vec3.hpp>
 DISABLE_WARNINGS_POP()
 #include "bounding_volume_hierarchy.h"
+#include "bsdf.h"
+#include "gbuffer.h"
+#include "irradiance_cache.h"
+#include "lights.h"
 #include "mesh.h"
+#include "path_guiding.h"
+#include "photon_map.h"
+#include "ray_statistics.h"
+#include "restir.h"
+#include "sampler.h"
 #include "scene.h"
+#include "shadow_maps.h"
+
+enum class RenderMode {
+	PathTracing, // get_color: mirror reflections, hemisphere samples and light sampling from camera paths
+	Bidirectional, // Camera and light subpaths connected at every pair of vertices
+	Wavefront // The paths of get_color, traced breadth first in batches of pixels by WavefrontTracer
+};
 
 struct ShadingData {
 	bool debug;
 	int max_traces;
 	int samples;
 	std::vector<std::vector<std::tuple<glm::vec3, glm::vec3>>> *transforms;
+	SamplerType sampler = SamplerType::Random;
+	bool jitter = false; // Random position inside the pixel instead of its corner
+	const AreaLights *lights = nullptr; // Emissive triangles, sampled explicitly at every hit if set
+	const PointLightTree *point_lights = nullptr; // Picks light_samples point lights per hit if set and the scene has more lights
+	int light_samples = 4;
+	const PhotonMap *photons = nullptr; // Indirect light is looked up in the photon map instead of traced if set
+	int photon_pass = 0; // Pass of progressive photon mapping
+	IrradianceCache *irradiance_cache = nullptr; // Indirect light of diffuse surfaces is interpolated from cached records if set
+	PathGuide *guide = nullptr; // Hemisphere samples partly follow the incident light learned by the guide if set
+	bool guide_training = false; // Hemisphere samples are recorded in the guide
+	RenderMode mode = RenderMode::PathTracing;
+	ReservoirBuffer *restir = nullptr; // Point lights at the first hit are picked by spatiotemporal resampling if set
+	const glm::vec3 *primary_direct = nullptr; // Light of the point lights at the first hit if it was computed beforehand
+	GBuffer *primary_hits = nullptr; // First hits of the camera rays are kept and reused until the camera moves if set
+	const ShadowMaps *shadow_maps = nullptr; // Visibility of the point lights is looked up in precomputed maps where they are sure if set
+	const HitInfo *primary_hit = nullptr; // First hit of the camera ray if it is already known, the ray must then end at the hit
 };
 
+// What the camera ray saw, for the render passes
+struct PrimaryHit {
+	HitInfo hitInfo; // meshIdx is (size_t) -1 if the ray missed
+	glm::vec3 direct; // Direct light and reflections at the first hit
+	glm::vec3 indirect; // Hemisphere samples at the first hit
+};
+
+// Number of rays traced by the calling thread so far
+size_t traced_rays();
+
+// Closest hit of the ray, counted in traced_rays() and by type in the ray statistics
+bool trace(const BoundingVolumeHierarchy &bvh, Ray &ray, HitInfo &hitInfo, const RayType type);
+
+// Light of a point light reflected towards the camera, without shadows
+glm::vec3 point_light_contribution(const glm::vec3 &point, const glm::vec3 &normal, const Material &material, const PointLight &light, const glm::vec3 &camera);
+
+// Ray from the point to just before the light, false if the light is behind the surface (and so in shadow without a ray)
+bool shadow_ray(const glm::vec3 &point, const glm::vec3 &light, const glm::vec3 &normal, Ray &ray);
+
 bool is_shadow(const BoundingVolumeHierarchy &bvh, const glm::vec3 &point, const glm::vec3 &light, const glm::vec3 &normal, const bool debug);
 
-glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, std::default_random_engine &rng, Ray &ray);
+// Directions of the hemisphere samples: from the BSDF, or with path guiding from a mix of the BSDF and the learned incident light
+struct DirectionSampler {
+	const BSDF &bsdf;
+	const PathGuide *guide;
+	size_t leaf;
+	glm::vec3 normal;
+
+	DirectionSampler(const BSDF &surface_bsdf, const PathGuide *path_guide, const glm::vec3 &position, const glm::vec3 &surface_normal);
+
+	BSDFSample sample(glm::vec2 u) const;
+
+	float pdf(const glm::vec3 &direction) const;
+};
+
+// Power heuristic for two strategies that take the same number of samples
+float mis_weight(const float pdf, const float other_pdf);
+
+// Next-event estimation up to the shadow ray: light arriving from a random point on an area light, divided by the density of that
+// direction, if nothing is in between. Returns false if the sample brings no light, otherwise the point on the light still has to be
+// tested for shadow. If directions is set the estimate is weighted against finding the same light with one of its samples.
+bool area_light_estimate(const ShadingData &data, const glm::vec3 &position, const glm::vec3 &normal, PathSampler &sampler, const DirectionSampler *directions, glm::vec3 &estimate, glm::vec3 &light_position);
+
+// Levels of hemisphere samples that get_color traces below a camera hit, the bounces photons need to carry the same light
+int indirect_bounces(const int max_traces);
+
+glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, PathSampler &sampler, Ray &ray);
+
+// Also returns the first hit of the ray and the light arriving there
+glm::vec3 get_color(const glm::vec3 &camera, const Scene &scene, const BoundingVolumeHierarchy &bvh, const ShadingData &data, PathSampler &sampler, Ray &ray, PrimaryHit &primary);
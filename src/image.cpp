@@ -3,12 +3,13 @@ DISABLE_WARNINGS_PUSH()
 #include <stb_image.h>
 DISABLE_WARNINGS_POP()
 #include <iostream>
+#include <stdexcept>
+#include <string>
 #include "image.h"
 
 Image::Image(const std::filesystem::path &filePath) {
     if (!std::filesystem::exists(filePath)) {
-        std::cerr << "Texture file " << filePath << " does not exists!" << std::endl;
-        throw std::exception();
+        throw std::runtime_error("Texture file " + filePath.string() + " does not exists!");
     }
 
     const std::string filePathStr = filePath.string(); // Create l-value so c_str() is safe.
@@ -16,15 +17,13 @@ Image::Image(const std::filesystem::path &filePath) {
     stbi_uc* pixels = stbi_load(filePathStr.c_str(), &m_width, &m_height, &numChannels, STBI_rgb);
 
     if (numChannels < 3) {
-        std::cerr << "Only textures with 3 or more color channels are supported. " << filePath << " has " << numChannels << " channels" << std::endl;
-        throw std::exception();
+        throw std::runtime_error("Only textures with 3 or more color channels are supported. " + filePath.string() + " has " + std::to_string(numChannels) + " channels");
     }
     if (!pixels) {
-        std::cerr << "Failed to read texture " << filePath << " using stb_image.h" << std::endl;
-        throw std::exception();
+        throw std::runtime_error("Failed to read texture " + filePath.string() + " using stb_image.h");
     }
 
-    std::cout << "Num channels: " << numChannels << std::endl;
+    std::cerr << "Num channels: " << numChannels << std::endl;
     for (int i = 0; i < m_width * m_height * numChannels; i += numChannels) {
         m_pixels.emplace_back(pixels[i + 0] / 255.0F, pixels[i + 1] / 255.0F, pixels[i + 2] / 255.0F);
     }
@@ -0,0 +1,130 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <glm/vector_relational.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <mutex>
+#include "irradiance_cache.h"
+
+// Nodes are not split further than this, so records with a tiny radius do not make a deep tree
+static constexpr int MAX_DEPTH = 16;
+// Nodes waiting on the stack of a lookup: up to seven siblings per level above the current node and the children of the deepest one
+static constexpr size_t LOOKUP_STACK_SIZE = 7 * MAX_DEPTH + 8;
+// Records slightly in front of the point are still used, as a fraction of their radius
+static constexpr float FRONT_TOLERANCE = 0.05F;
+
+static float luminance(const glm::vec3 &color) {
+    return glm::dot(color, glm::vec3(0.2126F, 0.7152F, 0.0722F));
+}
+
+IrradianceCache::IrradianceCache(const Scene &scene, const IrradianceCacheSettings &settings): cacheSettings(settings) {
+    glm::vec3 lower = glm::vec3(FLT_MAX);
+    glm::vec3 upper = glm::vec3(-FLT_MAX);
+    for (const Mesh &mesh : scene.meshes) {
+        for (const glm::vec3 &position : mesh.positions) {
+            lower = glm::min(lower, position);
+            upper = glm::max(upper, position);
+        }
+    }
+    if (lower.x > upper.x) {
+        lower = glm::vec3(0.0F);
+        upper = glm::vec3(0.0F);
+    }
+
+    const float size = std::max(glm::length(upper - lower), FLT_MIN);
+    minRadius = settings.minSpacing * size;
+    maxRadius = settings.maxSpacing * size;
+    root.center = (lower + upper) / 2.0F;
+    root.halfSize = std::max(std::max(upper.x - lower.x, upper.y - lower.y), upper.z - lower.z) / 2.0F + FLT_MIN;
+}
+
+const IrradianceCacheSettings &IrradianceCache::settings() const {
+    return cacheSettings;
+}
+
+float IrradianceCache::weight(const IrradianceRecord &record, const glm::vec3 &position, const glm::vec3 &normal) const {
+    const glm::vec3 offset = position - record.position;
+    // The record is in front of the point, it sees surfaces the point does not
+    if (glm::dot(offset, (normal + record.normal) / 2.0F) < -FRONT_TOLERANCE * record.radius) {
+        return 0.0F;
+    }
+    const float error = glm::length(offset) / record.radius + std::sqrt(std::max(1.0F - glm::dot(normal, record.normal), 0.0F));
+    return error < cacheSettings.accuracy ? 1.0F / std::max(error, FLT_MIN) : 0.0F;
+}
+
+bool IrradianceCache::lookup(const glm::vec3 &position, const glm::vec3 &normal, size_t meshIdx, glm::vec3 &irradiance) const {
+    const std::shared_lock lock{mutex};
+
+    glm::vec3 sum = glm::vec3(0.0F);
+    float weights = 0.0F;
+    std::array<const Node *, LOOKUP_STACK_SIZE> stack;
+    stack[0] = &root;
+    size_t pending = 1;
+    while (pending > 0) {
+        const Node *node = stack[--pending];
+        for (const IrradianceRecord &record : node->records) {
+            if (record.meshIdx != meshIdx) {
+                continue;
+            }
+            const float w = weight(record, position, normal);
+            if (w <= 0.0F) {
+                continue;
+            }
+            // First order extrapolation to the point and normal
+            const glm::vec3 extrapolated = record.irradiance + record.rotational * glm::cross(record.normal, normal) + record.translational * (position - record.position);
+            sum += w * glm::max(extrapolated, 0.0F);
+            weights += w;
+        }
+        // A record is used at most its node size away from it, so the children are twice as large for the lookup
+        for (const std::unique_ptr<Node> &child : node->children) {
+            if (child != nullptr && glm::all(glm::lessThanEqual(glm::abs(position - child->center), glm::vec3(2.0F * child->halfSize)))) {
+                stack[pending++] = child.get();
+            }
+        }
+    }
+
+    if (weights <= 0.0F) {
+        return false;
+    }
+    irradiance = sum / weights;
+    return true;
+}
+
+void IrradianceCache::insert(IrradianceRecord record) {
+    // The irradiance should not change by more than itself over the radius (Tabellion and Lamorlette 2004)
+    const glm::vec3 gradient = glm::transpose(record.translational) * glm::vec3(0.2126F, 0.7152F, 0.0722F);
+    const float gradientLength = glm::length(gradient);
+    if (gradientLength > 0.0F) {
+        record.radius = std::min(record.radius, luminance(record.irradiance) / gradientLength);
+    }
+    record.radius = glm::clamp(record.radius, minRadius, maxRadius);
+    // Farthest distance at which the record is used
+    const float reach = record.radius * cacheSettings.accuracy;
+
+    const std::unique_lock lock{mutex};
+    Node *node = &root;
+    for (int depth = 0; depth < MAX_DEPTH && node->halfSize / 2.0F >= reach; depth++) {
+        const glm::vec3 offset = record.position - node->center;
+        const glm::bvec3 side = glm::greaterThan(offset, glm::vec3(0.0F));
+        const size_t child = (side.x ? 1U : 0U) | (side.y ? 2U : 0U) | (side.z ? 4U : 0U);
+        if (node->children[child] == nullptr) {
+            const float halfSize = node->halfSize / 2.0F;
+            node->children[child] = std::make_unique<Node>();
+            node->children[child]->center = node->center + halfSize * (2.0F * glm::vec3(side) - 1.0F);
+            node->children[child]->halfSize = halfSize;
+        }
+        node = node->children[child].get();
+    }
+    node->records.push_back(record);
+    records++;
+}
+
+size_t IrradianceCache::size() const {
+    const std::shared_lock lock{mutex};
+    return records;
+}
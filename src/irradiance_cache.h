@@ -0,0 +1,67 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/mat3x3.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+#include "scene.h"
+
+struct IrradianceCacheSettings {
+    float accuracy = 0.2F; // Ward's a, records are used further away for larger values
+    float minSpacing = 0.005F; // Bounds of the record radius, as a fraction of the scene size
+    float maxSpacing = 0.1F;
+    int rays = 256; // Hemisphere rays per record
+};
+
+// Irradiance of indirect light at a point, computed from stratified hemisphere rays
+struct IrradianceRecord {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 irradiance;
+    glm::mat3 rotational; // Change of the irradiance per rotation of the normal (ni x n), one column per axis
+    glm::mat3 translational; // Change of the irradiance per unit of movement, one column per axis
+    float radius; // Harmonic mean distance to the surfaces seen from the point
+    size_t meshIdx; // Records are only shared within a mesh, the light transforms depend on it
+};
+
+// Ward's irradiance cache ("A Ray Tracing Solution for Diffuse Interreflection", Ward et al. 1988) with the gradients of
+// "Irradiance Gradients" (Ward and Heckbert 1992). Records live in a loose octree: a record is stored in the smallest node
+// that is at least as large as the distance over which it is used. Lookups and inserts can come from any number of threads.
+class IrradianceCache {
+public:
+    IrradianceCache(const Scene &scene, const IrradianceCacheSettings &settings);
+
+    const IrradianceCacheSettings &settings() const;
+
+    // Irradiance interpolated from the records near the point, false if there are none and a new record is needed
+    bool lookup(const glm::vec3 &position, const glm::vec3 &normal, size_t meshIdx, glm::vec3 &irradiance) const;
+
+    // The radius of the record is clamped to the spacing of the settings
+    void insert(IrradianceRecord record);
+
+    size_t size() const;
+
+private:
+    struct Node {
+        glm::vec3 center;
+        float halfSize;
+        std::vector<IrradianceRecord> records;
+        std::array<std::unique_ptr<Node>, 8> children;
+    };
+
+    // Inverse of the error of using the record at the point, 0 if the record should not be used
+    float weight(const IrradianceRecord &record, const glm::vec3 &position, const glm::vec3 &normal) const;
+
+    IrradianceCacheSettings cacheSettings;
+    float minRadius;
+    float maxRadius;
+    Node root;
+    size_t records = 0;
+    mutable std::shared_mutex mutex;
+};
@@ -0,0 +1,194 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include "lights.h"
+
+static constexpr float PI = 3.14159265358979323846F;
+
+static float luminance(const glm::vec3 &color) {
+    return glm::dot(color, glm::vec3(0.2126F, 0.7152F, 0.0722F));
+}
+
+static float triangleArea(const Mesh &mesh, const Triangle &triangle) {
+    const glm::vec3 &v0 = mesh.positions[triangle[0]];
+    const glm::vec3 &v1 = mesh.positions[triangle[1]];
+    const glm::vec3 &v2 = mesh.positions[triangle[2]];
+    return 0.5F * glm::length(glm::cross(v1 - v0, v2 - v0));
+}
+
+AreaLights::AreaLights(const Scene *lightScene): scene(lightScene) {
+    meshPdf.resize(scene->meshes.size(), 0.0F);
+
+    float total = 0.0F;
+    for (size_t m = 0; m < scene->meshes.size(); m++) {
+        const Mesh &mesh = scene->meshes[m];
+        const float radiance = luminance(mesh.material.ke);
+        if (radiance <= 0.0F) {
+            continue;
+        }
+        for (size_t t = 0; t < mesh.triangles.size(); t++) {
+            const float area = triangleArea(mesh, mesh.triangles[t]);
+            if (area <= 0.0F) {
+                continue;
+            }
+            total += radiance * area;
+            triangles.push_back(std::tuple(m, t));
+            cdf.push_back(total);
+        }
+        meshPdf[m] = radiance;
+    }
+
+    // A Lambertian emitter of radiance L and area A emits pi * L * A per side
+    totalPower = 2.0F * PI * total;
+    for (float &c : cdf) {
+        c /= total;
+    }
+    // A point is picked with probability radiance * area / total and then has density 1 / area
+    for (float &p : meshPdf) {
+        p = triangles.empty() ? 0.0F : p / total;
+    }
+}
+
+bool AreaLights::empty() const {
+    return triangles.empty();
+}
+
+LightSample AreaLights::sample(const glm::vec2 &u, const glm::vec2 &v) const {
+    const size_t i = std::min(size_t(std::upper_bound(cdf.begin(), cdf.end(), u.x) - cdf.begin()), triangles.size() - 1);
+    const auto &[meshIdx, triangleIdx] = triangles[i];
+    const Mesh &mesh = scene->meshes[meshIdx];
+    const Triangle &triangle = mesh.triangles[triangleIdx];
+    const glm::vec3 &v0 = mesh.positions[triangle[0]];
+    const glm::vec3 &v1 = mesh.positions[triangle[1]];
+    const glm::vec3 &v2 = mesh.positions[triangle[2]];
+
+    // Uniform point on the triangle
+    const float su = std::sqrt(v.x);
+    const float b0 = 1.0F - su;
+    const float b1 = v.y * su;
+    const glm::vec3 position = b0 * v0 + b1 * v1 + (1.0F - b0 - b1) * v2;
+
+    return LightSample{position, glm::normalize(glm::cross(v1 - v0, v2 - v0)), mesh.material.ke, meshPdf[meshIdx]};
+}
+
+float AreaLights::pdf(size_t meshIdx) const {
+    return meshIdx < meshPdf.size() ? meshPdf[meshIdx] : 0.0F;
+}
+
+float AreaLights::power() const {
+    return totalPower;
+}
+
+static constexpr size_t NO_LIGHT = SIZE_MAX;
+
+PointLightTree::PointLightTree(const Scene *lightScene): scene(lightScene) {
+    if (scene->pointLights.empty()) {
+        return;
+    }
+    std::vector<size_t> lights(scene->pointLights.size());
+    std::iota(lights.begin(), lights.end(), 0);
+    nodes.reserve(2 * lights.size() - 1);
+    build(lights, 0, lights.size());
+}
+
+bool PointLightTree::empty() const {
+    return nodes.empty();
+}
+
+size_t PointLightTree::build(std::vector<size_t> &lights, size_t begin, size_t end) {
+    const std::vector<PointLight> &pointLights = scene->pointLights;
+    const size_t index = nodes.size();
+    nodes.push_back(Node{AxisAlignedBox{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)}, 0.0F, NO_LIGHT, NO_LIGHT, NO_LIGHT});
+
+    AxisAlignedBox box = AxisAlignedBox{glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX)};
+    float power = 0.0F;
+    for (size_t i = begin; i < end; i++) {
+        const PointLight &light = pointLights[lights[i]];
+        box.lower = glm::min(box.lower, light.position);
+        box.upper = glm::max(box.upper, light.position);
+        power += luminance(light.color);
+    }
+
+    if (end - begin == 1) {
+        nodes[index] = Node{box, power, NO_LIGHT, NO_LIGHT, lights[begin]};
+        return index;
+    }
+
+    // Median split along the longest axis
+    const glm::vec3 extent = box.upper - box.lower;
+    const int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    const size_t middle = begin + (end - begin) / 2;
+    const auto first = lights.begin();
+    std::nth_element(first + std::ptrdiff_t(begin), first + std::ptrdiff_t(middle), first + std::ptrdiff_t(end),
+        [&](size_t a, size_t b) { return pointLights[a].position[axis] < pointLights[b].position[axis]; });
+
+    const size_t left = build(lights, begin, middle);
+    const size_t right = build(lights, middle, end);
+    nodes[index] = Node{box, power, left, right, NO_LIGHT};
+    return index;
+}
+
+// Power times the largest cosine between the normal and a direction towards the box, bounded by the cone around the
+// bounding sphere of the box. Point lights do not fall off with distance in this renderer, so distance is ignored.
+float PointLightTree::importance(const Node &node, const glm::vec3 &position, const glm::vec3 &normal) const {
+    if (node.light != NO_LIGHT) {
+        const glm::vec3 direction = scene->pointLights[node.light].position - position;
+        const float length = glm::length(direction);
+        return length > 0.0F ? node.power * std::max(glm::dot(normal, direction / length), 0.0F) : node.power;
+    }
+
+    const glm::vec3 center = 0.5F * (node.box.lower + node.box.upper);
+    const float radius = 0.5F * glm::length(node.box.upper - node.box.lower);
+    const glm::vec3 direction = center - position;
+    const float distance = glm::length(direction);
+    if (distance <= radius) {
+        return node.power;
+    }
+
+    const float sinRadius = radius / distance;
+    const float cosRadius = std::sqrt(1.0F - sinRadius * sinRadius);
+    const float cosCenter = glm::dot(normal, direction / distance);
+    if (cosCenter >= cosRadius) {
+        return node.power;
+    }
+    // cos(angle to the center - half angle of the cone)
+    const float sinCenter = std::sqrt(std::max(1.0F - cosCenter * cosCenter, 0.0F));
+    return node.power * std::max(cosCenter * cosRadius + sinCenter * sinRadius, 0.0F);
+}
+
+size_t PointLightTree::sample(const glm::vec3 &position, const glm::vec3 &normal, float u, float &pdf) const {
+    pdf = 1.0F;
+    size_t index = 0;
+    while (nodes[index].light == NO_LIGHT) {
+        const Node &node = nodes[index];
+        const float left = importance(nodes[node.left], position, normal);
+        const float right = importance(nodes[node.right], position, normal);
+        if (left + right <= 0.0F) {
+            pdf = 0.0F;
+            return NO_LIGHT;
+        }
+
+        // Reuse u for the next level
+        const float p = left / (left + right);
+        if (u < p) {
+            u /= p;
+            pdf *= p;
+            index = node.left;
+        } else {
+            u = (u - p) / (1.0F - p);
+            pdf *= 1.0F - p;
+            index = node.right;
+        }
+        u = std::min(u, 1.0F - FLT_EPSILON / 2.0F);
+    }
+    if (importance(nodes[index], position, normal) <= 0.0F) {
+        pdf = 0.0F;
+    }
+    return nodes[index].light;
+}
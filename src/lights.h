@@ -0,0 +1,74 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstddef>
+#include <tuple>
+#include <vector>
+#include "scene.h"
+
+// A point on an area light
+struct LightSample {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec3 emission;
+    float pdf; // Per unit area
+};
+
+// The triangles of all meshes with an emissive material (Ke in the .mtl file). Triangles are picked in proportion to the
+// power they emit, so the density of a point only depends on its mesh. Lights emit on both sides, like all surfaces are two-sided.
+class AreaLights {
+public:
+    AreaLights(const Scene *lightScene);
+
+    bool empty() const;
+
+    // u picks the triangle, v the point on the triangle
+    LightSample sample(const glm::vec2 &u, const glm::vec2 &v) const;
+
+    // Density per unit area of sampling a point on the mesh, 0 if the mesh is not a light
+    float pdf(size_t meshIdx) const;
+
+    // Luminance of the flux emitted by all lights, on both sides
+    float power() const;
+
+private:
+    const Scene *scene;
+    float totalPower = 0.0F;
+    std::vector<std::tuple<size_t, size_t>> triangles; // Mesh index, triangle index
+    std::vector<float> cdf;
+    std::vector<float> meshPdf;
+};
+
+// Bounding volume hierarchy over the point lights of a scene. A light is picked by walking down the tree, choosing each child
+// in proportion to the power of its lights times a bound on the cosine at the shading point, which takes O(log n) time.
+// Point lights can be moved in the user interface, so the tree has to be rebuilt before rendering.
+class PointLightTree {
+public:
+    PointLightTree(const Scene *lightScene);
+
+    bool empty() const;
+
+    // Index of the picked light in scene.pointLights, pdf is set to the probability of picking it.
+    // The pdf is 0 if no light lies above the surface.
+    size_t sample(const glm::vec3 &position, const glm::vec3 &normal, float u, float &pdf) const;
+
+private:
+    struct Node {
+        AxisAlignedBox box;
+        float power;
+        size_t left;
+        size_t right;
+        size_t light; // Leaf if this is not (size_t) -1
+    };
+
+    size_t build(std::vector<size_t> &lights, size_t begin, size_t end);
+
+    float importance(const Node &node, const glm::vec3 &position, const glm::vec3 &normal) const;
+
+    const Scene *scene;
+    std::vector<Node> nodes;
+};
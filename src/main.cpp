@@ -7,12 +7,18 @@ DISABLE_WARNINGS_POP()
 #include <atomic>
 #include <deque>
 #include <iostream>
+#include <optional>
 #include <random>
 #include <string>
 #include "bounding_volume_hierarchy.h"
+#include "denoiser.h"
 #include "draw.h"
+#include "headless.h"
 #include "illumination.h"
+#include "profiler.h"
+#include "render.h"
 #include "screen.h"
+#include "telemetry.h"
 #include "trackball.h"
 #include "window.h"
 #ifdef USE_OPENMP
@@ -28,36 +34,16 @@ static const std::filesystem::path outputPath{ OUTPUT_DIR };
 static void setOpenGLMatrices(const Trackball &camera);
 static void renderOpenGL(const Scene &scene, const Trackball &camera, int selectedLight);
 
-// This is the main rendering function. You are free to change this function in any way (including the function signature).
-static void renderRayTracing(const Scene& scene, const Trackball& camera, const BoundingVolumeHierarchy& bvh, const ShadingData &data, std::default_random_engine rng, Screen& screen) {
-    std::atomic_size_t render_progress = 0;
-#ifdef USE_OPENMP
-#pragma omp parallel for
-#endif
-    for (int y = 0; y < HEIGHT; y++) {
-        for (int x = 0; x < WIDTH; x++) {
-            // NOTE: (-1, -1) at the bottom left of the screen, (+1, +1) at the top right of the screen.
-            glm::vec2 normalizedPixelPos{
-                float(x) / WIDTH * 2.0F - 1.0F,
-                float(y) / HEIGHT * 2.0F - 1.0F
-            };
-            Ray cameraRay = camera.generateRay(normalizedPixelPos);
-            glm::vec3 color = get_color(camera.position(), scene, bvh, data, rng, cameraRay);
-            screen.setPixel(x, y, color);
-
-            size_t i = ++render_progress;
-            if (i % 64 == 0) {
-                float f = 100.0F * i / (WIDTH * HEIGHT);
-                std::cout << "\r\033[2KProgress: " << f << "%" << std::flush;
-            }
+int main(int argc, char *argv[]) {
+    try {
+        const std::optional<RenderJob> job = parseCommandLine(argc, argv, outputPath);
+        if (job) {
+            return renderHeadless(*job, dataPath);
         }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
     }
-    std::cout << std::endl;
-}
-
-int main(int argc, char *argv[]) {
-    (void) argc;
-    (void) argv;
 
     Trackball::printHelp();
     std::cout << "Press the [R] key on your keyboard to create a ray towards the mouse cursor" << std::endl;
@@ -71,19 +57,40 @@ int main(int argc, char *argv[]) {
 
     Scene scene = loadScene(sceneType, dataPath);
 
-    std::chrono::steady_clock::time_point start = std::chrono::high_resolution_clock::now();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     BoundingVolumeHierarchy bvh{&scene};
-    std::chrono::steady_clock::time_point end = std::chrono::high_resolution_clock::now();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
     std::cout << "Time to compute bounding volume hierarchy: " << std::chrono::duration<float, std::milli>(end - start).count() << " millisecond(s)" << std::endl;
+    std::cout << "Ray/triangle tests: " << simdLevelName(simdLevel()) << std::endl;
+    const AreaLights lights{&scene};
 
-    unsigned int seed = std::chrono::system_clock::now().time_since_epoch().count();
-    std::default_random_engine rng;
-    rng.seed(seed);
+    unsigned int seed = static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count());
     std::cout << "Seed: " << seed << std::endl;
 
     std::optional<Ray> optDebugRay;
     int bvhDebugLevel = 0;
     bool debugBVH{ false };
+    bool denoiseRender{ false };
+    bool writeAOVs{ false };
+    bool writeProfileFile{ false };
+    bool writeProgressLog{ false };
+    // Of the last render to file. Only read after the render, when the reporter thread has been joined.
+    std::optional<ProgressSample> lastProgress;
+    bool photonMapping{ false };
+    PhotonSettings photonSettings;
+    bool irradianceCaching{ false };
+    IrradianceCacheSettings cacheSettings;
+    bool pathGuiding{ false };
+    GuidingSettings guidingSettings;
+    bool restirDirect{ false };
+    bool progressivePreview{ false };
+    std::optional<ReservoirBuffer> previewReservoirs;
+    bool shadowMapping{ false };
+    ShadowMapSettings shadowMapSettings;
+    std::optional<ShadowMaps> shadowMaps;
+    std::vector<glm::vec3> previewSum;
+    int previewFrames = 0;
+    glm::mat4 previewView{ 1.0F };
     int selectedLight = 0;
     bool showSelectedMesh = false;
     bool showSelectedMeshE = false; // for showing meshes selected for edit
@@ -94,6 +101,30 @@ int main(int argc, char *argv[]) {
     size_t meshCount = scene.meshes.size();
     std::vector<std::vector<std::tuple<glm::vec3, glm::vec3>>> transforms(meshCount, std::vector<std::tuple<glm::vec3, glm::vec3>>(meshCount, std::tuple(glm::vec3(1.0F), glm::vec3(0.0F))));
     ShadingData data = ShadingData{false, 3, 32, &transforms};
+    data.lights = &lights;
+    // Built again only when a light is edited
+    PointLightTree pointLights{&scene};
+    data.point_lights = &pointLights;
+    // Lights and materials can be edited, the geometry can not
+    GBuffer primaryHits;
+    data.primary_hits = &primaryHits;
+    // Kept between renders, only the maps of lights that moved are traced again
+    auto updateShadowMaps = [&]() -> const ShadowMaps * {
+        if (!shadowMapping) {
+            return nullptr;
+        }
+        if (!shadowMaps || shadowMaps->settings().resolution != shadowMapSettings.resolution) {
+            shadowMaps.emplace(shadowMapSettings);
+        }
+        const std::chrono::steady_clock::time_point shadowStart = std::chrono::steady_clock::now();
+        const size_t traced = shadowMaps->update(scene, bvh);
+        const std::chrono::steady_clock::time_point shadowEnd = std::chrono::steady_clock::now();
+        if (traced > 0) {
+            profileEvent("shadow maps", shadowStart, shadowEnd);
+            std::cout << "Time to trace " << traced << " shadow map(s) of " << shadowMaps->resolution() << " texels: " << std::chrono::duration<float, std::milli>(shadowEnd - shadowStart).count() << " millisecond(s)" << std::endl;
+        }
+        return &*shadowMaps;
+    };
 
     window.registerKeyCallback([&](int key, int scancode, int action, int mods) {
             (void) scancode;
@@ -124,21 +155,151 @@ int main(int argc, char *argv[]) {
         ImGui::Begin("Menu");
         ImGui::SliderInt("Depth", &data.max_traces, 1, 8);
         ImGui::SliderInt("Samples", &data.samples, 0, 128);
+        ImGui::SliderInt("Light samples", &data.light_samples, 1, 16);
         {
-            if (ImGui::InputScalar("Seed", ImGuiDataType_::ImGuiDataType_U32, (void *) &seed, NULL, NULL, "%u", 0)) {
-                rng.seed(seed);
+            const char *options[] = {"Random", "Halton", "Sobol", "Blue noise"};
+            int sampler = int(data.sampler);
+            if (ImGui::Combo("Sampler", &sampler, options, 4)) {
+                data.sampler = SamplerType(sampler);
             }
+            ImGui::Checkbox("Jitter pixels", &data.jitter);
         }
+        {
+            const char *options[] = {"Path tracing", "Bidirectional", "Wavefront"};
+            int mode = int(data.mode);
+            if (ImGui::Combo("Render mode", &mode, options, 3)) {
+                data.mode = RenderMode(mode);
+            }
+        }
+        ImGui::InputScalar("Seed", ImGuiDataType_::ImGuiDataType_U32, (void *) &seed, NULL, NULL, "%u", 0);
         ImGui::Spacing();
         ImGui::Separator();
+        ImGui::Checkbox("Denoise", &denoiseRender);
+        ImGui::Checkbox("Write render passes", &writeAOVs);
+        ImGui::Checkbox("Write profile", &writeProfileFile);
+        ImGui::Checkbox("Write progress log", &writeProgressLog);
+        ImGui::Checkbox("Photon mapping", &photonMapping);
+        if (photonMapping) {
+            int photons = int(photonSettings.photons);
+            if (ImGui::SliderInt("Photons per pass", &photons, 1000, 1000000)) {
+                photonSettings.photons = size_t(photons);
+            }
+            ImGui::SliderInt("Photon passes", &photonSettings.passes, 1, 64);
+            ImGui::SliderFloat("Photon radius", &photonSettings.radius, 0.001F, 0.2F);
+        }
+        ImGui::Checkbox("Irradiance cache", &irradianceCaching);
+        if (irradianceCaching) {
+            ImGui::SliderFloat("Cache accuracy", &cacheSettings.accuracy, 0.05F, 1.0F);
+            ImGui::SliderInt("Cache rays", &cacheSettings.rays, 16, 1024);
+        }
+        ImGui::Checkbox("Path guiding", &pathGuiding);
+        if (pathGuiding) {
+            ImGui::SliderInt("Training passes", &guidingSettings.iterations, 1, 8);
+        }
+        ImGui::Checkbox("ReSTIR direct light", &restirDirect);
+        ImGui::Checkbox("Shadow maps", &shadowMapping);
+        if (shadowMapping) {
+            ImGui::SliderInt("Shadow map resolution", &shadowMapSettings.resolution, 64, 2048);
+        }
+        ImGui::Checkbox("Progressive preview", &progressivePreview);
         if (ImGui::Button("Render to file")) {
+            if (writeProfileFile) {
+                startProfile();
+            }
+            AOVBuffers aovs{screen.resolution()};
+            std::optional<PhotonMap> photons;
+            if (photonMapping) {
+                PhotonSettings settings = photonSettings;
+                settings.bounces = indirect_bounces(data.max_traces);
+                const std::chrono::steady_clock::time_point photonStart = std::chrono::steady_clock::now();
+                photons.emplace(scene, bvh, lights, *data.transforms, settings, data.sampler, seed);
+                const std::chrono::steady_clock::time_point photonEnd = std::chrono::steady_clock::now();
+                profileEvent("photon map", photonStart, photonEnd);
+                std::cout << "Time to shoot " << photons->size() << " photons: " << std::chrono::duration<float, std::milli>(photonEnd - photonStart).count() << " millisecond(s)" << std::endl;
+            }
+            data.photons = photons ? &*photons : nullptr;
+            // Records are only valid for this render, the transforms and lights may change afterwards
+            std::optional<IrradianceCache> cache;
+            if (irradianceCaching) {
+                cache.emplace(scene, cacheSettings);
+            }
+            data.irradiance_cache = cache ? &*cache : nullptr;
+            std::optional<PathGuide> guide;
+            if (pathGuiding) {
+                const std::chrono::steady_clock::time_point guideStart = std::chrono::steady_clock::now();
+                guide.emplace(scene, guidingSettings);
+                ProgressOutput progress;
+                progress.label = "Training path guide";
+                trainPathGuide(scene, camera, bvh, data, seed, screen.resolution(), *guide, progress);
+                const std::chrono::steady_clock::time_point guideEnd = std::chrono::steady_clock::now();
+                profileEvent("train path guide", guideStart, guideEnd);
+                std::cout << "Time to train path guide: " << std::chrono::duration<float, std::milli>(guideEnd - guideStart).count() / 1000.0F << " second(s)" << std::endl;
+            }
+            data.guide = guide ? &*guide : nullptr;
+            std::optional<ReservoirBuffer> reservoirs;
+            if (restirDirect) {
+                reservoirs.emplace(screen.resolution(), ReSTIRSettings{});
+            }
+            data.restir = reservoirs ? &*reservoirs : nullptr;
+            data.shadow_maps = updateShadowMaps();
+            // Builds with ray statistics always write the heat maps
+#ifdef USE_RAY_STATISTICS
+            const bool heatMaps = true;
+#else
+            const bool heatMaps = false;
+#endif
             {
-                const std::chrono::steady_clock::time_point start = std::chrono::high_resolution_clock::now();
-                renderRayTracing(scene, camera, bvh, data, rng, screen);
-                const std::chrono::steady_clock::time_point end = std::chrono::high_resolution_clock::now();
+                const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                ProgressOutput progress;
+                if (writeProgressLog) {
+                    progress.log = outputPath / "progress.jsonl";
+                }
+                progress.callback = [&](const ProgressSample &sample) { lastProgress = sample; };
+                const RenderStats stats = renderRayTracing(scene, camera, bvh, data, seed, screen, (denoiseRender || writeAOVs || heatMaps) ? &aovs : nullptr, progress);
+                const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+                profileEvent("render", start, end);
                 std::cout << "Time to render image: " << std::chrono::duration<float, std::milli>(end - start).count() / 1000.0F << " second(s)" << std::endl;
+                if (cache) {
+                    std::cout << "Irradiance cache records: " << cache->size() << std::endl;
+                }
+#ifdef USE_RAY_STATISTICS
+                const RayStatistics &statistics = stats.statistics;
+                std::cout << "Rays: " << statistics.rays[size_t(RayType::Camera)] << " camera, " << statistics.rays[size_t(RayType::Shadow)] << " shadow, "
+                          << statistics.rays[size_t(RayType::Reflection)] << " reflection, " << statistics.rays[size_t(RayType::Indirect)] << " indirect, "
+                          << statistics.hits << " hits" << std::endl;
+                std::cout << "BVH nodes tested: " << statistics.nodes << ", triangles tested: " << statistics.triangles << std::endl;
+#else
+                (void) stats;
+#endif
+            }
+            if (denoiseRender) {
+                const std::chrono::steady_clock::time_point denoiseStart = std::chrono::steady_clock::now();
+                denoise(screen, aovs, DenoiseSettings{});
+                const std::chrono::steady_clock::time_point denoiseEnd = std::chrono::steady_clock::now();
+                profileEvent("denoise", denoiseStart, denoiseEnd);
+                std::cout << "Time to denoise image: " << std::chrono::duration<float, std::milli>(denoiseEnd - denoiseStart).count() << " millisecond(s)" << std::endl;
+            }
+            data.photons = nullptr;
+            data.irradiance_cache = nullptr;
+            data.guide = nullptr;
+            data.restir = nullptr;
+            data.shadow_maps = nullptr;
+            {
+                PROFILE_SCOPE("write images");
+                screen.writeBitmapToFile(outputPath / "render.bmp");
+                if (writeAOVs) {
+                    writeAOVsToFile(screen, aovs, outputPath / "render.exr");
+                }
+                if (heatMaps) {
+                    writeHeatMapsToFile(aovs, outputPath / "heat.bmp");
+                }
             }
-            screen.writeBitmapToFile(outputPath / "render.bmp");
+            if (writeProfileFile) {
+                writeProfile(outputPath / "profile.json");
+            }
+        }
+        if (lastProgress) {
+            ImGui::Text("Last render: %.1f s, %.2f Mrays/s, %.0f samples/s", lastProgress->seconds, lastProgress->raysPerSecond() / 1e6, lastProgress->samplesPerSecond());
         }
         ImGui::Spacing();
         ImGui::Separator();
@@ -162,8 +323,11 @@ int main(int argc, char *argv[]) {
                 ImGui::Combo("Selected light", &selectedLight, optionsPointers.data(), static_cast<int>(optionsPointers.size()));
             }
             {
-                ImGui::DragFloat3("Light position", glm::value_ptr(scene.pointLights[selectedLight].position), 0.01F, -3.0F, 3.0F);
-                ImGui::ColorEdit3("Light color", glm::value_ptr(scene.pointLights[selectedLight].color));
+                const bool moved = ImGui::DragFloat3("Light position", glm::value_ptr(scene.pointLights[selectedLight].position), 0.01F, -3.0F, 3.0F);
+                const bool recolored = ImGui::ColorEdit3("Light color", glm::value_ptr(scene.pointLights[selectedLight].color));
+                if (moved || recolored) {
+                    pointLights = PointLightTree{&scene};
+                }
             }
         }
         ImGui::Spacing();
@@ -228,13 +392,50 @@ int main(int argc, char *argv[]) {
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         glPushAttrib(GL_ALL_ATTRIB_BITS);
-        renderOpenGL(scene, camera, selectedLight);
+        if (progressivePreview) {
+            // Frames are averaged until the camera moves or a setting changes
+            const glm::mat4 view = camera.viewMatrix();
+            if (previewSum.empty() || view != previewView || ImGui::IsAnyItemActive()) {
+                previewView = view;
+                previewFrames = 0;
+                previewSum.assign(WIDTH * HEIGHT, glm::vec3(0.0F));
+            }
+            // One camera path per pixel and frame with a single hemisphere sample per hit, so a frame takes a fraction of a second
+            // and the average over the frames converges to the indirect light of the render
+            ShadingData previewData = data;
+            previewData.samples = std::min(data.samples, 1);
+            // Jittered rays move with the seed of every frame, so their hits would never be reused
+            if (data.jitter) {
+                previewData.primary_hits = nullptr;
+            }
+            if (restirDirect) {
+                // The reservoirs of the last frame are reused even after the camera moved, where the surfaces still match
+                if (!previewReservoirs) {
+                    previewReservoirs.emplace(screen.resolution(), ReSTIRSettings{});
+                }
+                previewReservoirs->nextFrame();
+                previewData.restir = &*previewReservoirs;
+            }
+            previewData.shadow_maps = updateShadowMaps();
+            renderTile(scene, camera, bvh, previewData, seed + unsigned(previewFrames), Tile{glm::ivec2(0), screen.resolution()}, screen);
+            previewFrames++;
+            for (size_t y = 0; y < HEIGHT; y++) {
+                for (size_t x = 0; x < WIDTH; x++) {
+                    glm::vec3 &sum = previewSum[y * WIDTH + x];
+                    sum += screen.getPixel(x, y);
+                    screen.setPixel(x, y, sum / float(previewFrames));
+                }
+            }
+            screen.draw();
+        } else {
+            renderOpenGL(scene, camera, selectedLight);
+        }
         if (optDebugRay) {
             data.debug = true;
-            // We do not reuse the original rng to make the debug output consistent
-            std::default_random_engine rand;
-            rand.seed(seed);
-            (void) get_color(camera.position(), scene, bvh, data, rand, *optDebugRay);
+            // We create a new sampler every frame to make the debug output consistent
+            const std::unique_ptr<Sampler> sampler = makeSampler(data.sampler, seed);
+            PathSampler pathSampler{*sampler, glm::ivec2(0), 0};
+            (void) get_color(camera.position(), scene, bvh, data, pathSampler, *optDebugRay);
             data.debug = false;
         }
         glPopAttrib();
@@ -0,0 +1,63 @@
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include "mapped_file.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::filesystem::path &file) {
+#ifndef _WIN32
+    const int fd = open(file.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Could not open " + file.string());
+    }
+    length = size_t(info.st_size);
+    if (length > 0) {
+        void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Could not map " + file.string() + " into memory");
+        }
+        // Start reading ahead, pages are still only loaded when they are touched
+        madvise(mapping, length, MADV_WILLNEED);
+        mapped = static_cast<const char *>(mapping);
+    }
+    close(fd);
+#else
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream) {
+        throw std::runtime_error("Could not open " + file.string());
+    }
+    buffer.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    length = buffer.size();
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (mapped != nullptr) {
+        munmap(const_cast<char *>(mapped), length);
+    }
+#endif
+}
+
+const char *MappedFile::data() const {
+#ifndef _WIN32
+    return mapped;
+#else
+    return buffer.data();
+#endif
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+// Read-only view of a whole file, memory mapped where possible (read into memory on Windows)
+class MappedFile {
+public:
+    explicit MappedFile(const std::filesystem::path &file);
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    const char *data() const;
+    size_t size() const;
+
+private:
+    size_t length = 0;
+#ifndef _WIN32
+    const char *mapped = nullptr;
+#else
+    std::vector<char> buffer;
+#endif
+};
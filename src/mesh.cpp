@@ -8,10 +8,16 @@ DISABLE_WARNINGS_PUSH()
 #include <glm/gtc/matrix_inverse.hpp>
 #include <gsl-lite/gsl-lite.hpp>
 DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cctype>
 #include <iostream>
-#include <numeric>
 #include <stack>
+#include <stdexcept>
 #include "mesh.h"
+#include "obj_loader.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
 
 static glm::mat4 assimpMatrix(const aiMatrix4x4 &m) {
     glm::mat4 matrix;
@@ -42,44 +48,116 @@ static glm::vec3 assimpVec(const aiColor3D &c) {
     return glm::vec3(c.r, c.g, c.b);
 }
 
-static void centerAndScaleToUnitMesh(gsl::span<Mesh> meshes) {
-    std::vector<glm::vec3> positions;
-    for (const auto &mesh : meshes) {
-        std::transform(std::begin(mesh.vertices), std::end(mesh.vertices), std::back_inserter(positions), [](const Vertex &v) { return v.position; });
+// Mean of all vertex positions, summed in double precision so large meshes do not lose the small contributions
+static glm::vec3 meanPosition(gsl::span<const Mesh> meshes) {
+    double x = 0.0;
+    double y = 0.0;
+    double z = 0.0;
+    size_t count = 0;
+    for (const Mesh &mesh : meshes) {
+#ifdef USE_OPENMP
+#pragma omp parallel for reduction(+ : x, y, z)
+#endif
+        for (int64_t i = 0; i < int64_t(mesh.positions.size()); i++) {
+            const glm::vec3 &p = mesh.positions[size_t(i)];
+            x += double(p.x);
+            y += double(p.y);
+            z += double(p.z);
+        }
+        count += mesh.positions.size();
     }
-    const glm::vec3 center = std::accumulate(std::begin(positions), std::end(positions), glm::vec3(0.0F)) / static_cast<float>(positions.size());
+    return count == 0 ? glm::vec3(0.0F) : glm::vec3(float(x / double(count)), float(y / double(count)), float(z / double(count)));
+}
+
+static void centerAndScaleToUnitMesh(gsl::span<Mesh> meshes) {
+    const glm::vec3 center = meanPosition(gsl::span<const Mesh>(meshes.data(), meshes.size()));
     float maxD = 0.0F;
-    for (const glm::vec3 &p : positions) {
-        maxD = std::max(glm::length(p - center), maxD);
+    for (const Mesh &mesh : meshes) {
+#ifdef USE_OPENMP
+#pragma omp parallel for reduction(max : maxD)
+#endif
+        for (int64_t i = 0; i < int64_t(mesh.positions.size()); i++) {
+            maxD = std::max(glm::length(mesh.positions[size_t(i)] - center), maxD);
+        }
     }
-    /*// REQUIRES A MODERN COMPILER
-    const float maxD = std::transform_reduce(
-        std::begin(vertices), std::end(vertices),
-        0.0f,
-        [](float lhs, float rhs) { return std::max(lhs, rhs); },
-        [=](const Vertex& v) { return glm::length(v.pos - center); });*/
 
     for (Mesh &mesh : meshes) {
-        std::transform(std::begin(mesh.vertices), std::end(mesh.vertices), std::begin(mesh.vertices),
-            [=](Vertex v) {
-                v.position = (v.position - center) / maxD;
-                return v;
-            });
+        std::vector<glm::vec3> &positions = mesh.positions.edit();
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+        for (int64_t i = 0; i < int64_t(positions.size()); i++) {
+            glm::vec3 &p = positions[size_t(i)];
+            p = (p - center) / maxD;
+        }
     }
 }
 
-std::vector<Mesh> loadMesh(const std::filesystem::path& file, bool normalize) {
-    if (!std::filesystem::exists(file)) {
-        std::cerr << "File " << file << " does not exist." << std::endl;
-        throw std::exception();
+static void computeBounds(Mesh &mesh) {
+    float lowerX = FLT_MAX, lowerY = FLT_MAX, lowerZ = FLT_MAX;
+    float upperX = -FLT_MAX, upperY = -FLT_MAX, upperZ = -FLT_MAX;
+#ifdef USE_OPENMP
+#pragma omp parallel for reduction(min : lowerX, lowerY, lowerZ) reduction(max : upperX, upperY, upperZ)
+#endif
+    for (int64_t i = 0; i < int64_t(mesh.positions.size()); i++) {
+        const glm::vec3 &p = mesh.positions[size_t(i)];
+        lowerX = std::min(lowerX, p.x);
+        lowerY = std::min(lowerY, p.y);
+        lowerZ = std::min(lowerZ, p.z);
+        upperX = std::max(upperX, p.x);
+        upperY = std::max(upperY, p.y);
+        upperZ = std::max(upperZ, p.z);
+    }
+    mesh.lower = glm::vec3(lowerX, lowerY, lowerZ);
+    mesh.upper = glm::vec3(upperX, upperY, upperZ);
+}
+
+std::shared_ptr<const GeometryPool> poolGeometry(std::vector<Mesh> &meshes) {
+    const std::shared_ptr<GeometryPool> pool = std::make_shared<GeometryPool>();
+    size_t vertices = 0;
+    size_t triangles = 0;
+    for (const Mesh &mesh : meshes) {
+        pool->vertexOffsets.push_back(vertices);
+        pool->triangleOffsets.push_back(triangles);
+        vertices += mesh.positions.size();
+        triangles += mesh.triangles.size();
     }
+    pool->positions.resize(vertices);
+    pool->normals.resize(vertices);
+    pool->triangles.resize(triangles);
 
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int i = 0; i < int(meshes.size()); i++) {
+        const Mesh &mesh = meshes[size_t(i)];
+        std::copy(mesh.positions.begin(), mesh.positions.end(), pool->positions.begin() + std::ptrdiff_t(pool->vertexOffsets[size_t(i)]));
+        std::copy(mesh.normals.begin(), mesh.normals.end(), pool->normals.begin() + std::ptrdiff_t(pool->vertexOffsets[size_t(i)]));
+        std::copy(mesh.triangles.begin(), mesh.triangles.end(), pool->triangles.begin() + std::ptrdiff_t(pool->triangleOffsets[size_t(i)]));
+    }
+
+    for (size_t i = 0; i < meshes.size(); i++) {
+        Mesh &mesh = meshes[i];
+        const size_t vertexCount = mesh.positions.size();
+        mesh.positions = MeshArray<glm::vec3>::view(pool->positions.data() + pool->vertexOffsets[i], vertexCount, pool);
+        mesh.normals = MeshArray<glm::vec3>::view(pool->normals.data() + pool->vertexOffsets[i], vertexCount, pool);
+        mesh.triangles = MeshArray<Triangle>::view(pool->triangles.data() + pool->triangleOffsets[i], mesh.triangles.size(), pool);
+    }
+    return pool;
+}
+
+static bool isObjFile(const std::filesystem::path &file) {
+    std::string extension = file.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+    return extension == ".obj";
+}
+
+static std::vector<Mesh> loadWithAssimp(const std::filesystem::path &file) {
     Assimp::Importer importer;
     const aiScene* pAssimpScene = importer.ReadFile(file.string().c_str(), aiProcess_GenNormals | aiProcess_Triangulate);
 
     if (pAssimpScene == nullptr || pAssimpScene->mRootNode == nullptr || pAssimpScene->mFlags == AI_SCENE_FLAGS_INCOMPLETE) {
-        std::cerr << "Assimp failed to load mesh file " << file << std::endl;
-        throw std::exception();
+        throw std::runtime_error("Assimp failed to load mesh file " + file.string());
     }
 
     std::vector<Mesh> out;
@@ -102,6 +180,12 @@ std::vector<Mesh> loadMesh(const std::filesystem::path& file, bool normalize) {
 
             // Process triangles in sub mesh.
             Mesh mesh;
+            std::vector<Triangle> &triangles = mesh.triangles.edit();
+            std::vector<glm::vec3> &positions = mesh.positions.edit();
+            std::vector<glm::vec3> &normals = mesh.normals.edit();
+            triangles.reserve(pAssimpMesh->mNumFaces);
+            positions.reserve(pAssimpMesh->mNumVertices);
+            normals.reserve(pAssimpMesh->mNumVertices);
             for (unsigned int j = 0; j < pAssimpMesh->mNumFaces; j++) {
                 const aiFace &face = pAssimpMesh->mFaces[j];
                 if (face.mNumIndices != 3) {
@@ -109,14 +193,13 @@ std::vector<Mesh> loadMesh(const std::filesystem::path& file, bool normalize) {
                 }
 
                 const unsigned int *aiIndices = face.mIndices;
-                mesh.triangles.emplace_back(aiIndices[0], aiIndices[1], aiIndices[2]);
+                triangles.emplace_back(aiIndices[0], aiIndices[1], aiIndices[2]);
             }
 
             // Process vertices in sub mesh.
             for (unsigned int j = 0; j < pAssimpMesh->mNumVertices; j++) {
-                const glm::vec3 pos = matrix * glm::vec4(assimpVec(pAssimpMesh->mVertices[j]), 1.0F);
-                const glm::vec3 normal = normalMatrix * assimpVec(pAssimpMesh->mNormals[j]);
-                mesh.vertices.push_back(Vertex { pos, normal });
+                positions.push_back(matrix * glm::vec4(assimpVec(pAssimpMesh->mVertices[j]), 1.0F));
+                normals.push_back(normalMatrix * assimpVec(pAssimpMesh->mNormals[j]));
             }
 
             // Read the material, more info can be found here:
@@ -135,6 +218,7 @@ std::vector<Mesh> loadMesh(const std::filesystem::path& file, bool normalize) {
 
             mesh.material.kd = getMaterialColor(AI_MATKEY_COLOR_DIFFUSE);
             mesh.material.ks = getMaterialColor(AI_MATKEY_COLOR_SPECULAR);
+            mesh.material.ke = getMaterialColor(AI_MATKEY_COLOR_EMISSIVE);
             mesh.material.shininess = getMaterialFloat(AI_MATKEY_SHININESS);
             mesh.material.transparency = getMaterialFloat(AI_MATKEY_OPACITY);
             out.emplace_back(std::move(mesh));
@@ -146,17 +230,26 @@ std::vector<Mesh> loadMesh(const std::filesystem::path& file, bool normalize) {
     }
 
     importer.FreeScene();
+    return out;
+}
+
+std::vector<Mesh> loadMesh(const std::filesystem::path& file, bool normalize, bool pool) {
+    if (!std::filesystem::exists(file)) {
+        throw std::runtime_error("File " + file.string() + " does not exist.");
+    }
+
+    // OBJ exports can be gigabytes, Assimp reads them with a single thread and copies everything twice
+    std::vector<Mesh> out = isObjFile(file) ? loadObj(file) : loadWithAssimp(file);
 
     if (normalize) {
         centerAndScaleToUnitMesh(out);
     }
-
-    // Bounding box
     for (Mesh &mesh : out) {
-        for (const Vertex &vertex : mesh.vertices) {
-            mesh.lower = glm::min(mesh.lower, vertex.position);
-            mesh.upper = glm::max(mesh.upper, vertex.position);
-        }
+        computeBounds(mesh);
+    }
+    // The geometry does not change after loading, the meshes keep the pool alive
+    if (pool) {
+        poolGeometry(out);
     }
 
     return out;
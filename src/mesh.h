@@ -4,29 +4,85 @@
 DISABLE_WARNINGS_PUSH()
 #include <glm/vec3.hpp>
 DISABLE_WARNINGS_POP()
+#include <cfloat>
 #include <filesystem>
+#include <memory>
 #include <vector>
 
-struct Vertex {
-	glm::vec3 position;
-	glm::vec3 normal;
-};
-
 struct Material {
 	glm::vec3 kd{1.0F};
 	glm::vec3 ks{0.0F};
+	glm::vec3 ke{0.0F}; // Emitted radiance, meshes with a non-black ke are area lights
 	float shininess{1.0F};
 	float transparency{1.0F};
 };
 
 using Triangle = glm::uvec3;
 
+// Array of a mesh that either owns its elements or views memory owned by someone else, like a memory mapped scene file.
+// Reading never copies, edit() copies a view into an owned vector first.
+template <typename T>
+class MeshArray {
+public:
+	MeshArray() = default;
+	MeshArray(std::vector<T> elements): owned(std::move(elements)) {}
+
+	// The memory has to stay valid as long as owner is alive
+	static MeshArray view(const T *elements, size_t count, std::shared_ptr<const void> owner) {
+		MeshArray array;
+		array.viewed = elements;
+		array.count = count;
+		array.owner = std::move(owner);
+		return array;
+	}
+
+	const T *data() const { return viewed != nullptr ? viewed : owned.data(); }
+	size_t size() const { return viewed != nullptr ? count : owned.size(); }
+	bool empty() const { return size() == 0; }
+	const T &operator[](size_t i) const { return data()[i]; }
+	const T *begin() const { return data(); }
+	const T *end() const { return data() + size(); }
+
+	std::vector<T> &edit() {
+		if (viewed != nullptr) {
+			owned.assign(viewed, viewed + count);
+			viewed = nullptr;
+			count = 0;
+			owner.reset();
+		}
+		return owned;
+	}
+
+private:
+	std::vector<T> owned;
+	const T *viewed = nullptr;
+	size_t count = 0;
+	std::shared_ptr<const void> owner;
+};
+
+// Vertex attributes are stored as separate streams: intersection only reads positions, so normals do not take up cache lines
+// during traversal and are only fetched for the hit that is shaded
 struct Mesh {
-	std::vector<Vertex> vertices;
-	std::vector<Triangle> triangles;
+	MeshArray<glm::vec3> positions;
+	MeshArray<glm::vec3> normals; // One per position
+	MeshArray<Triangle> triangles;
 	Material material;
 	glm::vec3 lower{glm::vec3(FLT_MAX)};
 	glm::vec3 upper{glm::vec3(-FLT_MAX)};
 };
 
-[[nodiscard]] std::vector<Mesh> loadMesh(const std::filesystem::path &file, const bool normalize);
+// All vertices and triangles of a set of meshes in one array per attribute, the meshes view their own range of it
+struct GeometryPool {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> normals;
+	std::vector<Triangle> triangles; // Indices are relative to the first vertex of their mesh
+	std::vector<size_t> vertexOffsets; // First vertex of every mesh
+	std::vector<size_t> triangleOffsets; // First triangle of every mesh
+};
+
+// Moves the geometry of the meshes into one pool, which stays alive as long as any of the meshes views it
+std::shared_ptr<const GeometryPool> poolGeometry(std::vector<Mesh> &meshes);
+
+// Meshes of the file, with pool their geometry is moved into one GeometryPool by poolGeometry. That costs a copy of all of it, which
+// is wasted when the meshes are only written to a scene file.
+[[nodiscard]] std::vector<Mesh> loadMesh(const std::filesystem::path &file, const bool normalize, const bool pool = true);
@@ -0,0 +1,543 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "mapped_file.h"
+#include "obj_loader.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+// Files smaller than this are parsed by a single thread
+static constexpr size_t MIN_CHUNK_SIZE = 1 << 20;
+// More chunks than threads, so threads that got simple lines do not wait for the others
+static constexpr int CHUNKS_PER_THREAD = 4;
+
+// Marks a corner without a normal, negative indices that count back too far stay invalid instead of meaning none
+static constexpr int64_t NO_NORMAL = INT64_MIN;
+
+// Indices are 0 based once parsed
+struct ObjCorner {
+    int64_t position;
+    int64_t normal;
+};
+
+// An o, g or usemtl line, applies to the faces from face on
+struct ObjEvent {
+    size_t face;
+    bool object; // Otherwise a material
+    std::string name;
+};
+
+// Everything parsed from one range of lines
+struct ObjChunk {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<ObjCorner> corners;
+    std::vector<size_t> faces; // First corner of every face, followed by the number of corners
+    std::vector<ObjEvent> events;
+    std::vector<std::string> libraries;
+    // Corners with negative indices, which count back from the last vertex of this chunk and need its offset
+    std::vector<size_t> relativePositions;
+    std::vector<size_t> relativeNormals;
+};
+
+// Faces [faceBegin, faceEnd) of a chunk that belong to one mesh, written from vertex and triangle on
+struct ObjSegment {
+    size_t chunk;
+    size_t faceBegin;
+    size_t faceEnd;
+    size_t mesh;
+    size_t vertex = 0;
+    size_t triangle = 0;
+};
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static void skipSpaces(const char *&p, const char *end) {
+    while (p < end && isSpace(*p)) {
+        p++;
+    }
+}
+
+static std::string_view restOfLine(const char *p, const char *end) {
+    skipSpaces(p, end);
+    while (end > p && isSpace(end[-1])) {
+        end--;
+    }
+    return std::string_view(p, size_t(end - p));
+}
+
+[[noreturn]] static void malformedLine(const std::filesystem::path &file, const char *begin, const char *end) {
+    throw std::runtime_error("Malformed line in " + file.string() + ": " + std::string(restOfLine(begin, end)));
+}
+
+static double powerOfTen(int exponent) {
+    static constexpr double POWERS[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    if (exponent >= 0 && exponent <= 22) {
+        return POWERS[exponent];
+    }
+    return std::pow(10.0, double(exponent));
+}
+
+// Decimal numbers as written by exporters, from the first 19 significant digits in double precision, which is far more than a float keeps.
+// Anything else (inf, nan, hexadecimal) goes through strtof.
+static bool parseFloat(const char *&p, const char *end, float &value) {
+    skipSpaces(p, end);
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+        if (digits < 19) {
+            mantissa = mantissa * 10 + uint64_t(*p - '0');
+            digits += mantissa > 0 ? 1 : 0;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, any = true) {
+            if (digits < 19) {
+                mantissa = mantissa * 10 + uint64_t(*p - '0');
+                digits += mantissa > 0 ? 1 : 0;
+                exponent--;
+            }
+        }
+    }
+    if (!any) {
+        p = start;
+        const std::string text(restOfLine(p, end).substr(0, 64));
+        char *parsed;
+        value = std::strtof(text.c_str(), &parsed);
+        if (parsed == text.c_str()) {
+            return false;
+        }
+        p += parsed - text.c_str();
+        return true;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *exponentStart = p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = *p == '-';
+            p++;
+        }
+        if (p < end && *p >= '0' && *p <= '9') {
+            int e = 0;
+            for (; p < end && *p >= '0' && *p <= '9'; p++) {
+                e = std::min(e * 10 + (*p - '0'), 100000);
+            }
+            exponent += negativeExponent ? -e : e;
+        } else {
+            p = exponentStart;
+        }
+    }
+    // A zero mantissa stays zero, 0e400 would otherwise be 0 * inf
+    double result = double(mantissa);
+    if (mantissa != 0) {
+        result = exponent < 0 ? result / powerOfTen(-exponent) : result * powerOfTen(exponent);
+    }
+    value = float(negative ? -result : result);
+    return p == end || isSpace(*p) || *p == '/';
+}
+
+static bool parseIndex(const char *&p, const char *end, int64_t &index) {
+    bool negative = false;
+    if (p < end && *p == '-') {
+        negative = true;
+        p++;
+    }
+    if (p == end || *p < '0' || *p > '9') {
+        return false;
+    }
+    index = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        // Longer than any real index, and would overflow
+        const int digit = *p - '0';
+        if (index > (INT64_MAX - digit) / 10) {
+            return false;
+        }
+        index = index * 10 + digit;
+    }
+    index = negative ? -index : index;
+    return index != 0;
+}
+
+// Resolves a 1 based OBJ index, negative ones count back from the last vertex parsed so far
+static void resolveIndex(int64_t &index, size_t count, size_t corner, std::vector<size_t> &relative) {
+    if (index > 0) {
+        index--;
+    } else {
+        index += int64_t(count);
+        relative.push_back(corner);
+    }
+}
+
+static void parseFace(const std::filesystem::path &file, const char *lineBegin, const char *p, const char *end, ObjChunk &chunk) {
+    const size_t first = chunk.corners.size();
+    while (true) {
+        skipSpaces(p, end);
+        if (p == end) {
+            break;
+        }
+        // v, v/t, v//n or v/t/n
+        ObjCorner corner{0, NO_NORMAL};
+        if (!parseIndex(p, end, corner.position)) {
+            malformedLine(file, lineBegin, end);
+        }
+        const size_t index = chunk.corners.size();
+        resolveIndex(corner.position, chunk.positions.size(), index, chunk.relativePositions);
+        if (p < end && *p == '/') {
+            p++;
+            while (p < end && *p != '/' && !isSpace(*p)) {
+                p++;
+            }
+            if (p < end && *p == '/') {
+                p++;
+                if (!parseIndex(p, end, corner.normal)) {
+                    malformedLine(file, lineBegin, end);
+                }
+                resolveIndex(corner.normal, chunk.normals.size(), index, chunk.relativeNormals);
+            }
+        }
+        if (p < end && !isSpace(*p)) {
+            malformedLine(file, lineBegin, end);
+        }
+        chunk.corners.push_back(corner);
+    }
+    chunk.faces.push_back(first);
+    chunk.faces.push_back(chunk.corners.size() - first);
+}
+
+static bool startsWith(const char *p, const char *end, std::string_view keyword) {
+    return size_t(end - p) > keyword.size() && std::string_view(p, keyword.size()) == keyword && isSpace(p[keyword.size()]);
+}
+
+static void parseChunk(const std::filesystem::path &file, const char *begin, const char *end, ObjChunk &chunk) {
+    const char *line = begin;
+    while (line < end) {
+        const char *lineEnd = static_cast<const char *>(std::memchr(line, '\n', size_t(end - line)));
+        lineEnd = lineEnd == nullptr ? end : lineEnd;
+        const char *p = line;
+        skipSpaces(p, lineEnd);
+
+        if (startsWith(p, lineEnd, "v") || startsWith(p, lineEnd, "vn")) {
+            const bool normal = p[1] == 'n';
+            p += normal ? 2 : 1;
+            glm::vec3 v;
+            if (!parseFloat(p, lineEnd, v.x) || !parseFloat(p, lineEnd, v.y) || !parseFloat(p, lineEnd, v.z)) {
+                malformedLine(file, line, lineEnd);
+            }
+            (normal ? chunk.normals : chunk.positions).push_back(v);
+        } else if (startsWith(p, lineEnd, "f")) {
+            parseFace(file, line, p + 1, lineEnd, chunk);
+        } else if (startsWith(p, lineEnd, "o") || startsWith(p, lineEnd, "g")) {
+            chunk.events.push_back(ObjEvent{chunk.faces.size() / 2, true, std::string(restOfLine(p + 1, lineEnd))});
+        } else if (startsWith(p, lineEnd, "usemtl")) {
+            chunk.events.push_back(ObjEvent{chunk.faces.size() / 2, false, std::string(restOfLine(p + 6, lineEnd))});
+        } else if (startsWith(p, lineEnd, "mtllib")) {
+            chunk.libraries.emplace_back(restOfLine(p + 6, lineEnd));
+        }
+        line = lineEnd + 1;
+    }
+}
+
+// Materials of an MTL file by name, with the defaults of the Assimp importer for anything not given
+static void loadMaterials(const std::filesystem::path &file, const Material &defaults, std::unordered_map<std::string, Material> &materials) {
+    std::ifstream stream(file);
+    if (!stream) {
+        std::cerr << "Material library " << file << " does not exist, using the default material." << std::endl;
+        return;
+    }
+    Material *material = nullptr;
+    std::string line;
+    while (std::getline(stream, line)) {
+        const char *p = line.data();
+        const char *end = p + line.size();
+        skipSpaces(p, end);
+        auto color = [&](size_t keyword, glm::vec3 &out) {
+            p += keyword;
+            glm::vec3 c;
+            if (!parseFloat(p, end, c.x)) {
+                malformedLine(file, line.data(), end);
+            }
+            // A single value is grey
+            c.y = c.z = c.x;
+            if (parseFloat(p, end, c.y) && !parseFloat(p, end, c.z)) {
+                malformedLine(file, line.data(), end);
+            }
+            out = c;
+        };
+        auto scalar = [&](size_t keyword, float &out) {
+            p += keyword;
+            if (!parseFloat(p, end, out)) {
+                malformedLine(file, line.data(), end);
+            }
+        };
+
+        if (startsWith(p, end, "newmtl")) {
+            material = &materials.insert_or_assign(std::string(restOfLine(p + 6, end)), defaults).first->second;
+        } else if (material == nullptr) {
+            continue;
+        } else if (startsWith(p, end, "Kd")) {
+            color(2, material->kd);
+        } else if (startsWith(p, end, "Ks")) {
+            color(2, material->ks);
+        } else if (startsWith(p, end, "Ke")) {
+            color(2, material->ke);
+        } else if (startsWith(p, end, "Ns")) {
+            scalar(2, material->shininess);
+        } else if (startsWith(p, end, "d")) {
+            scalar(1, material->transparency);
+        } else if (startsWith(p, end, "Tr")) {
+            scalar(2, material->transparency);
+            material->transparency = 1.0F - material->transparency;
+        }
+    }
+}
+
+std::vector<Mesh> loadObj(const std::filesystem::path &file) {
+    const MappedFile mapped{file};
+    const char *data = mapped.data();
+    const size_t size = mapped.size();
+
+    // Chunks end after a line break, so every line is parsed by exactly one of them
+    int threads = 1;
+#ifdef USE_OPENMP
+    threads = omp_get_max_threads();
+#endif
+    const size_t chunkCount = std::max<size_t>(1, std::min(size / MIN_CHUNK_SIZE, size_t(threads * CHUNKS_PER_THREAD)));
+    std::vector<size_t> bounds{0};
+    for (size_t i = 1; i < chunkCount; i++) {
+        size_t split = std::max(bounds.back(), size * i / chunkCount);
+        const void *lineEnd = std::memchr(data + split, '\n', size - split);
+        split = lineEnd == nullptr ? size : size_t(static_cast<const char *>(lineEnd) - data) + 1;
+        bounds.push_back(split);
+    }
+    bounds.push_back(size);
+
+    // Exceptions must not leave the parallel loop, the first malformed line of the file is reported after it
+    std::vector<ObjChunk> chunks(chunkCount);
+    std::vector<std::exception_ptr> errors(chunkCount);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int i = 0; i < int(chunkCount); i++) {
+        try {
+            parseChunk(file, data + bounds[size_t(i)], data + bounds[size_t(i) + 1], chunks[size_t(i)]);
+        } catch (...) {
+            errors[size_t(i)] = std::current_exception();
+        }
+    }
+    for (const std::exception_ptr &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Vertices of all chunks in one array, chunks only know the vertices before them through the offsets
+    std::vector<size_t> positionOffsets(chunkCount + 1, 0);
+    std::vector<size_t> normalOffsets(chunkCount + 1, 0);
+    for (size_t i = 0; i < chunkCount; i++) {
+        positionOffsets[i + 1] = positionOffsets[i] + chunks[i].positions.size();
+        normalOffsets[i + 1] = normalOffsets[i] + chunks[i].normals.size();
+    }
+    std::vector<glm::vec3> positions(positionOffsets.back());
+    std::vector<glm::vec3> normals(normalOffsets.back());
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int i = 0; i < int(chunkCount); i++) {
+        ObjChunk &chunk = chunks[size_t(i)];
+        std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + std::ptrdiff_t(positionOffsets[size_t(i)]));
+        std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + std::ptrdiff_t(normalOffsets[size_t(i)]));
+        std::vector<glm::vec3>().swap(chunk.positions);
+        std::vector<glm::vec3>().swap(chunk.normals);
+        for (const size_t corner : chunk.relativePositions) {
+            chunk.corners[corner].position += int64_t(positionOffsets[size_t(i)]);
+        }
+        for (const size_t corner : chunk.relativeNormals) {
+            chunk.corners[corner].normal += int64_t(normalOffsets[size_t(i)]);
+        }
+    }
+
+    const Material defaults{glm::vec3(0.6F), glm::vec3(0.0F), glm::vec3(0.0F), 0.0F, 1.0F};
+    std::unordered_map<std::string, Material> materials;
+    for (const ObjChunk &chunk : chunks) {
+        for (const std::string &library : chunk.libraries) {
+            loadMaterials(file.parent_path() / library, defaults, materials);
+        }
+    }
+
+    // Split the faces into meshes by object and material, like the Assimp importer
+    struct ObjObject {
+        std::string name;
+        std::vector<size_t> meshes;
+    };
+    std::vector<ObjObject> objects;
+    std::vector<std::string> meshMaterials;
+    std::vector<ObjSegment> segments;
+    size_t object = size_t(-1);
+    size_t mesh = size_t(-1);
+    std::string material;
+    for (size_t c = 0; c < chunkCount; c++) {
+        const ObjChunk &chunk = chunks[c];
+        const size_t faceCount = chunk.faces.size() / 2;
+        size_t face = 0;
+        for (size_t e = 0; e <= chunk.events.size(); e++) {
+            const size_t next = e < chunk.events.size() ? chunk.events[e].face : faceCount;
+            if (next > face) {
+                if (object == size_t(-1)) {
+                    object = objects.size();
+                    objects.push_back(ObjObject{"defaultobject", {}});
+                }
+                if (mesh == size_t(-1)) {
+                    mesh = meshMaterials.size();
+                    meshMaterials.push_back(material);
+                    objects[object].meshes.push_back(mesh);
+                }
+                segments.push_back(ObjSegment{c, face, next, mesh});
+                face = next;
+            }
+            if (e == chunk.events.size()) {
+                break;
+            }
+            const ObjEvent &event = chunk.events[e];
+            if (event.object) {
+                const auto found = std::find_if(objects.begin(), objects.end(), [&](const ObjObject &o) { return o.name == event.name; });
+                object = size_t(found - objects.begin());
+                if (found == objects.end()) {
+                    objects.push_back(ObjObject{event.name, {}});
+                }
+                mesh = size_t(-1);
+            } else if (event.name != material) {
+                material = event.name;
+                mesh = size_t(-1);
+            }
+        }
+    }
+
+    // Count the vertices and triangles of every segment to know where it writes them
+    const size_t meshCount = meshMaterials.size();
+    std::vector<size_t> segmentVertices(segments.size());
+    std::vector<size_t> segmentTriangles(segments.size());
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (int s = 0; s < int(segments.size()); s++) {
+        const ObjSegment &segment = segments[size_t(s)];
+        const std::vector<size_t> &faces = chunks[segment.chunk].faces;
+        size_t vertices = 0;
+        size_t triangles = 0;
+        for (size_t f = segment.faceBegin; f < segment.faceEnd; f++) {
+            const size_t corners = faces[2 * f + 1];
+            if (corners >= 3) {
+                vertices += corners;
+                triangles += corners - 2;
+            }
+        }
+        segmentVertices[size_t(s)] = vertices;
+        segmentTriangles[size_t(s)] = triangles;
+    }
+    std::vector<Mesh> meshes(meshCount);
+    std::vector<size_t> meshVertices(meshCount, 0);
+    std::vector<size_t> meshTriangles(meshCount, 0);
+    for (size_t s = 0; s < segments.size(); s++) {
+        ObjSegment &segment = segments[s];
+        segment.vertex = meshVertices[segment.mesh];
+        segment.triangle = meshTriangles[segment.mesh];
+        meshVertices[segment.mesh] += segmentVertices[s];
+        meshTriangles[segment.mesh] += segmentTriangles[s];
+    }
+    for (size_t m = 0; m < meshCount; m++) {
+        if (meshVertices[m] > size_t(UINT32_MAX)) {
+            throw std::runtime_error("A mesh in " + file.string() + " has more than 2^32 vertices");
+        }
+        meshes[m].positions.edit().resize(meshVertices[m]);
+        meshes[m].normals.edit().resize(meshVertices[m]);
+        meshes[m].triangles.edit().resize(meshTriangles[m]);
+        const auto found = materials.find(meshMaterials[m]);
+        meshes[m].material = found != materials.end() ? found->second : defaults;
+    }
+
+    bool outOfRange = false;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(|| : outOfRange)
+#endif
+    for (int s = 0; s < int(segments.size()); s++) {
+        const ObjSegment &segment = segments[size_t(s)];
+        const ObjChunk &chunk = chunks[segment.chunk];
+        // Segments of a mesh write to separate ranges, and edit() does not reallocate an owned array
+        glm::vec3 *meshPositions = meshes[segment.mesh].positions.edit().data();
+        glm::vec3 *meshNormals = meshes[segment.mesh].normals.edit().data();
+        Triangle *triangles = meshes[segment.mesh].triangles.edit().data();
+        size_t vertex = segment.vertex;
+        size_t triangle = segment.triangle;
+        for (size_t f = segment.faceBegin; f < segment.faceEnd; f++) {
+            const ObjCorner *corners = chunk.corners.data() + chunk.faces[2 * f];
+            const size_t cornerCount = chunk.faces[2 * f + 1];
+            if (cornerCount < 3) {
+                continue;
+            }
+            bool valid = true;
+            for (size_t i = 0; i < cornerCount; i++) {
+                valid = valid && corners[i].position >= 0 && size_t(corners[i].position) < positions.size() &&
+                        (corners[i].normal == NO_NORMAL || (corners[i].normal >= 0 && size_t(corners[i].normal) < normals.size()));
+            }
+            if (!valid) {
+                outOfRange = true;
+                break;
+            }
+            const glm::vec3 &a = positions[size_t(corners[0].position)];
+            // Degenerate faces get a zero normal rather than NaN
+            const glm::vec3 perpendicular = glm::cross(positions[size_t(corners[1].position)] - a, positions[size_t(corners[2].position)] - a);
+            const float length = glm::length(perpendicular);
+            const glm::vec3 faceNormal = length > 0.0F ? perpendicular / length : glm::vec3(0.0F);
+            for (size_t i = 0; i < cornerCount; i++) {
+                meshPositions[vertex + i] = positions[size_t(corners[i].position)];
+                meshNormals[vertex + i] = corners[i].normal != NO_NORMAL ? normals[size_t(corners[i].normal)] : faceNormal;
+            }
+            for (size_t i = 1; i + 1 < cornerCount; i++) {
+                triangles[triangle++] = Triangle(uint32_t(vertex), uint32_t(vertex + i), uint32_t(vertex + i + 1));
+            }
+            vertex += cornerCount;
+        }
+    }
+    if (outOfRange) {
+        throw std::runtime_error("A face in " + file.string() + " refers to a vertex that does not exist");
+    }
+
+    // The Assimp importer makes a node per object, which loadMesh visits last to first
+    std::vector<Mesh> out;
+    out.reserve(meshCount);
+    for (auto it = objects.rbegin(); it != objects.rend(); ++it) {
+        for (const size_t m : it->meshes) {
+            if (!meshes[m].triangles.empty()) {
+                out.push_back(std::move(meshes[m]));
+            }
+        }
+    }
+    return out;
+}
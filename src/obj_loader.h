@@ -0,0 +1,12 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+#include "mesh.h"
+
+// Wavefront OBJ loader for large files, used by loadMesh instead of Assimp for .obj files.
+// The file is memory mapped and split into chunks at line ends, which are parsed in parallel. The vertices of every mesh are then
+// written straight into preallocated buffers. Meshes come out like from the Assimp importer: one per object (o or g) and material,
+// in the same order, with one vertex per face corner and polygons split into a fan of triangles (so they should be convex).
+// Corners without a normal get the normal of their face. Texture coordinates, lines and points are skipped.
+[[nodiscard]] std::vector<Mesh> loadObj(const std::filesystem::path &file);
@@ -0,0 +1,249 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "path_guiding.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+static constexpr float PI = 3.14159265358979323846F;
+// Directional cells are at least 2^-20 wide
+static constexpr int MAX_DIRECTION_DEPTH = 20;
+static constexpr float ONE_MINUS_EPSILON = 1.0F - FLT_EPSILON / 2.0F;
+
+// Cylindrical mapping of the sphere to the square, equal areas on both
+static glm::vec2 toSquare(const glm::vec3 &direction) {
+    const float cosTheta = glm::clamp(direction.z, -1.0F, 1.0F);
+    float phi = std::atan2(direction.y, direction.x) / (2.0F * PI);
+    if (phi < 0.0F) {
+        phi += 1.0F;
+    }
+    return glm::min(glm::vec2((cosTheta + 1.0F) / 2.0F, phi), glm::vec2(ONE_MINUS_EPSILON));
+}
+
+static glm::vec3 toDirection(const glm::vec2 &point) {
+    const float cosTheta = 2.0F * point.x - 1.0F;
+    const float sinTheta = std::sqrt(std::max(1.0F - cosTheta * cosTheta, 0.0F));
+    const float phi = 2.0F * PI * point.y;
+    return glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+// Quadrant of the point, which is then mapped to the square of the quadrant
+static size_t quadrant(glm::vec2 &point) {
+    const size_t x = point.x >= 0.5F ? 1 : 0;
+    const size_t y = point.y >= 0.5F ? 1 : 0;
+    point = glm::min(2.0F * point - glm::vec2(float(x), float(y)), glm::vec2(ONE_MINUS_EPSILON));
+    return x + 2 * y;
+}
+
+// Reuses a uniform number after it picked between two options with probability p for the first
+static float pick(float &u, const float p) {
+    if (u < p) {
+        u = std::min(u / p, ONE_MINUS_EPSILON);
+        return 0.0F;
+    }
+    u = std::min((u - p) / (1.0F - p), ONE_MINUS_EPSILON);
+    return 1.0F;
+}
+
+PathGuide::DirectionTree::DirectionTree(): nodes(1) {
+    // Nothing
+}
+
+void PathGuide::DirectionTree::record(glm::vec2 point, const float value) {
+    uint32_t index = 0;
+    while (true) {
+        Node &node = nodes[index];
+        const size_t q = quadrant(point);
+#ifdef USE_OPENMP
+#pragma omp atomic
+#endif
+        node.sums[q] += value;
+        if (node.children[q] == 0) {
+            return;
+        }
+        index = node.children[q];
+    }
+}
+
+glm::vec2 PathGuide::DirectionTree::sample(glm::vec2 u) const {
+    glm::vec2 offset = glm::vec2(0.0F);
+    float scale = 1.0F;
+    uint32_t index = 0;
+    while (true) {
+        const Node &node = nodes[index];
+        const float total = node.sums[0] + node.sums[1] + node.sums[2] + node.sums[3];
+        if (total <= 0.0F) {
+            return offset + scale * u;
+        }
+        // The column first, then the quadrant within the column
+        const float x = pick(u.x, (node.sums[0] + node.sums[2]) / total);
+        const size_t columnIndex = size_t(x);
+        const float column = node.sums[columnIndex] + node.sums[columnIndex + 2];
+        const float y = pick(u.y, column > 0.0F ? node.sums[columnIndex] / column : 0.5F);
+        scale /= 2.0F;
+        offset += scale * glm::vec2(x, y);
+        const uint32_t child = node.children[columnIndex + 2 * size_t(y)];
+        if (child == 0) {
+            return offset + scale * u;
+        }
+        index = child;
+    }
+}
+
+float PathGuide::DirectionTree::pdf(glm::vec2 point) const {
+    float pdf = 1.0F;
+    uint32_t index = 0;
+    while (true) {
+        const Node &node = nodes[index];
+        const float total = node.sums[0] + node.sums[1] + node.sums[2] + node.sums[3];
+        if (total <= 0.0F) {
+            return pdf;
+        }
+        const size_t q = quadrant(point);
+        pdf *= 4.0F * node.sums[q] / total;
+        if (node.children[q] == 0 || pdf <= 0.0F) {
+            return pdf;
+        }
+        index = node.children[q];
+    }
+}
+
+PathGuide::DirectionTree PathGuide::DirectionTree::refined(const float threshold) const {
+    const Node &root = nodes[0];
+    const float total = root.sums[0] + root.sums[1] + root.sums[2] + root.sums[3];
+    DirectionTree out;
+    if (total <= 0.0F) {
+        // Nothing was learned here, keep the cells
+        out.nodes = nodes;
+        for (Node &node : out.nodes) {
+            node.sums.fill(0.0F);
+        }
+        return out;
+    }
+    refine(root, total, threshold, 1, out, 0);
+    return out;
+}
+
+void PathGuide::DirectionTree::refine(const Node &node, const float total, const float threshold, const int depth, DirectionTree &out, const uint32_t index) const {
+    for (size_t q = 0; q < 4; q++) {
+        if (node.sums[q] / total <= threshold || depth >= MAX_DIRECTION_DEPTH) {
+            continue;
+        }
+        // A cell without children that holds much energy is split as often as needed at once, as if the energy was spread evenly
+        Node child;
+        if (node.children[q] != 0) {
+            child = nodes[node.children[q]];
+        } else {
+            child.sums.fill(node.sums[q] / 4.0F);
+        }
+        const uint32_t childIndex = uint32_t(out.nodes.size());
+        out.nodes.emplace_back();
+        out.nodes[index].children[q] = childIndex;
+        refine(child, total, threshold, depth + 1, out, childIndex);
+    }
+}
+
+PathGuide::PathGuide(const Scene &scene, const GuidingSettings &settings): guideSettings(settings), lower(FLT_MAX), upper(-FLT_MAX) {
+    for (const Mesh &mesh : scene.meshes) {
+        for (const glm::vec3 &position : mesh.positions) {
+            lower = glm::min(lower, position);
+            upper = glm::max(upper, position);
+        }
+    }
+    if (lower.x > upper.x) {
+        lower = glm::vec3(0.0F);
+        upper = glm::vec3(0.0F);
+    }
+    // Points on the bounding box itself are inside
+    const glm::vec3 margin = glm::vec3(0.01F * glm::length(upper - lower) + FLT_MIN);
+    lower -= margin;
+    upper += margin;
+    nodes.push_back(SpatialNode{0, {0, 0}, DirectionTree(), DirectionTree(), 0.0F});
+}
+
+const GuidingSettings &PathGuide::settings() const {
+    return guideSettings;
+}
+
+size_t PathGuide::leaf(const glm::vec3 &position) const {
+    glm::vec3 boxLower = lower;
+    glm::vec3 boxUpper = upper;
+    size_t index = 0;
+    while (nodes[index].children[0] != 0) {
+        const SpatialNode &node = nodes[index];
+        const float middle = (boxLower[node.axis] + boxUpper[node.axis]) / 2.0F;
+        if (position[node.axis] < middle) {
+            boxUpper[node.axis] = middle;
+            index = node.children[0];
+        } else {
+            boxLower[node.axis] = middle;
+            index = node.children[1];
+        }
+    }
+    return index;
+}
+
+glm::vec3 PathGuide::sample(size_t leaf, const glm::vec2 &u) const {
+    return toDirection(nodes[leaf].sampling.sample(u));
+}
+
+float PathGuide::pdf(size_t leaf, const glm::vec3 &direction) const {
+    return nodes[leaf].sampling.pdf(toSquare(direction)) / (4.0F * PI);
+}
+
+void PathGuide::record(size_t leaf, const glm::vec3 &direction, const float value) {
+    if (!(value > 0.0F) || !std::isfinite(value)) {
+        return;
+    }
+    SpatialNode &node = nodes[leaf];
+    node.building.record(toSquare(direction), value);
+#ifdef USE_OPENMP
+#pragma omp atomic
+#endif
+    node.samples += 1.0F;
+}
+
+void PathGuide::split(const uint32_t node, const float threshold) {
+    // Both halves start from the directions learned for the whole box
+    SpatialNode child = nodes[node];
+    child.axis = (child.axis + 1) % 3;
+    child.samples /= 2.0F;
+    const uint32_t first = uint32_t(nodes.size());
+    nodes[node].children = {first, first + 1};
+    nodes[node].sampling = DirectionTree();
+    nodes[node].building = DirectionTree();
+    nodes.push_back(child);
+    nodes.push_back(child);
+    for (const uint32_t c : {first, first + 1}) {
+        if (nodes[c].samples > threshold) {
+            split(c, threshold);
+        }
+    }
+}
+
+void PathGuide::refine() {
+    // Later passes have more samples, so leaves need more of them before they split
+    const float threshold = guideSettings.spatialThreshold * std::sqrt(std::pow(2.0F, float(iteration)));
+    const size_t count = nodes.size();
+    for (size_t i = 0; i < count; i++) {
+        if (nodes[i].children[0] == 0 && nodes[i].samples > threshold) {
+            split(uint32_t(i), threshold);
+        }
+    }
+
+    for (SpatialNode &node : nodes) {
+        if (node.children[0] != 0) {
+            continue;
+        }
+        node.sampling = std::move(node.building);
+        node.building = node.sampling.refined(guideSettings.energyThreshold);
+        node.samples = 0.0F;
+    }
+    iteration++;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "scene.h"
+
+struct GuidingSettings {
+    int iterations = 4; // Training passes before the final render, every pass has twice the samples of the previous one
+    float bsdfFraction = 0.5F; // Fraction of the directions still sampled from the BSDF, so no light is missed completely
+    float spatialThreshold = 12000.0F; // A spatial leaf is split after c * sqrt(2^iteration) recorded samples
+    float energyThreshold = 0.01F; // A directional cell is split if it holds more than this fraction of the energy
+};
+
+// Incident light learned from the paths of earlier passes, as in "Practical Path Guiding for Efficient Light-Transport
+// Simulation" (Müller et al. 2017). A binary tree over the scene holds a quadtree over the sphere of directions in every
+// leaf. Each training pass records into one set of quadtrees while sampling from the one learned by the previous pass,
+// refine() then swaps them and adapts both trees to where the samples and the energy went.
+class PathGuide {
+public:
+    PathGuide(const Scene &scene, const GuidingSettings &settings);
+
+    const GuidingSettings &settings() const;
+
+    // Spatial leaf that contains the point, the other functions take it so the tree is only searched once per vertex
+    size_t leaf(const glm::vec3 &position) const;
+
+    glm::vec3 sample(size_t leaf, const glm::vec2 &u) const;
+
+    float pdf(size_t leaf, const glm::vec3 &direction) const; // Per unit solid angle
+
+    // Adds a radiance estimate (incident radiance divided by the density of its direction). Can be called from many threads.
+    void record(size_t leaf, const glm::vec3 &direction, float value);
+
+    // Ends a training pass: the recorded distribution is sampled from now on and recording starts over
+    void refine();
+
+private:
+    // Quadtree over the square [0, 1)^2 that the sphere is mapped to (cos theta, phi), which preserves area
+    class DirectionTree {
+    public:
+        DirectionTree();
+
+        void record(glm::vec2 point, float value);
+        glm::vec2 sample(glm::vec2 u) const;
+        float pdf(glm::vec2 point) const; // Over the square
+
+        // Same tree with cells split where they hold much energy and merged where they do not, without any energy
+        DirectionTree refined(float threshold) const;
+
+    private:
+        struct Node {
+            std::array<float, 4> sums{}; // Energy per quadrant: x, then y
+            std::array<uint32_t, 4> children{}; // 0 for a quadrant without children, the root is never a child
+        };
+
+        void refine(const Node &node, float total, float threshold, int depth, DirectionTree &out, uint32_t index) const;
+
+        std::vector<Node> nodes;
+    };
+
+    struct SpatialNode {
+        int axis; // The box of the node is split in the middle of this axis
+        std::array<uint32_t, 2> children; // 0 for a leaf
+        DirectionTree sampling;
+        DirectionTree building;
+        float samples; // Recorded in the current pass
+    };
+
+    void split(uint32_t node, float threshold);
+
+    GuidingSettings guideSettings;
+    glm::vec3 lower;
+    glm::vec3 upper;
+    std::vector<SpatialNode> nodes;
+    int iteration = 0;
+};
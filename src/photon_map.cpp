@@ -0,0 +1,248 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include "bsdf.h"
+#include "photon_map.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+static constexpr float PI = 3.14159265358979323846F;
+static constexpr float OFFSET = 0.01F;
+static constexpr size_t NO_MESH = SIZE_MAX;
+// Ranges with fewer photons are built by a single thread
+static constexpr size_t PARALLEL_BUILD_SIZE = 1 << 14;
+// Photons on surfaces that face a different way do not count, so light does not leak around corners
+static constexpr float NORMAL_THRESHOLD = 0.5F;
+
+static float luminance(const glm::vec3 &color) {
+    return glm::dot(color, glm::vec3(0.2126F, 0.7152F, 0.0722F));
+}
+
+static float maxComponent(const glm::vec3 &color) {
+    return std::max(color.x, std::max(color.y, color.z));
+}
+
+static glm::vec3 uniformSphere(const glm::vec2 &u) {
+    const float z = 1.0F - 2.0F * u.x;
+    const float r = std::sqrt(std::max(1.0F - z * z, 0.0F));
+    const float phi = 2.0F * PI * u.y;
+    return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// Scale that limits light of a point light to 1 per channel, like shader_lambert clamps it
+static glm::vec3 clampFactor(const glm::vec3 &light) {
+    return glm::vec3(light.x > 1.0F ? 1.0F / light.x : 1.0F, light.y > 1.0F ? 1.0F / light.y : 1.0F, light.z > 1.0F ? 1.0F / light.z : 1.0F);
+}
+
+// Cosine weighted direction around the normal
+static glm::vec3 cosineDirection(const glm::vec2 &u, const glm::vec3 &normal, const glm::vec3 &incoming) {
+    return BSDF{Material{}, normal, -incoming}.sample(u).direction;
+}
+
+PhotonMap::PhotonMap(const Scene &scene, const BoundingVolumeHierarchy &bvh, const AreaLights &lights, const std::vector<std::vector<std::tuple<glm::vec3, glm::vec3>>> &transforms, const PhotonSettings &settings, SamplerType samplerType, uint32_t seed) {
+    // Lights are picked in proportion to their power, the area lights are the last entry
+    std::vector<float> cdf;
+    float total = 0.0F;
+    for (const PointLight &light : scene.pointLights) {
+        total += 4.0F * PI * std::max(luminance(light.color), 0.0F);
+        cdf.push_back(total);
+    }
+    total += lights.empty() ? 0.0F : lights.power();
+    cdf.push_back(total);
+
+    const std::unique_ptr<Sampler> sampler = makeSampler(samplerType, seed);
+    const int photons = int(settings.photons);
+    float radius = settings.radius;
+    for (int pass = 0; pass < settings.passes; pass++) {
+        Pass &map = maps.emplace_back();
+        map.radius = radius;
+        // r_{i+1}^2 = r_i^2 * (i + alpha) / (i + 1) with i counted from 1
+        radius *= std::sqrt((float(pass + 1) + settings.alpha) / float(pass + 2));
+        if (total <= 0.0F) {
+            continue;
+        }
+
+        // Every path stores its own photons, so the map does not depend on the number of threads
+        std::vector<std::vector<Photon>> paths(settings.photons);
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic, 256)
+#endif
+        for (int i = 0; i < photons; i++) {
+            PathSampler pathSampler{*sampler, glm::ivec2(pass, -1), uint32_t(i)};
+            const glm::vec2 u = pathSampler.next2D();
+            const size_t light = std::min(size_t(std::upper_bound(cdf.begin(), cdf.end(), u.x * total) - cdf.begin()), cdf.size() - 1);
+            const float lightPdf = (cdf[light] - (light == 0 ? 0.0F : cdf[light - 1])) / total;
+
+            glm::vec3 origin;
+            glm::vec3 direction;
+            glm::vec3 power;
+            const PointLight *pointLight = nullptr;
+            if (light < scene.pointLights.size()) {
+                pointLight = &scene.pointLights[light];
+                origin = pointLight->position;
+                direction = uniformSphere(pathSampler.next2D());
+                power = 4.0F * PI * pointLight->color / (lightPdf * float(photons));
+            } else {
+                const glm::vec2 pick = pathSampler.next2D();
+                const glm::vec2 point = pathSampler.next2D();
+                const LightSample sample = lights.sample(pick, point);
+                // Either side of the light, cosine weighted
+                const glm::vec3 normal = u.y < 0.5F ? sample.normal : -sample.normal;
+                origin = sample.position;
+                direction = cosineDirection(pathSampler.next2D(), normal, -normal);
+                power = 2.0F * PI * sample.emission / (sample.pdf * lightPdf * float(photons));
+            }
+
+            // Mesh the photon was last reflected by, none while it comes straight from the light
+            size_t from = NO_MESH;
+            for (int bounce = 0; bounce <= settings.bounces; bounce++) {
+                Ray ray = Ray{origin + direction * OFFSET, direction};
+                HitInfo hitInfo;
+                if (!bvh.intersect(ray, hitInfo)) {
+                    break;
+                }
+                // Surfaces are only lit on the side their normal faces, like in the shaders and hemisphere samples of get_color
+                const float cosTheta = -glm::dot(direction, hitInfo.normal);
+                if (cosTheta <= 0.0F) {
+                    break;
+                }
+                const glm::vec3 position = ray.origin + ray.direction * ray.t;
+                const Material &material = hitInfo.material;
+
+                // At the first hit the light is reflected with kd like direct light, after that with the white Lambert lobe
+                // and the transform of the hemisphere sample that would find it. Mirror rays are not transformed.
+                glm::vec3 albedo = glm::vec3(1.0F);
+                glm::vec3 diffusePower = from != NO_MESH ? power * std::get<0>(transforms[from][hitInfo.meshIdx]) : power;
+                // Mirrors reflect ks / PI of the light they see, they do not show point lights
+                float specular = maxComponent(material.ks) / PI;
+                if (bounce == 0) {
+                    albedo = material.kd;
+                    if (pointLight != nullptr) {
+                        // Point lights have no falloff in the renderer and are clamped per light
+                        diffusePower *= ray.t * ray.t * clampFactor(material.kd * pointLight->color * cosTheta);
+                        specular = 0.0F;
+                    }
+                } else {
+                    paths[size_t(i)].push_back(Photon{position, hitInfo.normal, diffusePower});
+                }
+                if (bounce == settings.bounces) {
+                    break;
+                }
+
+                // Russian roulette between diffuse reflection, mirror reflection and absorption
+                float diffuse = maxComponent(albedo);
+                if (diffuse + specular > 1.0F) {
+                    const float sum = diffuse + specular;
+                    diffuse /= sum;
+                    specular /= sum;
+                }
+                const glm::vec2 r = pathSampler.next2D();
+                if (r.x < diffuse) {
+                    power = diffusePower * albedo / diffuse;
+                    direction = cosineDirection(pathSampler.next2D(), hitInfo.normal, direction);
+                } else if (r.x < diffuse + specular) {
+                    power *= material.ks / (PI * specular);
+                    direction = glm::normalize(direction - 2.0F * glm::dot(direction, hitInfo.normal) * hitInfo.normal);
+                } else {
+                    break;
+                }
+                from = hitInfo.meshIdx;
+                origin = position;
+            }
+        }
+
+        for (const std::vector<Photon> &path : paths) {
+            map.photons.insert(map.photons.end(), path.begin(), path.end());
+        }
+        map.axes.resize(map.photons.size(), 0);
+#ifdef USE_OPENMP
+#pragma omp parallel
+#pragma omp single
+#endif
+        build(map, 0, map.photons.size());
+    }
+}
+
+int PhotonMap::passes() const {
+    return int(maps.size());
+}
+
+size_t PhotonMap::size() const {
+    size_t out = 0;
+    for (const Pass &map : maps) {
+        out += map.photons.size();
+    }
+    return out;
+}
+
+void PhotonMap::build(Pass &map, size_t begin, size_t end) {
+    if (end - begin <= 1) {
+        return;
+    }
+
+    glm::vec3 lower = glm::vec3(FLT_MAX);
+    glm::vec3 upper = glm::vec3(-FLT_MAX);
+    for (size_t i = begin; i < end; i++) {
+        lower = glm::min(lower, map.photons[i].position);
+        upper = glm::max(upper, map.photons[i].position);
+    }
+    const glm::vec3 extent = upper - lower;
+    const uint8_t axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+    const size_t middle = begin + (end - begin) / 2;
+    const auto first = map.photons.begin();
+    std::nth_element(first + std::ptrdiff_t(begin), first + std::ptrdiff_t(middle), first + std::ptrdiff_t(end),
+        [axis](const Photon &a, const Photon &b) { return a.position[axis] < b.position[axis]; });
+    map.axes[middle] = axis;
+
+    if (end - begin > PARALLEL_BUILD_SIZE) {
+#ifdef USE_OPENMP
+        // A reference is firstprivate in a task by default, which would build a copy of the pass
+#pragma omp task shared(map)
+#endif
+        build(map, begin, middle);
+        build(map, middle + 1, end);
+#ifdef USE_OPENMP
+#pragma omp taskwait
+#endif
+    } else {
+        build(map, begin, middle);
+        build(map, middle + 1, end);
+    }
+}
+
+void PhotonMap::gather(const Pass &map, size_t begin, size_t end, const glm::vec3 &position, const glm::vec3 &normal, glm::vec3 &power) const {
+    if (begin >= end) {
+        return;
+    }
+
+    const size_t middle = begin + (end - begin) / 2;
+    const Photon &photon = map.photons[middle];
+    const int axis = map.axes[middle];
+    const float split = photon.position[axis];
+    if (position[axis] - map.radius <= split) {
+        gather(map, begin, middle, position, normal, power);
+    }
+    if (position[axis] + map.radius >= split) {
+        gather(map, middle + 1, end, position, normal, power);
+    }
+
+    const glm::vec3 d = photon.position - position;
+    if (glm::dot(d, d) <= map.radius * map.radius && glm::dot(photon.normal, normal) > NORMAL_THRESHOLD) {
+        power += photon.power;
+    }
+}
+
+glm::vec3 PhotonMap::irradiance(const glm::vec3 &position, const glm::vec3 &normal, int pass) const {
+    const Pass &map = maps[size_t(pass)];
+    glm::vec3 power = glm::vec3(0.0F);
+    gather(map, 0, map.photons.size(), position, normal, power);
+    return power / (PI * map.radius * map.radius);
+}
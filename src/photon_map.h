@@ -0,0 +1,60 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <tuple>
+#include <vector>
+#include "bounding_volume_hierarchy.h"
+#include "lights.h"
+#include "sampler.h"
+#include "scene.h"
+
+struct PhotonSettings {
+    size_t photons = 100000; // Emitted per pass
+    int passes = 1; // Progressive photon mapping if more than one
+    float radius = 0.05F; // Gather radius of the first pass
+    float alpha = 0.7F; // Fraction of the photons kept per pass, the radius shrinks slower for larger values
+    int bounces = 2; // Reflections after the first hit, set to indirect_bounces() to match the hemisphere samples of a render
+};
+
+// A photon that arrived at a surface after at least one bounce. Direct light is computed by the renderer itself.
+struct Photon {
+    glm::vec3 position;
+    glm::vec3 normal; // Of the surface, photons only arrive on the side it faces
+    glm::vec3 power;
+};
+
+// Photons shot from the point and area lights of a scene, bounced diffusely and specularly (ks) with Russian roulette and
+// stored in a kd-tree per pass. Photon paths through mirrors make the caustics that camera paths hardly find.
+// They follow the light model of get_color rather than physics: point lights have no falloff and are clamped per light, the
+// first hit reflects kd, later ones the white Lambert lobe scaled by the transforms, so the irradiance replaces its indirect term.
+// The offsets of the transforms and the Blinn-Phong highlights of point lights are not carried by photons.
+// The passes follow "Progressive Photon Mapping: A Probabilistic Approach" (Knaus and Zwicker 2011): every pass has
+// its own photons and a smaller radius, the average over the passes converges to the right answer.
+class PhotonMap {
+public:
+    PhotonMap(const Scene &scene, const BoundingVolumeHierarchy &bvh, const AreaLights &lights, const std::vector<std::vector<std::tuple<glm::vec3, glm::vec3>>> &transforms, const PhotonSettings &settings, SamplerType samplerType, uint32_t seed);
+
+    int passes() const;
+
+    size_t size() const; // Photons stored over all passes
+
+    // Density estimate of the irradiance at a point from the photons of the pass
+    glm::vec3 irradiance(const glm::vec3 &position, const glm::vec3 &normal, int pass) const;
+
+private:
+    struct Pass {
+        std::vector<Photon> photons; // Balanced kd-tree, the root of every range is its middle element
+        std::vector<uint8_t> axes; // Split axis of the node at the same index
+        float radius;
+    };
+
+    void build(Pass &pass, size_t begin, size_t end);
+
+    void gather(const Pass &pass, size_t begin, size_t end, const glm::vec3 &position, const glm::vec3 &normal, glm::vec3 &power) const;
+
+    std::vector<Pass> maps;
+};
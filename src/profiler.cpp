@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include "profiler.h"
+
+// Events kept per thread, the oldest are overwritten
+static constexpr uint64_t EVENTS_PER_THREAD = 1 << 16;
+// Thread IDs of the timelines of the worker processes start here
+static constexpr uint32_t WORKER_TIMELINES = 1000000;
+
+// Nanoseconds since the start of the profile
+struct ProfileEvent {
+    const char *name;
+    int64_t begin;
+    int64_t end;
+    uint32_t worker;
+};
+
+// Only written by its thread. The count is published after the event, so the writer sees whole events.
+struct ThreadProfile {
+    std::vector<ProfileEvent> events = std::vector<ProfileEvent>(EVENTS_PER_THREAD);
+    std::atomic<uint64_t> count { 0 };
+    uint32_t id = 0;
+};
+
+static std::atomic<bool> recording { false };
+static std::atomic<ProfileClock::rep> epoch { 0 };
+// Only locked when a thread records its first event, and to start or write the profile. Profiles of threads that ended are kept
+// until the profile is written.
+static std::mutex threadsMutex;
+static std::vector<std::unique_ptr<ThreadProfile>> threads;
+static thread_local ThreadProfile *threadProfile = nullptr;
+
+static ThreadProfile &currentThread() {
+    if (threadProfile == nullptr) {
+        const std::lock_guard<std::mutex> lock(threadsMutex);
+        threads.push_back(std::make_unique<ThreadProfile>());
+        threads.back()->id = uint32_t(threads.size());
+        threadProfile = threads.back().get();
+    }
+    return *threadProfile;
+}
+
+static int64_t sinceEpoch(ProfileClock::time_point time) {
+    const ProfileClock::duration duration = time.time_since_epoch() - ProfileClock::duration(epoch.load(std::memory_order_relaxed));
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+void startProfile() {
+    const std::lock_guard<std::mutex> lock(threadsMutex);
+    for (const std::unique_ptr<ThreadProfile> &thread : threads) {
+        thread->count.store(0, std::memory_order_relaxed);
+    }
+    epoch.store(ProfileClock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    recording.store(true, std::memory_order_release);
+}
+
+bool profiling() {
+    return recording.load(std::memory_order_relaxed);
+}
+
+void profileEvent(const char *name, ProfileClock::time_point begin, ProfileClock::time_point end, uint32_t worker) {
+    if (!profiling()) {
+        return;
+    }
+    ThreadProfile &thread = currentThread();
+    const uint64_t count = thread.count.load(std::memory_order_relaxed);
+    thread.events[count % EVENTS_PER_THREAD] = ProfileEvent{name, sinceEpoch(begin), sinceEpoch(end), worker};
+    thread.count.store(count + 1, std::memory_order_release);
+}
+
+ProfileScope::ProfileScope(const char *scopeName) : name(profiling() ? scopeName : nullptr), begin(name != nullptr ? ProfileClock::now() : ProfileClock::time_point()) {}
+
+ProfileScope::~ProfileScope() {
+    if (name != nullptr) {
+        profileEvent(name, begin, ProfileClock::now());
+    }
+}
+
+void writeProfile(const std::filesystem::path &filePath) {
+    recording.store(false, std::memory_order_relaxed);
+    const std::lock_guard<std::mutex> lock(threadsMutex);
+
+    std::ofstream file(filePath);
+    // Microseconds with nanosecond precision
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    bool first = true;
+    auto separator = [&]() {
+        file << (first ? "\n" : ",\n");
+        first = false;
+    };
+    std::vector<bool> workers;
+    uint64_t dropped = 0;
+    for (const std::unique_ptr<ThreadProfile> &thread : threads) {
+        const uint64_t count = thread->count.load(std::memory_order_acquire);
+        if (count == 0) {
+            continue;
+        }
+        separator();
+        file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread->id << ", \"args\": {\"name\": \"Thread " << thread->id << "\"}}";
+        const uint64_t begin = count > EVENTS_PER_THREAD ? count - EVENTS_PER_THREAD : 0;
+        dropped += begin;
+        for (uint64_t i = begin; i < count; i++) {
+            const ProfileEvent &event = thread->events[i % EVENTS_PER_THREAD];
+            if (event.worker > 0) {
+                workers.resize(std::max(workers.size(), size_t(event.worker) + 1));
+                workers[event.worker] = true;
+            }
+            // Complete events
+            separator();
+            file << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": "
+                 << (event.worker > 0 ? WORKER_TIMELINES + event.worker : thread->id)
+                 << ", \"ts\": " << double(event.begin) / 1000.0 << ", \"dur\": " << double(event.end - event.begin) / 1000.0 << "}";
+        }
+    }
+    for (size_t worker = 1; worker < workers.size(); worker++) {
+        if (workers[worker]) {
+            separator();
+            file << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << WORKER_TIMELINES + worker << ", \"args\": {\"name\": \"Worker process " << worker << "\"}}";
+        }
+    }
+    file << "\n]}" << std::endl;
+
+    if (!file) {
+        throw std::runtime_error("Failed to write " + filePath.string());
+    }
+    if (dropped > 0) {
+        std::cerr << "Warning: " << dropped << " profile events were overwritten, the profile only has the newest " << EVENTS_PER_THREAD << " per thread." << std::endl;
+    }
+}
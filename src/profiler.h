@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+// Timeline of the render pipeline, written as Chrome trace events (open in chrome://tracing or ui.perfetto.dev).
+// Every thread records its scopes into a ring buffer of its own, so recording takes no lock and keeps the newest events if a thread
+// records more than fit. Scopes cost one atomic load while no profile is being recorded.
+using ProfileClock = std::chrono::steady_clock;
+
+// Drops what was recorded before and records from now on
+void startProfile();
+
+// Stops recording and writes the events of all threads. Must not be called while other threads record.
+void writeProfile(const std::filesystem::path &filePath);
+
+bool profiling();
+
+// Event on the timeline of the calling thread, or with worker > 0 on the timeline of that worker process.
+// name must outlive the profile, e.g. a string literal.
+void profileEvent(const char *name, ProfileClock::time_point begin, ProfileClock::time_point end, uint32_t worker = 0);
+
+// Records the time from construction to destruction
+class ProfileScope {
+public:
+    explicit ProfileScope(const char *scopeName);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *name; // nullptr if no profile was being recorded at the start
+    ProfileClock::time_point begin;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) const ProfileScope PROFILE_CONCAT(profileScope, __LINE__){name}
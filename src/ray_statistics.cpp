@@ -0,0 +1,30 @@
+#include "ray_statistics.h"
+
+size_t RayStatistics::totalRays() const {
+    size_t total = 0;
+    for (size_t type = 0; type < RAY_TYPES; type++) {
+        total += rays[type];
+    }
+    return total;
+}
+
+RayStatistics &RayStatistics::operator+=(const RayStatistics &other) {
+    for (size_t type = 0; type < RAY_TYPES; type++) {
+        rays[type] += other.rays[type];
+    }
+    nodes += other.nodes;
+    triangles += other.triangles;
+    hits += other.hits;
+    return *this;
+}
+
+RayStatistics RayStatistics::operator-(const RayStatistics &other) const {
+    RayStatistics difference = *this;
+    for (size_t type = 0; type < RAY_TYPES; type++) {
+        difference.rays[type] -= other.rays[type];
+    }
+    difference.nodes -= other.nodes;
+    difference.triangles -= other.triangles;
+    difference.hits -= other.hits;
+    return difference;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+
+// What a traced ray is for
+enum class RayType {
+    Camera,
+    Shadow, // Shadow rays to lights, also those of the shadow maps and of bidirectional connections
+    Reflection, // Mirror reflections
+    Indirect // Hemisphere samples and the rays of light subpaths
+};
+
+static constexpr size_t RAY_TYPES = 4;
+
+// Work done by the tracer, all zero unless the build counts it (the RAY_STATISTICS option of CMake).
+struct RayStatistics {
+    size_t rays[RAY_TYPES] {};
+    size_t nodes = 0; // Hierarchy nodes whose box was tested
+    size_t triangles = 0; // Ray/triangle tests, without the padding of the kernels
+    size_t hits = 0; // Rays that hit a triangle
+
+    size_t totalRays() const;
+
+    RayStatistics &operator+=(const RayStatistics &other);
+    RayStatistics operator-(const RayStatistics &other) const;
+};
+
+#ifdef USE_RAY_STATISTICS
+// Counters of the calling thread, in the header so that counting inlines into the traversal
+inline thread_local RayStatistics threadCounters;
+
+inline const RayStatistics &threadRayStatistics() {
+    return threadCounters;
+}
+
+#define COUNT_RAY_STATISTIC(counter, amount) (threadCounters.counter += (amount))
+#else
+// Counting compiles to nothing
+inline RayStatistics threadRayStatistics() {
+    return RayStatistics{};
+}
+
+#define COUNT_RAY_STATISTIC(counter, amount) ((void) 0)
+#endif
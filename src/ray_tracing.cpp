@@ -67,8 +67,8 @@ Plane trianglePlane(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v
 
 /// Input: the three vertices of the triangle
 /// Output: if intersects then modify the hit parameter ray.t and return true,
-/// otherwise return false
-bool intersectRayWithTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, Ray &ray, HitInfo &hitInfo) {
+/// otherwise return false. The surface at the hit is left to the caller, so traversal does not compute it for every closer triangle
+bool intersectRayWithTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, Ray &ray) {
   Plane plane = trianglePlane(v0, v1, v2);
 
   // We save the old value
@@ -80,14 +80,6 @@ bool intersectRayWithTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const gl
 
   // Ray hits the triangle and the triangle is closer than the previous value
   if (pointInTriangle(v0, v1, v2, plane.normal, ray.origin + ray.direction * ray.t) && ray.t <= oldT) {
-    // We manually update the hit info normal
-    hitInfo.normal = plane.normal;
-
-    // Turn the normal if it faces away from the ray origin
-    if (glm::dot(glm::normalize(ray.direction), plane.normal) > 0.0F) {
-      hitInfo.normal *= -1;
-    }
-
     return true;
   }
 
@@ -97,6 +89,22 @@ bool intersectRayWithTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const gl
   return false;
 }
 
+glm::vec2 triangleBarycentric(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, const glm::vec3 &p) {
+  const glm::vec3 e1 = v1 - v0;
+  const glm::vec3 e2 = v2 - v0;
+  const glm::vec3 ep = p - v0;
+  const float d11 = glm::dot(e1, e1);
+  const float d12 = glm::dot(e1, e2);
+  const float d22 = glm::dot(e2, e2);
+  const float dp1 = glm::dot(ep, e1);
+  const float dp2 = glm::dot(ep, e2);
+  const float denom = d11 * d22 - d12 * d12;
+  if (denom == 0.0F) {
+    return glm::vec2(0.0F);
+  }
+  return glm::vec2(d22 * dp1 - d12 * dp2, d11 * dp2 - d12 * dp1) / denom;
+}
+
 /// Input: a sphere with the following attributes: sphere.radius, sphere.center
 /// Output: if intersects then modify the hit parameter ray.t and return true,
 /// otherwise return false
@@ -131,7 +139,6 @@ bool intersectRayWithShape(const Sphere &sphere, Ray &ray, HitInfo &hitInfo) {
   // Update hit info
   glm::vec3 point = ray.origin + ray.direction * ray.t;
   hitInfo.normal = glm::normalize(point - sphere.center);
-  hitInfo.material = sphere.material;
 
   // Turn the normal if it faces away from the ray origin
   if (glm::dot(glm::normalize(ray.direction), hitInfo.normal) > 0) {
@@ -1,13 +1,20 @@
 #pragma once
 
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
 #include "scene.h"
 #include "ray.h"
 
 
+// The surface at the closest hit of a ray, built once after traversal
 struct HitInfo {
-    glm::vec3 normal;
+    glm::vec3 normal; // Geometric normal, faces the ray
     Material material;
     size_t meshIdx;
+    size_t triangleIdx;
+    glm::vec2 barycentric; // Weights of the second and third vertex of the triangle
 };
 
 bool intersectRayWithPlane(const Plane &plane, Ray &ray);
@@ -16,8 +23,12 @@ bool pointInTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &
 
 Plane trianglePlane(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2);
 
-bool intersectRayWithTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, Ray &ray, HitInfo &hitInfo);
+bool intersectRayWithTriangle(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, Ray &ray);
 
+// Weights of v1 and v2 of the point in the plane of the triangle
+glm::vec2 triangleBarycentric(const glm::vec3 &v0, const glm::vec3 &v1, const glm::vec3 &v2, const glm::vec3 &p);
+
+// Only sets the normal, the material is up to the caller
 bool intersectRayWithShape(const Sphere &sphere, Ray &ray, HitInfo &hitInfo);
 
 bool intersectRayWithShape(const AxisAlignedBox &box, Ray &ray);
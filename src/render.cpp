@@ -0,0 +1,374 @@
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include "bidirectional.h"
+#include "profiler.h"
+#include "render.h"
+#include "telemetry.h"
+#include "wavefront.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#pragma omp declare reduction(+ : RayStatistics : omp_out += omp_in)
+#endif
+
+// pixel is the work of the thread for the pixel, for the heat maps
+static void setAOVs(AOVBuffers *aovs, const int x, const int y, const PrimaryHit &primary, const float depth, const RayStatistics &pixel) {
+    if (aovs == nullptr) {
+        return;
+    }
+    const HitInfo &hitInfo = primary.hitInfo;
+    AOVSample sample;
+    if (hitInfo.meshIdx != SIZE_MAX) {
+        sample = AOVSample{hitInfo.material.kd, hitInfo.normal, depth, uint32_t(hitInfo.meshIdx), primary.direct, primary.indirect};
+    }
+    sample.nodes = uint32_t(std::min(pixel.nodes, size_t(UINT32_MAX)));
+    sample.triangles = uint32_t(std::min(pixel.triangles, size_t(UINT32_MAX)));
+    aovs->set(x, y, sample);
+}
+
+// Every pixel traces data.samples camera and light subpaths. Light subpaths also reach other pixels of the tile through the
+// camera, so the pixels are only written once all of them are done.
+static RenderStats renderBidirectional(const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const unsigned int seed, const Tile &tile, Screen &screen, AOVBuffers *aovs, RenderProgress *progress) {
+    const glm::ivec2 resolution = screen.resolution();
+    const glm::ivec2 size = tile.upper - tile.lower;
+    const size_t pixels = size_t(size.x) * size_t(size.y);
+    const std::unique_ptr<Sampler> sampler = makeSampler(data.sampler, seed);
+    const BidirectionalTracer tracer{scene, bvh, data.lights, camera, resolution, data.max_traces};
+    const int samples = std::max(data.samples, 1);
+    SplatBuffer splats{tile.lower, tile.upper};
+    std::vector<glm::vec3> colors(pixels);
+    size_t rays = 0;
+    RayStatistics statistics;
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+ : rays, statistics)
+#endif
+    for (int y = tile.lower.y; y < tile.upper.y; y++) {
+        PROFILE_SCOPE("row");
+        const size_t tracedBefore = traced_rays();
+        const RayStatistics statisticsBefore = threadRayStatistics();
+        for (int x = tile.lower.x; x < tile.upper.x; x++) {
+            const RayStatistics pixelBefore = threadRayStatistics();
+            glm::vec3 color = glm::vec3(0.0F);
+            PrimaryHit primary;
+            float depth = FLT_MAX;
+            for (int i = 0; i < samples; i++) {
+                const PathSampler pathSampler{*sampler, glm::ivec2(x, y), uint32_t(i)};
+                PathSampler cameraSampler = pathSampler.branch(0, 2);
+                PathSampler lightSampler = pathSampler.branch(1, 2);
+                const glm::vec2 offset = data.jitter ? cameraSampler.next2D() : glm::vec2(0.0F);
+                const glm::vec2 normalizedPixelPos{
+                    (float(x) + offset.x) / float(resolution.x) * 2.0F - 1.0F,
+                    (float(y) + offset.y) / float(resolution.y) * 2.0F - 1.0F
+                };
+                PrimaryHit samplePrimary;
+                float sampleDepth;
+                color += tracer.sample(normalizedPixelPos, cameraSampler, lightSampler, splats, samplePrimary, sampleDepth);
+                if (i == 0) {
+                    primary = samplePrimary;
+                    depth = sampleDepth;
+                }
+            }
+            colors[size_t(y - tile.lower.y) * size_t(size.x) + size_t(x - tile.lower.x)] = color / float(samples);
+            setAOVs(aovs, x, y, primary, depth, threadRayStatistics() - pixelBefore);
+        }
+        const size_t rowRays = traced_rays() - tracedBefore;
+        rays += rowRays;
+        statistics += threadRayStatistics() - statisticsBefore;
+        if (progress != nullptr) {
+            progress->add(size_t(size.x), rowRays);
+        }
+    }
+
+    // A light subpath lands on the whole film, so the splats estimate the image as if every pixel of the screen had traced
+    // as many light subpaths as the pixels of the tile did
+    PROFILE_SCOPE("add splats");
+    const float splatScale = float(resolution.x) * float(resolution.y) / (float(pixels) * float(samples));
+    for (int y = tile.lower.y; y < tile.upper.y; y++) {
+        for (int x = tile.lower.x; x < tile.upper.x; x++) {
+            const glm::vec3 color = colors[size_t(y - tile.lower.y) * size_t(size.x) + size_t(x - tile.lower.x)] + splats.get(x, y) * splatScale;
+            screen.setPixel(size_t(x), size_t(y), color);
+        }
+    }
+
+    return RenderStats{pixels, rays, statistics};
+}
+
+// Light of the point lights at the first hit of every pixel of the tile, picked by the reservoirs of data.restir. Every stage needs the
+// previous one for all pixels of the tile, because the pixels reuse the reservoirs of their neighbours.
+static std::vector<glm::vec3> resampleDirectLight(const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const unsigned int seed, const Tile &tile, const glm::ivec2 &resolution, size_t &rays, RayStatistics &statistics) {
+    PROFILE_SCOPE("ReSTIR");
+    ReservoirBuffer &restir = *data.restir;
+    const glm::ivec2 size = tile.upper - tile.lower;
+    const std::unique_ptr<Sampler> sampler = makeSampler(data.sampler, seed);
+    // Other samples than the paths, which start at the same pixels
+    const std::unique_ptr<Sampler> restirSampler = makeSampler(data.sampler, ~seed);
+    std::vector<glm::vec3> direct(size_t(size.x) * size_t(size.y));
+#ifdef USE_OPENMP
+#pragma omp parallel for reduction(+ : rays, statistics)
+#endif
+    for (int y = tile.lower.y; y < tile.upper.y; y++) {
+        const size_t tracedBefore = traced_rays();
+        const RayStatistics statisticsBefore = threadRayStatistics();
+        for (int x = tile.lower.x; x < tile.upper.x; x++) {
+            // The same camera ray as the first pass of the render
+            PathSampler pathSampler{*sampler, glm::ivec2(x, y), 0};
+            const glm::vec2 offset = data.jitter ? pathSampler.next2D() : glm::vec2(0.0F);
+            Ray cameraRay = camera.generateRay(glm::vec2(
+                (float(x) + offset.x) / float(resolution.x) * 2.0F - 1.0F,
+                (float(y) + offset.y) / float(resolution.y) * 2.0F - 1.0F));
+            HitInfo hitInfo;
+            if (data.primary_hits == nullptr || !data.primary_hits->get(scene, x, y, cameraRay, hitInfo)) {
+                if (!trace(bvh, cameraRay, hitInfo, RayType::Camera)) {
+                    hitInfo.meshIdx = SIZE_MAX;
+                }
+                if (data.primary_hits != nullptr) {
+                    data.primary_hits->set(x, y, cameraRay, hitInfo);
+                }
+            }
+            PathSampler reservoirSampler{*restirSampler, glm::ivec2(x, y), 0};
+            restir.sample(scene, data.point_lights, glm::ivec2(x, y), cameraRay, hitInfo, reservoirSampler);
+        }
+        rays += traced_rays() - tracedBefore;
+        statistics += threadRayStatistics() - statisticsBefore;
+    }
+#ifdef USE_OPENMP
+#pragma omp parallel for
+#endif
+    for (int y = tile.lower.y; y < tile.upper.y; y++) {
+        std::vector<size_t> merged;
+        for (int x = tile.lower.x; x < tile.upper.x; x++) {
+            PathSampler reservoirSampler{*restirSampler, glm::ivec2(x, y), 1};
+            restir.reuse(scene, glm::ivec2(x, y), tile.lower, tile.upper, reservoirSampler, merged);
+        }
+    }
+#ifdef USE_OPENMP
+#pragma omp parallel for reduction(+ : rays, statistics)
+#endif
+    for (int y = tile.lower.y; y < tile.upper.y; y++) {
+        const size_t tracedBefore = traced_rays();
+        const RayStatistics statisticsBefore = threadRayStatistics();
+        for (int x = tile.lower.x; x < tile.upper.x; x++) {
+            direct[size_t(y - tile.lower.y) * size_t(size.x) + size_t(x - tile.lower.x)] = restir.shade(scene, bvh, glm::ivec2(x, y));
+        }
+        rays += traced_rays() - tracedBefore;
+        statistics += threadRayStatistics() - statisticsBefore;
+    }
+    return direct;
+}
+
+// The same paths as get_color, traced a batch of pixels at a time by a WavefrontTracer per thread. The rays of a batch are not
+// told apart by pixel, so the heat maps stay empty.
+static void renderWavefront(const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const unsigned int seed, const Tile &tile, Screen &screen, AOVBuffers *aovs, RenderProgress *progress, const std::vector<glm::vec3> &direct, size_t &rays, RayStatistics &statistics) {
+    const glm::ivec2 resolution = screen.resolution();
+    const glm::ivec2 size = tile.upper - tile.lower;
+    const size_t pixels = size_t(size.x) * size_t(size.y);
+    const std::unique_ptr<Sampler> sampler = makeSampler(data.sampler, seed);
+    const size_t batch = WavefrontTracer::batchSize(data);
+    const int batches = int((pixels + batch - 1) / batch);
+#ifdef USE_OPENMP
+#pragma omp parallel reduction(+ : rays, statistics)
+#endif
+    {
+        WavefrontTracer tracer{scene, bvh, data, camera.position()};
+        std::vector<WavefrontTracer::CameraPath> paths;
+        std::vector<HitInfo> knownHits(batch);
+        std::vector<glm::vec3> colors;
+        std::vector<PrimaryHit> primaries;
+        const size_t tracedBefore = traced_rays();
+        const RayStatistics statisticsBefore = threadRayStatistics();
+#ifdef USE_OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (int b = 0; b < batches; b++) {
+            PROFILE_SCOPE("batch");
+            const size_t batchBefore = traced_rays();
+            const size_t begin = size_t(b) * batch;
+            const size_t end = std::min(begin + batch, pixels);
+            paths.clear();
+            for (size_t i = begin; i < end; i++) {
+                const int x = tile.lower.x + int(i % size_t(size.x));
+                const int y = tile.lower.y + int(i / size_t(size.x));
+                PathSampler pathSampler{*sampler, glm::ivec2(x, y), 0};
+                const glm::vec2 offset = data.jitter ? pathSampler.next2D() : glm::vec2(0.0F);
+                Ray cameraRay = camera.generateRay(glm::vec2(
+                    (float(x) + offset.x) / float(resolution.x) * 2.0F - 1.0F,
+                    (float(y) + offset.y) / float(resolution.y) * 2.0F - 1.0F));
+                WavefrontTracer::CameraPath path{cameraRay, pathSampler};
+                if (data.primary_hits != nullptr && data.primary_hits->get(scene, x, y, path.ray, knownHits[i - begin])) {
+                    path.knownHit = &knownHits[i - begin];
+                }
+                if (!direct.empty()) {
+                    path.direct = &direct[i];
+                }
+                paths.push_back(path);
+            }
+
+            tracer.trace(paths, colors, primaries);
+
+            for (size_t i = begin; i < end; i++) {
+                const int x = tile.lower.x + int(i % size_t(size.x));
+                const int y = tile.lower.y + int(i / size_t(size.x));
+                const WavefrontTracer::CameraPath &path = paths[i - begin];
+                screen.setPixel(size_t(x), size_t(y), colors[i - begin]);
+                setAOVs(aovs, x, y, primaries[i - begin], path.ray.t, RayStatistics{});
+                if (data.primary_hits != nullptr && path.knownHit == nullptr) {
+                    data.primary_hits->set(x, y, path.ray, primaries[i - begin].hitInfo);
+                }
+            }
+
+            if (progress != nullptr) {
+                progress->add(end - begin, traced_rays() - batchBefore);
+            }
+        }
+        rays += traced_rays() - tracedBefore;
+        statistics += threadRayStatistics() - statisticsBefore;
+    }
+}
+
+// Progress is only reported if output is set
+static RenderStats render(const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const unsigned int seed, const Tile &tile, Screen &screen, AOVBuffers *aovs, const ProgressOutput *output) {
+    PROFILE_SCOPE("render tile");
+    const glm::ivec2 resolution = screen.resolution();
+    const glm::ivec2 size = tile.upper - tile.lower;
+    const size_t pixels = size_t(size.x) * size_t(size.y);
+    const int passes = data.photons != nullptr ? std::max(data.photons->passes(), 1) : 1;
+    // The render threads only count, the reporter reads the counters on a thread of its own
+    std::optional<RenderProgress> counters;
+    std::optional<ProgressReporter> reporter;
+    if (output != nullptr) {
+        counters.emplace(pixels, size_t(data.mode == RenderMode::Bidirectional ? std::max(data.samples, 1) : passes));
+        reporter.emplace(*counters, *output);
+    }
+    RenderProgress *progress = counters ? &*counters : nullptr;
+    if (data.mode == RenderMode::Bidirectional) {
+        return renderBidirectional(scene, camera, bvh, data, seed, tile, screen, aovs, progress);
+    }
+    const std::unique_ptr<Sampler> sampler = makeSampler(data.sampler, seed);
+    size_t rays = 0;
+    RayStatistics statistics;
+    if (data.primary_hits != nullptr) {
+        PROFILE_SCOPE("update primary hits");
+        data.primary_hits->update(camera, resolution, data.sampler, data.jitter, seed);
+    }
+    std::vector<glm::vec3> direct;
+    if (data.restir != nullptr) {
+        direct = resampleDirectLight(scene, camera, bvh, data, seed, tile, resolution, rays, statistics);
+    }
+    if (data.mode == RenderMode::Wavefront) {
+        if (WavefrontTracer::supports(data)) {
+            renderWavefront(scene, camera, bvh, data, seed, tile, screen, aovs, progress, direct, rays, statistics);
+            return RenderStats{pixels, rays, statistics};
+        }
+        // Renders the same image path by path, said once since the preview and every tile come through here
+        static std::atomic<bool> warned{false};
+        if (!warned.exchange(true)) {
+            std::cerr << "Warning: wavefront mode does not support photon mapping, the irradiance cache or path guide training, rendering path by path instead." << std::endl;
+        }
+    }
+#ifdef USE_OPENMP
+#pragma omp parallel for reduction(+ : rays, statistics)
+#endif
+    for (int y = tile.lower.y; y < tile.upper.y; y++) {
+        PROFILE_SCOPE("row");
+        const size_t tracedBefore = traced_rays();
+        const RayStatistics statisticsBefore = threadRayStatistics();
+        for (int x = tile.lower.x; x < tile.upper.x; x++) {
+            const RayStatistics pixelBefore = threadRayStatistics();
+            // Progressive photon mapping averages one path per photon map pass, the render passes come from the first one
+            glm::vec3 color = glm::vec3(0.0F);
+            PrimaryHit primary;
+            float depth = FLT_MAX;
+            for (int pass = 0; pass < passes; pass++) {
+                ShadingData passData = data;
+                passData.photon_pass = pass;
+                // Only the first pass has the camera ray the reservoirs were made for
+                if (pass == 0 && !direct.empty()) {
+                    passData.primary_direct = &direct[size_t(y - tile.lower.y) * size_t(size.x) + size_t(x - tile.lower.x)];
+                }
+                PathSampler pathSampler{*sampler, glm::ivec2(x, y), uint32_t(pass)};
+                const glm::vec2 offset = data.jitter ? pathSampler.next2D() : glm::vec2(0.0F);
+
+                // NOTE: (-1, -1) at the bottom left of the screen, (+1, +1) at the top right of the screen.
+                glm::vec2 normalizedPixelPos{
+                    (float(x) + offset.x) / float(resolution.x) * 2.0F - 1.0F,
+                    (float(y) + offset.y) / float(resolution.y) * 2.0F - 1.0F
+                };
+                Ray cameraRay = camera.generateRay(normalizedPixelPos);
+                // Only the first pass has the same camera ray in every render
+                HitInfo knownHit;
+                if (pass == 0 && data.primary_hits != nullptr && data.primary_hits->get(scene, x, y, cameraRay, knownHit)) {
+                    passData.primary_hit = &knownHit;
+                }
+                PrimaryHit passPrimary;
+                color += get_color(camera.position(), scene, bvh, passData, pathSampler, cameraRay, passPrimary);
+                if (pass == 0) {
+                    primary = passPrimary;
+                    depth = cameraRay.t;
+                    if (data.primary_hits != nullptr && passData.primary_hit == nullptr) {
+                        data.primary_hits->set(x, y, cameraRay, passPrimary.hitInfo);
+                    }
+                }
+            }
+            color /= float(passes);
+            screen.setPixel(size_t(x), size_t(y), color);
+            setAOVs(aovs, x, y, primary, depth, threadRayStatistics() - pixelBefore);
+        }
+        const size_t rowRays = traced_rays() - tracedBefore;
+        rays += rowRays;
+        statistics += threadRayStatistics() - statisticsBefore;
+        if (progress != nullptr) {
+            progress->add(size_t(size.x), rowRays);
+        }
+    }
+
+    return RenderStats{pixels, rays, statistics};
+}
+
+RenderStats renderRayTracing(const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const unsigned int seed, Screen &screen, AOVBuffers *aovs, const ProgressOutput &progress) {
+    return render(scene, camera, bvh, data, seed, Tile{glm::ivec2(0), screen.resolution()}, screen, aovs, &progress);
+}
+
+RenderStats renderTile(const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const unsigned int seed, const Tile &tile, Screen &screen, AOVBuffers *aovs) {
+    return render(scene, camera, bvh, data, seed, tile, screen, aovs, nullptr);
+}
+
+void trainPathGuide(const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const unsigned int seed, const glm::ivec2 &resolution, PathGuide &guide, const ProgressOutput &progress) {
+    const int iterations = guide.settings().iterations;
+    if (iterations <= 0) {
+        return;
+    }
+    RenderProgress counters{size_t(resolution.x) * size_t(resolution.y) * size_t(iterations), 1};
+    const ProgressReporter reporter{counters, progress};
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        PROFILE_SCOPE("path guide pass");
+        ShadingData passData = data;
+        passData.guide = &guide;
+        passData.guide_training = true;
+        passData.samples = std::max(1, data.samples >> (iterations - iteration));
+        // Other samples than the final render
+        const std::unique_ptr<Sampler> sampler = makeSampler(data.sampler, seed + 1 + unsigned(iteration));
+#ifdef USE_OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+        for (int y = 0; y < resolution.y; y++) {
+            PROFILE_SCOPE("row");
+            const size_t tracedBefore = traced_rays();
+            for (int x = 0; x < resolution.x; x++) {
+                PathSampler pathSampler{*sampler, glm::ivec2(x, y), 0};
+                const glm::vec2 offset = data.jitter ? pathSampler.next2D() : glm::vec2(0.0F);
+                Ray cameraRay = camera.generateRay(glm::vec2(
+                    (float(x) + offset.x) / float(resolution.x) * 2.0F - 1.0F,
+                    (float(y) + offset.y) / float(resolution.y) * 2.0F - 1.0F));
+                get_color(camera.position(), scene, bvh, passData, pathSampler, cameraRay);
+            }
+            counters.add(size_t(resolution.x), traced_rays() - tracedBefore);
+        }
+        {
+            PROFILE_SCOPE("refine path guide");
+            guide.refine();
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include "aov.h"
+#include "bounding_volume_hierarchy.h"
+#include "illumination.h"
+#include "ray_statistics.h"
+#include "scene.h"
+#include "screen.h"
+#include "telemetry.h"
+#include "trackball.h"
+
+struct RenderStats {
+    size_t pixels;
+    size_t rays;
+    RayStatistics statistics; // All zero unless the build counts them
+};
+
+// Pixels [lower, upper) with (0, 0) at the bottom left of the screen.
+struct Tile {
+    glm::ivec2 lower;
+    glm::ivec2 upper;
+};
+
+// Ray traces the whole screen, and fills the render passes if given. Samples only depend on the seed and the pixel, so the result does not
+// depend on the number of threads or the order in which pixels are rendered, except for the order in which bidirectional light paths add up
+// and with the irradiance cache, whose records are made by whichever pixel needs one first and then interpolated by the others.
+// Progress is reported to the given output while rendering.
+RenderStats renderRayTracing(const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const unsigned int seed, Screen &screen, AOVBuffers *aovs = nullptr, const ProgressOutput &progress = ProgressOutput{});
+
+// Ray traces only the pixels of the tile, without progress output. Tiles rendered separately combine into the same image as
+// renderRayTracing, except with ReSTIR, which only reuses neighbours within the tile, and in bidirectional mode, where the light
+// subpaths and the scale of their splats are per tile. The coordinator therefore does not split those.
+RenderStats renderTile(const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const unsigned int seed, const Tile &tile, Screen &screen, AOVBuffers *aovs = nullptr);
+
+// Renders the training passes of path guiding without keeping the images. Every pass has twice the samples of the previous one
+// and ends with refining the guide, the last one with half the samples of data. Progress over all passes, a path per pixel and
+// pass, is reported to the given output.
+void trainPathGuide(const Scene &scene, const Trackball &camera, const BoundingVolumeHierarchy &bvh, const ShadingData &data, const unsigned int seed, const glm::ivec2 &resolution, PathGuide &guide, const ProgressOutput &progress = ProgressOutput{});
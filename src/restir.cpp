@@ -0,0 +1,178 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "illumination.h"
+#include "restir.h"
+
+static constexpr float PI = 3.14159265358979323846F;
+// Neighbours are only merged if their normal is within about 25 degrees and their depth within 10 percent
+static constexpr float NORMAL_THRESHOLD = 0.9F;
+static constexpr float DEPTH_THRESHOLD = 0.1F;
+
+static float luminance(const glm::vec3 &color) {
+    return glm::dot(color, glm::vec3(0.2126F, 0.7152F, 0.0722F));
+}
+
+bool Reservoir::update(uint32_t candidate, float w, float u) {
+    weightSum += w;
+    if (w > 0.0F && u * weightSum < w) {
+        light = candidate;
+        return true;
+    }
+    return false;
+}
+
+ReservoirBuffer::ReservoirBuffer(const glm::ivec2 &imageResolution, const ReSTIRSettings &settings)
+    : resolution(imageResolution), restirSettings(settings) {
+    const size_t pixels = size_t(resolution.x) * size_t(resolution.y);
+    surfaces.resize(pixels);
+    previousSurfaces.resize(pixels);
+    candidates.resize(pixels);
+    reservoirs.resize(pixels);
+    previous.resize(pixels);
+}
+
+const ReSTIRSettings &ReservoirBuffer::settings() const {
+    return restirSettings;
+}
+
+void ReservoirBuffer::nextFrame() {
+    // The history is taken before spatial reuse, otherwise neighbours would merge the same candidates again every frame, which darkens
+    std::swap(previous, candidates);
+    std::swap(previousSurfaces, surfaces);
+    std::fill(surfaces.begin(), surfaces.end(), Surface{});
+}
+
+size_t ReservoirBuffer::index(const glm::ivec2 &pixel) const {
+    return size_t(pixel.y) * size_t(resolution.x) + size_t(pixel.x);
+}
+
+// Unshadowed light reflected towards the camera, the reservoirs pick lights in proportion to it
+float ReservoirBuffer::target(const Scene &scene, const Surface &surface, uint32_t light) const {
+    if (light >= scene.pointLights.size()) {
+        return 0.0F;
+    }
+    const glm::vec3 color = point_light_contribution(surface.position, surface.normal, surface.material, scene.pointLights[light], surface.camera);
+    return std::max(luminance(color), 0.0F);
+}
+
+bool ReservoirBuffer::similar(const Surface &a, const Surface &b) const {
+    return a.valid && b.valid && glm::dot(a.normal, b.normal) > NORMAL_THRESHOLD && std::fabs(a.depth - b.depth) <= DEPTH_THRESHOLD * a.depth;
+}
+
+// Adds the light of a reservoir from another pixel or frame, as if all its candidates had been seen here
+void ReservoirBuffer::merge(const Scene &scene, const Surface &surface, Reservoir &reservoir, const Reservoir &other, float u) const {
+    if (other.count <= 0.0F) {
+        return;
+    }
+    reservoir.update(other.light, target(scene, surface, other.light) * other.weight * other.count, u);
+    reservoir.count += other.count;
+}
+
+void ReservoirBuffer::finish(const Scene &scene, const Surface &surface, Reservoir &reservoir) const {
+    const float p = target(scene, surface, reservoir.light);
+    reservoir.weight = p > 0.0F && reservoir.count > 0.0F ? reservoir.weightSum / (reservoir.count * p) : 0.0F;
+}
+
+void ReservoirBuffer::sample(const Scene &scene, const PointLightTree *tree, const glm::ivec2 &pixel, const Ray &ray, const HitInfo &hitInfo, PathSampler &sampler) {
+    const size_t i = index(pixel);
+    Surface &surface = surfaces[i];
+    Reservoir &reservoir = candidates[i];
+    surface = Surface{};
+    reservoir = Reservoir{};
+    if (hitInfo.meshIdx == SIZE_MAX || scene.pointLights.empty()) {
+        return;
+    }
+    surface.position = ray.origin + ray.direction * ray.t;
+    surface.normal = hitInfo.normal;
+    surface.camera = ray.origin;
+    surface.material = hitInfo.material;
+    surface.depth = ray.t;
+    surface.valid = true;
+
+    // Candidates from the light hierarchy, or uniformly if there is none
+    const bool useTree = tree != nullptr && !tree->empty();
+    for (int c = 0; c < restirSettings.candidates; c++) {
+        const glm::vec2 u = sampler.next2D();
+        float pdf;
+        size_t light;
+        if (useTree) {
+            light = tree->sample(surface.position, surface.normal, u.x, pdf);
+        } else {
+            light = std::min(size_t(u.x * float(scene.pointLights.size())), scene.pointLights.size() - 1);
+            pdf = 1.0F / float(scene.pointLights.size());
+        }
+        reservoir.count += 1.0F;
+        if (pdf > 0.0F) {
+            reservoir.update(uint32_t(light), target(scene, surface, uint32_t(light)) / pdf, u.y);
+        }
+    }
+    finish(scene, surface, reservoir);
+
+    if (restirSettings.temporal && similar(surface, previousSurfaces[i])) {
+        Reservoir history = previous[i];
+        // Old lights would otherwise dominate after a few frames and never adapt to changes
+        const float limit = restirSettings.historyLimit * float(restirSettings.candidates);
+        history.count = std::min(history.count, limit);
+        const glm::vec2 u = sampler.next2D();
+        Reservoir combined;
+        merge(scene, surface, combined, reservoir, u.x);
+        merge(scene, surface, combined, history, u.y);
+        finish(scene, surface, combined);
+        reservoir = combined;
+    }
+}
+
+void ReservoirBuffer::reuse(const Scene &scene, const glm::ivec2 &pixel, const glm::ivec2 &lower, const glm::ivec2 &upper, PathSampler &sampler, std::vector<size_t> &merged) {
+    const size_t i = index(pixel);
+    const Surface &surface = surfaces[i];
+    if (!surface.valid) {
+        reservoirs[i] = candidates[i];
+        return;
+    }
+    Reservoir reservoir;
+    merge(scene, surface, reservoir, candidates[i], sampler.next2D().x);
+    merged.assign(1, i);
+    for (int n = 0; n < restirSettings.spatialNeighbours; n++) {
+        const glm::vec2 u = sampler.next2D();
+        // Uniform point in the disk around the pixel
+        const float r = restirSettings.spatialRadius * std::sqrt(u.x);
+        const float phi = 2.0F * PI * u.y;
+        const glm::ivec2 neighbour = glm::clamp(pixel + glm::ivec2(int(std::lround(r * std::cos(phi))), int(std::lround(r * std::sin(phi)))), lower, upper - 1);
+        const size_t j = index(neighbour);
+        if (j == i || !similar(surface, surfaces[j])) {
+            continue;
+        }
+        merge(scene, surface, reservoir, candidates[j], sampler.next2D().x);
+        merged.push_back(j);
+    }
+    // Only pixels that could have picked the light count, otherwise neighbours that face away from it darken the estimate
+    reservoir.count = 0.0F;
+    for (const size_t j : merged) {
+        if (target(scene, surfaces[j], reservoir.light) > 0.0F) {
+            reservoir.count += candidates[j].count;
+        }
+    }
+    finish(scene, surface, reservoir);
+    reservoirs[i] = reservoir;
+}
+
+glm::vec3 ReservoirBuffer::shade(const Scene &scene, const BoundingVolumeHierarchy &bvh, const glm::ivec2 &pixel) const {
+    const size_t i = index(pixel);
+    const Surface &surface = surfaces[i];
+    const Reservoir &reservoir = reservoirs[i];
+    if (!surface.valid || reservoir.weight <= 0.0F || reservoir.light >= scene.pointLights.size()) {
+        return glm::vec3(0.0F);
+    }
+    const PointLight &light = scene.pointLights[reservoir.light];
+    if (is_shadow(bvh, surface.position, light.position, surface.normal, false)) {
+        return glm::vec3(0.0F);
+    }
+    return glm::clamp(point_light_contribution(surface.position, surface.normal, surface.material, light, surface.camera) * reservoir.weight, 0.0F, 1.0F);
+}
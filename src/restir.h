@@ -0,0 +1,82 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <vector>
+#include "bounding_volume_hierarchy.h"
+#include "lights.h"
+#include "mesh.h"
+#include "sampler.h"
+#include "scene.h"
+
+struct ReSTIRSettings {
+    int candidates = 32; // Lights streamed into the reservoir of every pixel per frame
+    bool temporal = true; // Reuse the reservoir of the previous frame at the same pixel
+    int spatialNeighbours = 5;
+    float spatialRadius = 20.0F; // In pixels
+    float historyLimit = 20.0F; // The previous frame counts for at most this many times the candidates of a new one
+};
+
+// Weighted reservoir holding one of the point lights of a scene
+struct Reservoir {
+    uint32_t light = 0; // Index in scene.pointLights
+    float weightSum = 0.0F;
+    float count = 0.0F; // Candidates seen so far
+    float weight = 0.0F; // Contribution weight of the light, 1 / target density on average
+
+    // Keeps the candidate with probability w / weightSum
+    bool update(uint32_t candidate, float w, float u);
+};
+
+// Direct light of the point lights at the first hit of every pixel by reservoir-based spatiotemporal importance resampling, as in
+// "Spatiotemporal Reservoir Resampling for Real-Time Ray Tracing with Dynamic Direct Lighting" (Bitterli et al. 2020).
+// Each pixel streams a few candidate lights through a reservoir, merges it with the reservoir the pixel had in the previous frame and
+// with those of a few neighbours. Lights are weighted by their contribution without shadows, so only the light that is left needs a shadow
+// ray and the cost does not grow with the number of lights.
+class ReservoirBuffer {
+public:
+    ReservoirBuffer(const glm::ivec2 &resolution, const ReSTIRSettings &settings);
+
+    const ReSTIRSettings &settings() const;
+
+    // Starts a new frame: the reservoirs of the last one become the temporal history
+    void nextFrame();
+
+    // Candidates and temporal reuse for the first hit of the pixel. meshIdx of the hit is SIZE_MAX if the ray missed.
+    void sample(const Scene &scene, const PointLightTree *tree, const glm::ivec2 &pixel, const Ray &ray, const HitInfo &hitInfo, PathSampler &sampler);
+
+    // Spatial reuse, once sample() was called for all pixels in [lower, upper). Neighbours are only taken from that range.
+    // merged is scratch space for the pixels that were merged, kept by the caller so it is not allocated for every pixel.
+    void reuse(const Scene &scene, const glm::ivec2 &pixel, const glm::ivec2 &lower, const glm::ivec2 &upper, PathSampler &sampler, std::vector<size_t> &merged);
+
+    // Direct light of the point lights at the first hit of the pixel, once reuse() was called for it
+    glm::vec3 shade(const Scene &scene, const BoundingVolumeHierarchy &bvh, const glm::ivec2 &pixel) const;
+
+private:
+    struct Surface {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec3 camera;
+        Material material;
+        float depth;
+        bool valid = false;
+    };
+
+    size_t index(const glm::ivec2 &pixel) const;
+    float target(const Scene &scene, const Surface &surface, uint32_t light) const;
+    bool similar(const Surface &a, const Surface &b) const;
+    void merge(const Scene &scene, const Surface &surface, Reservoir &reservoir, const Reservoir &other, float u) const;
+    void finish(const Scene &scene, const Surface &surface, Reservoir &reservoir) const;
+
+    glm::ivec2 resolution;
+    ReSTIRSettings restirSettings;
+    std::vector<Surface> surfaces;
+    std::vector<Surface> previousSurfaces;
+    std::vector<Reservoir> candidates; // After temporal reuse, the history of the next frame
+    std::vector<Reservoir> reservoirs; // After spatial reuse
+    std::vector<Reservoir> previous; // Candidates of the last frame
+};
@@ -0,0 +1,319 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/common.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include "sampler.h"
+
+static constexpr uint32_t BLUE_NOISE_SIZE = 64;
+static constexpr float BLUE_NOISE_SIGMA = 1.5F;
+
+// Integer hash with good avalanche behaviour (lowbias32 by Chris Wellons)
+static inline uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352DU;
+    x ^= x >> 15;
+    x *= 0x846CA68BU;
+    x ^= x >> 16;
+    return x;
+}
+
+static inline uint32_t hashCombine(uint32_t seed, uint32_t value) {
+    return hash(seed ^ (value + 0x9E3779B9U + (seed << 6) + (seed >> 2)));
+}
+
+static inline uint32_t hashPixel(uint32_t seed, const glm::ivec2 &pixel, uint32_t dimension) {
+    return hashCombine(hashCombine(hashCombine(seed, uint32_t(pixel.x)), uint32_t(pixel.y)), dimension);
+}
+
+// Uses the upper 24 bits so the result is always smaller than 1
+static inline float toFloat(uint32_t x) {
+    return float(x >> 8) * (1.0F / 16777216.0F);
+}
+
+static inline uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00FF00FFU) << 8) | ((x & 0xFF00FF00U) >> 8);
+    x = ((x & 0x0F0F0F0FU) << 4) | ((x & 0xF0F0F0F0U) >> 4);
+    x = ((x & 0x33333333U) << 2) | ((x & 0xCCCCCCCCU) >> 2);
+    x = ((x & 0x55555555U) << 1) | ((x & 0xAAAAAAAAU) >> 1);
+    return x;
+}
+
+// Owen scrambling of the bits of x, see "Practical Hash-based Owen Scrambling" (Burley 2020)
+static inline uint32_t nestedUniformScramble(uint32_t x, uint32_t seed) {
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6C50B47CU;
+    x ^= x * 0xB82F1E52U;
+    x ^= x * 0xC7AFE638U;
+    x ^= x * 0x8D22F6E6U;
+    return reverseBits(x);
+}
+
+// First two dimensions of the Sobol sequence, a (0, 2)-sequence in base 2
+static inline uint32_t sobol0(uint32_t index) {
+    return reverseBits(index);
+}
+
+static inline uint32_t sobol1(uint32_t index) {
+    uint32_t x = 0;
+    for (uint32_t v = 1U << 31; index != 0; index >>= 1, v ^= v >> 1) {
+        if (index & 1) {
+            x ^= v;
+        }
+    }
+    return x;
+}
+
+static float radicalInverse(uint32_t base, uint32_t index) {
+    const float inverse = 1.0F / float(base);
+    float factor = inverse;
+    float x = 0.0F;
+    while (index > 0) {
+        x += float(index % base) * factor;
+        index /= base;
+        factor *= inverse;
+    }
+    return std::min(x, 1.0F - FLT_EPSILON / 2.0F);
+}
+
+static float wrap(float f) {
+    return f >= 1.0F ? f - 1.0F : f;
+}
+
+class RandomSampler : public Sampler {
+public:
+    RandomSampler(uint32_t samplerSeed): seed(samplerSeed) {}
+
+    glm::vec2 get2D(const glm::ivec2 &pixel, uint32_t index, uint32_t dimension) const override {
+        const uint32_t h = hashCombine(hashPixel(seed, pixel, dimension), index);
+        return glm::vec2(toFloat(h), toFloat(hash(h)));
+    }
+
+private:
+    uint32_t seed;
+};
+
+// Halton sequence with a random toroidal shift per pixel (Cranley-Patterson rotation)
+class HaltonSampler : public Sampler {
+public:
+    HaltonSampler(uint32_t samplerSeed): seed(samplerSeed), fallback(samplerSeed) {}
+
+    glm::vec2 get2D(const glm::ivec2 &pixel, uint32_t index, uint32_t dimension) const override {
+        // Higher bases are strongly correlated, there are only a few dimensions per path anyway
+        if (2 * dimension + 1 >= PRIMES.size()) {
+            return fallback.get2D(pixel, index, dimension);
+        }
+
+        const uint32_t h = hashPixel(seed, pixel, dimension);
+        return glm::vec2(
+            wrap(radicalInverse(PRIMES[2 * dimension], index) + toFloat(h)),
+            wrap(radicalInverse(PRIMES[2 * dimension + 1], index) + toFloat(hash(h))));
+    }
+
+private:
+    static constexpr std::array<uint32_t, 16> PRIMES{2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53};
+
+    uint32_t seed;
+    RandomSampler fallback;
+};
+
+// Owen scrambled Sobol (0, 2)-sequence, padded to higher dimensions by shuffling the index per dimension
+class SobolSampler : public Sampler {
+public:
+    SobolSampler(uint32_t samplerSeed): seed(samplerSeed) {}
+
+    glm::vec2 get2D(const glm::ivec2 &pixel, uint32_t index, uint32_t dimension) const override {
+        const uint32_t h = hashPixel(seed, pixel, dimension);
+        const uint32_t shuffled = nestedUniformScramble(index, h);
+        return glm::vec2(
+            toFloat(nestedUniformScramble(sobol0(shuffled), hashCombine(h, 0))),
+            toFloat(nestedUniformScramble(sobol1(shuffled), hashCombine(h, 1))));
+    }
+
+private:
+    uint32_t seed;
+};
+
+// Tileable blue noise threshold mask made with the void and cluster method (Ulichney 1993)
+class BlueNoiseMask {
+public:
+    BlueNoiseMask() {
+        constexpr uint32_t size = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+        energy.resize(size, 0.0F);
+        points.resize(size, false);
+        rank.resize(size, 0.0F);
+
+        // Gaussian weights of the toroidal distance
+        kernel.resize(size);
+        for (uint32_t y = 0; y < BLUE_NOISE_SIZE; y++) {
+            for (uint32_t x = 0; x < BLUE_NOISE_SIZE; x++) {
+                const float dx = float(std::min(x, BLUE_NOISE_SIZE - x));
+                const float dy = float(std::min(y, BLUE_NOISE_SIZE - y));
+                kernel[y * BLUE_NOISE_SIZE + x] = std::exp(-(dx * dx + dy * dy) / (2.0F * BLUE_NOISE_SIGMA * BLUE_NOISE_SIGMA));
+            }
+        }
+
+        // Initial binary pattern: 10% random points, relaxed until the tightest cluster is the largest void
+        const uint32_t initialPoints = size / 10;
+        for (uint32_t i = 0, h = 1; i < initialPoints; h++) {
+            const uint32_t p = hash(h) % size;
+            if (!points[p]) {
+                toggle(p);
+                i++;
+            }
+        }
+        for (uint32_t i = 0; i < size; i++) {
+            const uint32_t cluster = find(true);
+            toggle(cluster);
+            const uint32_t v = find(false);
+            toggle(v);
+            if (v == cluster) {
+                break;
+            }
+        }
+        const std::vector<bool> initial = points;
+        const std::vector<float> initialEnergy = energy;
+
+        // Remove the points of the initial pattern tightest cluster first
+        for (uint32_t r = initialPoints; r > 0; r--) {
+            const uint32_t cluster = find(true);
+            toggle(cluster);
+            rank[cluster] = float(r - 1);
+        }
+        points = initial;
+        energy = initialEnergy;
+        // Fill the largest void until every pixel has a rank
+        for (uint32_t r = initialPoints; r < size; r++) {
+            const uint32_t v = find(false);
+            toggle(v);
+            rank[v] = float(r);
+        }
+
+        for (float &r : rank) {
+            r = (r + 0.5F) / float(size);
+        }
+    }
+
+    float get(uint32_t x, uint32_t y) const {
+        return rank[(y % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE + (x % BLUE_NOISE_SIZE)];
+    }
+
+private:
+    void toggle(uint32_t p) {
+        points[p] = !points[p];
+        const float sign = points[p] ? 1.0F : -1.0F;
+        const uint32_t px = p % BLUE_NOISE_SIZE;
+        const uint32_t py = p / BLUE_NOISE_SIZE;
+        for (uint32_t y = 0; y < BLUE_NOISE_SIZE; y++) {
+            const uint32_t ky = ((y + BLUE_NOISE_SIZE - py) % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE;
+            for (uint32_t x = 0; x < BLUE_NOISE_SIZE; x++) {
+                energy[y * BLUE_NOISE_SIZE + x] += sign * kernel[ky + (x + BLUE_NOISE_SIZE - px) % BLUE_NOISE_SIZE];
+            }
+        }
+    }
+
+    // Highest energy point (tightest cluster) or lowest energy empty pixel (largest void)
+    uint32_t find(bool cluster) const {
+        uint32_t best = 0;
+        float bestEnergy = cluster ? -FLT_MAX : FLT_MAX;
+        for (uint32_t i = 0; i < energy.size(); i++) {
+            if (points[i] != cluster) {
+                continue;
+            }
+            if (cluster ? energy[i] > bestEnergy : energy[i] < bestEnergy) {
+                bestEnergy = energy[i];
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    std::vector<float> kernel;
+    std::vector<float> energy;
+    std::vector<bool> points;
+    std::vector<float> rank;
+};
+
+// The same Sobol points in every pixel, rotated by a blue noise mask. The error of neighbouring pixels is then
+// negatively correlated, which looks much less noisy than white noise at low sample counts.
+class BlueNoiseSampler : public Sampler {
+public:
+    BlueNoiseSampler(uint32_t samplerSeed): seed(samplerSeed) {}
+
+    glm::vec2 get2D(const glm::ivec2 &pixel, uint32_t index, uint32_t dimension) const override {
+        // Computing the mask takes a moment, so it is shared by all renders
+        static const BlueNoiseMask mask;
+
+        // Every dimension uses the mask with a different offset so the dimensions are not correlated
+        const uint32_t h = hashCombine(seed, dimension);
+        const uint32_t x = uint32_t(pixel.x) + (h & 0xFFFFU);
+        const uint32_t y = uint32_t(pixel.y) + (h >> 16);
+        const uint32_t shuffled = nestedUniformScramble(index, h);
+        return glm::vec2(
+            wrap(toFloat(sobol0(shuffled)) + mask.get(x, y)),
+            wrap(toFloat(sobol1(shuffled)) + mask.get(x + BLUE_NOISE_SIZE / 2, y + BLUE_NOISE_SIZE / 2)));
+    }
+
+private:
+    uint32_t seed;
+};
+
+std::unique_ptr<Sampler> makeSampler(SamplerType type, uint32_t seed) {
+    switch (type) {
+        case SamplerType::Halton:
+            return std::make_unique<HaltonSampler>(seed);
+        case SamplerType::Sobol:
+            return std::make_unique<SobolSampler>(seed);
+        case SamplerType::BlueNoise:
+            return std::make_unique<BlueNoiseSampler>(seed);
+        case SamplerType::Random:
+        default:
+            return std::make_unique<RandomSampler>(seed);
+    }
+}
+
+const char *samplerName(SamplerType type) {
+    switch (type) {
+        case SamplerType::Halton:
+            return "halton";
+        case SamplerType::Sobol:
+            return "sobol";
+        case SamplerType::BlueNoise:
+            return "blue-noise";
+        case SamplerType::Random:
+        default:
+            return "random";
+    }
+}
+
+std::optional<SamplerType> samplerFromName(const std::string &name) {
+    for (SamplerType type : {SamplerType::Random, SamplerType::Halton, SamplerType::Sobol, SamplerType::BlueNoise}) {
+        if (name == samplerName(type)) {
+            return type;
+        }
+    }
+    return {};
+}
+
+PathSampler::PathSampler(const Sampler &pathSampler, const glm::ivec2 &pathPixel, uint32_t pathIndex): sampler(&pathSampler), pixel(pathPixel), index(pathIndex) {
+    // Nothing
+}
+
+glm::vec2 PathSampler::next2D() {
+    return sampler->get2D(pixel, index, dimension++);
+}
+
+PathSampler PathSampler::branch(uint32_t i, uint32_t count) const {
+    // index * count + i would overflow after a few bounces and give the branches of different paths the same samples.
+    // The block of the branches is picked by a hash instead, small enough that the branches never wrap around.
+    const uint32_t blocks = UINT32_MAX / std::max(count, 1U);
+    PathSampler out = *this;
+    out.index = hashCombine(index, dimension) % blocks * count + i;
+    return out;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+
+enum class SamplerType {
+    Random,
+    Halton,
+    Sobol,
+    BlueNoise
+};
+
+// Low discrepancy samples in [0, 1)^2. A sample only depends on the pixel, the sample index and the
+// (2D) dimension, so samplers can be shared between threads and renders are reproducible.
+class Sampler {
+public:
+    virtual ~Sampler() = default;
+
+    virtual glm::vec2 get2D(const glm::ivec2 &pixel, uint32_t index, uint32_t dimension) const = 0;
+};
+
+std::unique_ptr<Sampler> makeSampler(SamplerType type, uint32_t seed);
+
+const char *samplerName(SamplerType type);
+
+std::optional<SamplerType> samplerFromName(const std::string &name);
+
+// The samples of one path through a pixel, handed out dimension by dimension.
+class PathSampler {
+public:
+    PathSampler(const Sampler &pathSampler, const glm::ivec2 &pathPixel, uint32_t pathIndex);
+
+    glm::vec2 next2D();
+
+    // Sampler for the i-th of count paths that continue from this one. The branches of a vertex get consecutive sample indices
+    // in a block picked by hashing the index of this path, so they are stratified against each other without running out of indices.
+    PathSampler branch(uint32_t i, uint32_t count) const;
+
+private:
+    const Sampler *sampler;
+    glm::ivec2 pixel;
+    uint32_t index;
+    uint32_t dimension = 0;
+};
@@ -0,0 +1,235 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "mapped_file.h"
+#include "scene_file.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+static constexpr char MAGIC[8] = {'F', 'P', '2', 'S', 'C', 'E', 'N', 'E'};
+static constexpr uint32_t VERSION = 2;
+static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+static constexpr uint64_t ALIGNMENT = 64;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t meshCount;
+    uint64_t meshTable;
+    uint64_t lightCount;
+    uint64_t lightTable;
+    uint64_t fileSize;
+};
+
+struct FileMaterial {
+    float kd[3];
+    float ks[3];
+    float ke[3];
+    float shininess;
+    float transparency;
+};
+
+struct FileMesh {
+    uint64_t positions;
+    uint64_t normals;
+    uint64_t triangles;
+    uint64_t vertexCount;
+    uint64_t triangleCount;
+    float lower[3];
+    float upper[3];
+    FileMaterial material;
+    uint32_t reserved;
+};
+
+struct FileLight {
+    float position[3];
+    float color[3];
+};
+
+// The arrays of a mesh are used in place, so they need to have exactly the layout of the file
+static_assert(sizeof(FileHeader) == 56 && sizeof(FileMesh) == 112 && sizeof(FileLight) == 24);
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float) && std::is_trivially_copyable_v<glm::vec3>);
+static_assert(sizeof(Triangle) == 3 * sizeof(uint32_t) && std::is_trivially_copyable_v<Triangle>);
+
+static bool littleEndian() {
+    const uint32_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+static void copy(const glm::vec3 &v, float out[3]) {
+    out[0] = v.x;
+    out[1] = v.y;
+    out[2] = v.z;
+}
+
+static glm::vec3 vec(const float v[3]) {
+    return glm::vec3(v[0], v[1], v[2]);
+}
+
+bool isSceneFile(const std::filesystem::path &file) {
+    return file.extension() == ".scene";
+}
+
+void writeSceneFile(const Scene &scene, const std::filesystem::path &file) {
+    if (!littleEndian()) {
+        throw std::runtime_error("Scene files can only be written on little-endian machines");
+    }
+    std::ofstream stream(file, std::ios::binary | std::ios::trunc);
+    if (!stream) {
+        throw std::runtime_error("Could not open " + file.string() + " for writing");
+    }
+    uint64_t offset = 0;
+    auto write = [&](const void *data, size_t bytes) {
+        stream.write(static_cast<const char *>(data), std::streamsize(bytes));
+        offset += bytes;
+    };
+    auto align = [&]() {
+        static constexpr char zeros[ALIGNMENT] = {};
+        write(zeros, (ALIGNMENT - offset % ALIGNMENT) % ALIGNMENT);
+    };
+
+    FileHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    write(&header, sizeof(header));
+
+    std::vector<FileMesh> meshes;
+    for (const Mesh &mesh : scene.meshes) {
+        for (const Triangle &triangle : mesh.triangles) {
+            if (triangle.x >= mesh.positions.size() || triangle.y >= mesh.positions.size() || triangle.z >= mesh.positions.size()) {
+                throw std::runtime_error("A triangle refers to a vertex that does not exist, not writing " + file.string());
+            }
+        }
+        if (mesh.normals.size() != mesh.positions.size()) {
+            throw std::runtime_error("A mesh does not have a normal for every vertex, not writing " + file.string());
+        }
+        FileMesh entry{};
+        entry.vertexCount = mesh.positions.size();
+        align();
+        entry.positions = offset;
+        write(mesh.positions.data(), mesh.positions.size() * sizeof(glm::vec3));
+        align();
+        entry.normals = offset;
+        write(mesh.normals.data(), mesh.normals.size() * sizeof(glm::vec3));
+        align();
+        entry.triangles = offset;
+        entry.triangleCount = mesh.triangles.size();
+        write(mesh.triangles.data(), mesh.triangles.size() * sizeof(Triangle));
+        copy(mesh.lower, entry.lower);
+        copy(mesh.upper, entry.upper);
+        copy(mesh.material.kd, entry.material.kd);
+        copy(mesh.material.ks, entry.material.ks);
+        copy(mesh.material.ke, entry.material.ke);
+        entry.material.shininess = mesh.material.shininess;
+        entry.material.transparency = mesh.material.transparency;
+        meshes.push_back(entry);
+    }
+
+    align();
+    header.meshCount = meshes.size();
+    header.meshTable = offset;
+    write(meshes.data(), meshes.size() * sizeof(FileMesh));
+    align();
+    header.lightCount = scene.pointLights.size();
+    header.lightTable = offset;
+    for (const PointLight &light : scene.pointLights) {
+        FileLight entry;
+        copy(light.position, entry.position);
+        copy(light.color, entry.color);
+        write(&entry, sizeof(entry));
+    }
+    header.fileSize = offset;
+
+    stream.seekp(0);
+    stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    if (!stream) {
+        throw std::runtime_error("Could not write " + file.string());
+    }
+}
+
+Scene loadSceneFile(const std::filesystem::path &file, bool trusted) {
+    if (!littleEndian()) {
+        throw std::runtime_error("Scene files can only be read on little-endian machines");
+    }
+    const std::shared_ptr<const MappedFile> mapped = std::make_shared<const MappedFile>(file);
+    const char *data = mapped->data();
+    const uint64_t size = mapped->size();
+    auto invalid = [&](const char *reason) {
+        throw std::runtime_error(file.string() + " is not a valid scene file: " + reason);
+    };
+    auto inFile = [&](uint64_t offset, uint64_t count, uint64_t elementSize) {
+        return offset % ALIGNMENT == 0 && offset <= size && count <= (size - offset) / elementSize;
+    };
+
+    FileHeader header;
+    if (size < sizeof(header)) {
+        invalid("too short");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+        invalid("wrong magic number");
+    }
+    if (header.version != VERSION) {
+        invalid("unsupported version");
+    }
+    if (header.byteOrder != BYTE_ORDER_MARK) {
+        invalid("wrong byte order");
+    }
+    if (header.fileSize != size) {
+        invalid("truncated");
+    }
+    if (!inFile(header.meshTable, header.meshCount, sizeof(FileMesh)) || !inFile(header.lightTable, header.lightCount, sizeof(FileLight))) {
+        invalid("table out of range");
+    }
+
+    Scene scene;
+    const FileMesh *meshes = reinterpret_cast<const FileMesh *>(data + header.meshTable);
+    scene.meshes.resize(header.meshCount);
+    for (size_t i = 0; i < header.meshCount; i++) {
+        const FileMesh &entry = meshes[i];
+        if (!inFile(entry.positions, entry.vertexCount, sizeof(glm::vec3)) || !inFile(entry.normals, entry.vertexCount, sizeof(glm::vec3))
+            || !inFile(entry.triangles, entry.triangleCount, sizeof(Triangle))) {
+            invalid("mesh out of range");
+        }
+        Mesh &mesh = scene.meshes[i];
+        mesh.positions = MeshArray<glm::vec3>::view(reinterpret_cast<const glm::vec3 *>(data + entry.positions), entry.vertexCount, mapped);
+        mesh.normals = MeshArray<glm::vec3>::view(reinterpret_cast<const glm::vec3 *>(data + entry.normals), entry.vertexCount, mapped);
+        mesh.triangles = MeshArray<Triangle>::view(reinterpret_cast<const Triangle *>(data + entry.triangles), entry.triangleCount, mapped);
+        if (!trusted) {
+            const Triangle *triangles = mesh.triangles.data();
+            const uint64_t vertexCount = entry.vertexCount;
+            bool outOfRange = false;
+#ifdef USE_OPENMP
+#pragma omp parallel for reduction(|| : outOfRange)
+#endif
+            for (int64_t t = 0; t < int64_t(entry.triangleCount); t++) {
+                const Triangle &triangle = triangles[t];
+                outOfRange = outOfRange || triangle.x >= vertexCount || triangle.y >= vertexCount || triangle.z >= vertexCount;
+            }
+            if (outOfRange) {
+                invalid("a triangle refers to a vertex that does not exist");
+            }
+        }
+        mesh.lower = vec(entry.lower);
+        mesh.upper = vec(entry.upper);
+        mesh.material.kd = vec(entry.material.kd);
+        mesh.material.ks = vec(entry.material.ks);
+        mesh.material.ke = vec(entry.material.ke);
+        mesh.material.shininess = entry.material.shininess;
+        mesh.material.transparency = entry.material.transparency;
+    }
+    const FileLight *lights = reinterpret_cast<const FileLight *>(data + header.lightTable);
+    for (size_t i = 0; i < header.lightCount; i++) {
+        scene.pointLights.push_back(PointLight{vec(lights[i].position), vec(lights[i].color)});
+    }
+    return scene;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <filesystem>
+#include "scene.h"
+
+// Binary scene files (.scene) hold the meshes, materials and point lights of a scene as arrays that are used in place:
+// loading maps the file into memory and the meshes view it, so nothing is parsed or copied and startup does not depend on the
+// size of the scene. Pages are only read from disk when the renderer touches them.
+//
+// Layout, little-endian, all arrays aligned to 64 bytes:
+//   header: magic "FP2SCENE", version, byte order mark, mesh count and offset of the mesh table, light count and offset of the light table, file size
+//   per mesh: positions (3 floats), normals (3 floats), triangles (3 uint32 indices)
+//   mesh table: offsets of the three arrays, vertex and triangle count, bounding box and material of every mesh
+//   light table: position and color of every point light
+void writeSceneFile(const Scene &scene, const std::filesystem::path &file);
+
+// The meshes keep the file mapped as long as they or copies of them exist. Every triangle index is checked against the vertex count of
+// its mesh, which reads the triangle arrays once; trusted files skip that so only the pages the renderer touches are read.
+[[nodiscard]] Scene loadSceneFile(const std::filesystem::path &file, bool trusted = false);
+
+bool isSceneFile(const std::filesystem::path &file);
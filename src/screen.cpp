@@ -8,11 +8,11 @@ DISABLE_WARNINGS_POP()
 #include "screen.h"
 
 Screen::Screen(const size_t width, const size_t height): width(width), height(height), pixels(width * height, glm::vec3(0.0F)) {
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    // Nothing
+}
+
+glm::ivec2 Screen::resolution() const {
+    return glm::ivec2(int(width), int(height));
 }
 
 void Screen::clear(const glm::vec3 &color) {
@@ -31,6 +31,16 @@ void Screen::setPixel(size_t x, size_t y, const glm::vec3 &color) {
     pixels[i] = glm::vec4(color, 1.0F);
 }
 
+glm::vec3 Screen::getPixel(size_t x, size_t y) const {
+    // Outside the screen
+    if (x >= width || y >= height) {
+        return glm::vec3(0.0F);
+    }
+
+    const size_t i = (height - 1 - y) * width + x;
+    return pixels[i];
+}
+
 void Screen::writeBitmapToFile(const std::filesystem::path &filePath) {
     std::vector<glm::u8vec4> textureData8Bits(pixels.size());
     std::transform(std::begin(pixels), std::end(pixels), std::begin(textureData8Bits),
@@ -44,6 +54,14 @@ void Screen::writeBitmapToFile(const std::filesystem::path &filePath) {
 }
 
 void Screen::draw() {
+    if (texture == 0) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
     glPushAttrib(GL_ALL_ATTRIB_BITS);
     glBindTexture(GL_TEXTURE_2D, texture);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, (GLsizei) width, (GLsizei) height, 0, GL_RGB, GL_FLOAT, pixels.data());
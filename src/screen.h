@@ -2,6 +2,7 @@
 
 #include "disable_all_warnings.h"
 DISABLE_WARNINGS_PUSH()
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 DISABLE_WARNINGS_POP()
 #include <filesystem>
@@ -11,10 +12,14 @@ class Screen {
 public:
     Screen(const size_t width, const size_t height);
 
+    glm::ivec2 resolution() const;
+
     void clear(const glm::vec3 &color);
 
     void setPixel(const size_t x, const size_t y, const glm::vec3 &color);
 
+    glm::vec3 getPixel(const size_t x, const size_t y) const;
+
     void writeBitmapToFile(const std::filesystem::path &filePath);
 
     void draw();
@@ -24,5 +29,6 @@ private:
     size_t height;
     std::vector<glm::vec3> pixels;
     //GLuint texture;
-    uint32_t texture;
+    // Created on the first draw so that a screen can be used without an OpenGL context (headless rendering).
+    uint32_t texture = 0;
 };
@@ -0,0 +1,139 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "illumination.h"
+#include "shadow_maps.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+// Same as the shadow rays in illumination.cpp, occluders this close to the light or the point are ignored
+static constexpr float OFFSET = 0.01F;
+// The centres of the 2x2 texels around a direction are at most this many texel footprints from it
+static constexpr float NEIGHBOURHOOD_TEXELS = 1.5F;
+static constexpr float MAX_SLOPE = 10.0F;
+// Below this many texels per side lights get no map at all rather than a useless one
+static constexpr int MIN_RESOLUTION = 32;
+
+// Face 2 * axis (+ 1 for the negative direction), u and v are the other two coordinates in order, in [-1, 1]
+static glm::vec3 faceDirection(int face, float u, float v) {
+    const int axis = face / 2;
+    glm::vec3 direction;
+    direction[axis] = face % 2 == 0 ? 1.0F : -1.0F;
+    direction[axis == 0 ? 1 : 0] = u;
+    direction[axis == 2 ? 1 : 2] = v;
+    return glm::normalize(direction);
+}
+
+static int directionFace(const glm::vec3 &direction, float &u, float &v) {
+    const glm::vec3 a = glm::abs(direction);
+    const int axis = a.x >= a.y && a.x >= a.z ? 0 : (a.y >= a.z ? 1 : 2);
+    u = direction[axis == 0 ? 1 : 0] / a[axis];
+    v = direction[axis == 2 ? 1 : 2] / a[axis];
+    return 2 * axis + (direction[axis] < 0.0F ? 1 : 0);
+}
+
+ShadowMaps::ShadowMaps(const ShadowMapSettings &settings): mapSettings(settings) {
+    // Nothing
+}
+
+const ShadowMapSettings &ShadowMaps::settings() const {
+    return mapSettings;
+}
+
+int ShadowMaps::resolution() const {
+    return mapResolution;
+}
+
+size_t ShadowMaps::update(const Scene &scene, const BoundingVolumeHierarchy &bvh) {
+    // Share the memory budget between the lights, and leave the lights that do not fit at the minimum resolution without a map
+    const size_t lights = std::max(scene.pointLights.size(), size_t(1));
+    const size_t lightTexels = mapSettings.maxBytes / (lights * 6 * sizeof(Texel));
+    const int resolution = std::max(std::min(mapSettings.resolution, int(std::sqrt(double(lightTexels)))), MIN_RESOLUTION);
+    const size_t faceTexels = size_t(resolution) * size_t(resolution);
+    if (resolution != mapResolution) {
+        maps.clear();
+        mapResolution = resolution;
+    }
+    maps.resize(std::min(scene.pointLights.size(), mapSettings.maxBytes / (6 * faceTexels * sizeof(Texel))));
+    size_t traced = 0;
+    for (size_t i = 0; i < maps.size(); i++) {
+        CubeMap &map = maps[i];
+        const glm::vec3 position = scene.pointLights[i].position;
+        if (!map.texels.empty() && map.position == position) {
+            continue;
+        }
+        map.position = position;
+        map.texels.resize(6 * faceTexels);
+#ifdef USE_OPENMP
+#pragma omp parallel for collapse(2) schedule(dynamic, 4)
+#endif
+        for (int face = 0; face < 6; face++) {
+            for (int y = 0; y < resolution; y++) {
+                for (int x = 0; x < resolution; x++) {
+                    const glm::vec3 direction = faceDirection(face, (float(x) + 0.5F) / float(resolution) * 2.0F - 1.0F, (float(y) + 0.5F) / float(resolution) * 2.0F - 1.0F);
+                    Ray ray = Ray{position + direction * OFFSET, direction};
+                    HitInfo hitInfo;
+                    Texel &texel = map.texels[size_t(face) * faceTexels + size_t(y) * size_t(resolution) + size_t(x)];
+                    texel = trace(bvh, ray, hitInfo, RayType::Shadow) ? Texel{ray.t + OFFSET, uint32_t(hitInfo.meshIdx)} : Texel{FLT_MAX, UINT32_MAX};
+                }
+            }
+        }
+        traced++;
+    }
+    return traced;
+}
+
+ShadowMaps::Visibility ShadowMaps::lookup(size_t light, const glm::vec3 &lightPosition, const glm::vec3 &point, const glm::vec3 &normal, size_t meshIdx) const {
+    if (light >= maps.size() || maps[light].texels.empty() || maps[light].position != lightPosition) {
+        return Visibility::Unknown;
+    }
+    const CubeMap &map = maps[light];
+    const glm::vec3 offset = point - lightPosition;
+    const float distance = glm::length(offset);
+    if (distance <= 2.0F * OFFSET) {
+        return Visibility::Unknown;
+    }
+
+    // A texel covers about 2 / resolution of the distance. Across the neighbourhood the plane of the point moves this much closer to
+    // the light where it is seen at a grazing angle, so its own mesh seen in front of that is another part of the mesh. Anything further
+    // in front than that plus a texel footprint for curvature is an occluder
+    const int resolution = mapResolution;
+    const float footprint = 2.0F * distance / float(resolution);
+    const float cosTheta = std::fabs(glm::dot(normal, offset)) / distance;
+    const float slope = std::min(std::sqrt(std::max(1.0F - cosTheta * cosTheta, 0.0F)) / std::max(cosTheta, 1e-4F), MAX_SLOPE);
+    const float planeBias = NEIGHBOURHOOD_TEXELS * footprint * slope + OFFSET;
+    const float shadowBias = planeBias + footprint;
+
+    float u;
+    float v;
+    const int face = directionFace(offset, u, v);
+    const float sx = (u + 1.0F) / 2.0F * float(resolution) - 0.5F;
+    const float sy = (v + 1.0F) / 2.0F * float(resolution) - 0.5F;
+    const int x0 = std::clamp(int(std::floor(sx)), 0, resolution - 1);
+    const int y0 = std::clamp(int(std::floor(sy)), 0, resolution - 1);
+    const int x1 = std::min(x0 + 1, resolution - 1);
+    const int y1 = std::min(y0 + 1, resolution - 1);
+    const size_t faceOffset = size_t(face) * size_t(resolution) * size_t(resolution);
+
+    int lit = 0;
+    int shadowed = 0;
+    for (const int y : {y0, y1}) {
+        for (const int x : {x0, x1}) {
+            const Texel &texel = map.texels[faceOffset + size_t(y) * size_t(resolution) + size_t(x)];
+            if (texel.depth >= distance - OFFSET || (texel.depth >= distance - planeBias && texel.mesh == uint32_t(meshIdx))) {
+                lit++;
+            } else if (texel.depth < distance - shadowBias) {
+                shadowed++;
+            }
+        }
+    }
+    if (lit == 4) {
+        return Visibility::Lit;
+    }
+    return shadowed == 4 ? Visibility::Shadowed : Visibility::Unknown;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "bounding_volume_hierarchy.h"
+#include "scene.h"
+
+struct ShadowMapSettings {
+    int resolution = 512; // Texels along each side of a cube face, 8 bytes per texel and 6 * resolution^2 texels per light
+    size_t maxBytes = size_t(256) << 20; // Memory of all maps together, the resolution is lowered for scenes with many lights
+};
+
+// Ray traced depth cube maps of the point lights, which answer most shadow queries without traversing the BVH. A point is lit if the 2x2
+// texels around its direction all see something behind it, or its own mesh no closer than the plane of the point would be at those texels,
+// and in shadow if they all see something clearly in front of it. Where they disagree (shadow edges and depth discontinuities) or see
+// something just in front of it (contact shadows, creases of concave meshes), the caller has to trace a shadow ray.
+class ShadowMaps {
+public:
+    enum class Visibility {
+        Lit,
+        Shadowed,
+        Unknown
+    };
+
+    ShadowMaps(const ShadowMapSettings &settings);
+
+    const ShadowMapSettings &settings() const;
+    // Texels along each side of a cube face in the last update, at most settings().resolution
+    int resolution() const;
+
+    // Traces the maps of lights that were added or moved since the last update, returns how many were traced
+    size_t update(const Scene &scene, const BoundingVolumeHierarchy &bvh);
+
+    // Visibility of the light at index light, Unknown if its map is missing (over the memory budget) or was traced for another position
+    Visibility lookup(size_t light, const glm::vec3 &lightPosition, const glm::vec3 &point, const glm::vec3 &normal, size_t meshIdx) const;
+
+private:
+    struct Texel {
+        float depth; // Distance from the light to the first hit, FLT_MAX if there is none
+        uint32_t mesh;
+    };
+
+    struct CubeMap {
+        glm::vec3 position;
+        std::vector<Texel> texels; // Per face, row by row
+    };
+
+    ShadowMapSettings mapSettings;
+    int mapResolution = 0;
+    std::vector<CubeMap> maps;
+};
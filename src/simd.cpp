@@ -0,0 +1,131 @@
+#include <atomic>
+#include "simd.h"
+#if defined(USE_X86_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+static std::atomic<int> limit{int(SimdLevel::AVX512)};
+
+static SimdLevel detect() {
+#if defined(USE_X86_SIMD) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse42 = (info[2] & (1 << 20)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    // The OS has to save the AVX (and AVX-512) registers on context switches
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool avx2 = false;
+    bool avx512 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+        avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+    }
+#elif defined(USE_X86_SIMD)
+    // Also checks that the OS saves the registers
+    __builtin_cpu_init();
+    const bool sse42 = __builtin_cpu_supports("sse4.2");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+    const bool avx512 = __builtin_cpu_supports("avx512f");
+#else
+    const bool sse42 = false;
+    const bool avx2 = false;
+    const bool avx512 = false;
+#endif
+    if (avx512 && avx2 && sse42) {
+        return SimdLevel::AVX512;
+    }
+    if (avx2 && sse42) {
+        return SimdLevel::AVX2;
+    }
+    return sse42 ? SimdLevel::SSE42 : SimdLevel::Scalar;
+}
+
+SimdLevel detectedSimdLevel() {
+    static const SimdLevel detected = detect();
+    return detected;
+}
+
+SimdLevel simdLevel() {
+    const SimdLevel detected = detectedSimdLevel();
+    return int(detected) < limit.load() ? detected : SimdLevel(limit.load());
+}
+
+void limitSimdLevel(SimdLevel level) {
+    limit = int(level);
+}
+
+const char *simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SSE42: return "sse4.2";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+TriangleKernelInfo triangleKernel(size_t count) {
+#ifdef USE_X86_SIMD
+    const SimdLevel level = simdLevel();
+    TriangleKernelInfo kernels[] = {
+        {1, intersectTrianglesScalar},
+        {4, intersectTrianglesSSE42},
+        {8, intersectTrianglesAVX2},
+        {16, intersectTrianglesAVX512}
+    };
+    // A single triangle is tested fastest without vectors
+    size_t best = 0;
+    for (size_t i = 1; i <= size_t(level) && count > kernels[best].width; i++) {
+        best = i;
+    }
+    return kernels[best];
+#else
+    // The vector kernels are only compiled for x86
+    (void) count;
+    return {1, intersectTrianglesScalar};
+#endif
+}
+
+int64_t closestLaneHit(const float *laneT, const int32_t *laneBlock, size_t width, float *t) {
+    int64_t hit = -1;
+    for (size_t lane = 0; lane < width; lane++) {
+        if (laneBlock[lane] < 0) {
+            continue;
+        }
+        const int64_t index = int64_t(laneBlock[lane]) * int64_t(width) + int64_t(lane);
+        if (hit < 0 || laneT[lane] < *t || (laneT[lane] == *t && index > hit)) {
+            *t = laneT[lane];
+            hit = index;
+        }
+    }
+    return hit;
+}
+
+int64_t intersectTrianglesScalar(const float *blocks, size_t blockCount, const float *origin, const float *direction, float *t) {
+    int64_t hit = -1;
+    for (size_t b = 0; b < blockCount; b++) {
+        const float *v = blocks + 9 * b;
+        // Same operations in the same order as the vector kernels
+        const float px = direction[1] * v[8] - direction[2] * v[7];
+        const float py = direction[2] * v[6] - direction[0] * v[8];
+        const float pz = direction[0] * v[7] - direction[1] * v[6];
+        const float det = v[3] * px + v[4] * py + v[5] * pz;
+        const float inv = 1.0F / det;
+        const float tx = origin[0] - v[0];
+        const float ty = origin[1] - v[1];
+        const float tz = origin[2] - v[2];
+        const float u = (tx * px + ty * py + tz * pz) * inv;
+        const float qx = ty * v[5] - tz * v[4];
+        const float qy = tz * v[3] - tx * v[5];
+        const float qz = tx * v[4] - ty * v[3];
+        const float w = (direction[0] * qx + direction[1] * qy + direction[2] * qz) * inv;
+        const float distance = (v[6] * qx + v[7] * qy + v[8] * qz) * inv;
+        if (det != 0.0F && u >= 0.0F && w >= 0.0F && u + w <= 1.0F && distance >= 0.0F && distance <= *t) {
+            *t = distance;
+            hit = int64_t(b);
+        }
+    }
+    return hit;
+}
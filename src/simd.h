@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Vectorized kernels for the hot paths, compiled once per instruction set and picked at runtime, so one binary uses AVX-512 where it is
+// available and still runs on CPUs with only SSE4.2 (or on other architectures, with the scalar kernels).
+// The files of the kernels (simd_*.cpp) are compiled with their instruction set enabled, so they must not include anything with inline
+// functions like glm or the standard containers: the linker could otherwise keep their AVX-512 copy for the whole program.
+enum class SimdLevel {
+    Scalar,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+// Highest level supported by both the CPU (and the OS) and the build, detected on first use
+SimdLevel detectedSimdLevel();
+
+// Level used by bounding volume hierarchies built from now on, the detected one unless limited
+SimdLevel simdLevel();
+
+// Limits the level, e.g. to compare the kernels. Levels above the detected one fall back to it.
+void limitSimdLevel(SimdLevel level);
+
+const char *simdLevelName(SimdLevel level);
+
+// Möller-Trumbore ray/triangle test over blocks of triangles. Every block holds width triangles as 9 arrays of width floats:
+// v0.x, v0.y, v0.z, e1 = v1 - v0 (x, y, z) and e2 = v2 - v0 (x, y, z). Unused lanes are all zero and never hit.
+// Returns the index (block * width + lane) of the closest hit with 0 <= t <= *t and sets *t to its distance, -1 if there is none.
+// Equally close hits go to the higher index, like a loop over the triangles with <=. All kernels give bit identical results.
+using TriangleKernel = int64_t (*)(const float *blocks, size_t blockCount, const float *origin, const float *direction, float *t);
+
+struct TriangleKernelInfo {
+    size_t width;
+    TriangleKernel intersect;
+};
+
+// Kernel to test count triangles with: the narrowest one that fits them all in one block, otherwise the widest one of the current level
+TriangleKernelInfo triangleKernel(size_t count);
+
+// Final step of the vector kernels: the closest of the per-lane hits, each the last block (-1 for none) a lane hit at its t
+int64_t closestLaneHit(const float *laneT, const int32_t *laneBlock, size_t width, float *t);
+
+int64_t intersectTrianglesScalar(const float *blocks, size_t blockCount, const float *origin, const float *direction, float *t);
+#ifdef USE_X86_SIMD
+int64_t intersectTrianglesSSE42(const float *blocks, size_t blockCount, const float *origin, const float *direction, float *t);
+int64_t intersectTrianglesAVX2(const float *blocks, size_t blockCount, const float *origin, const float *direction, float *t);
+int64_t intersectTrianglesAVX512(const float *blocks, size_t blockCount, const float *origin, const float *direction, float *t);
+#endif
@@ -0,0 +1,63 @@
+#ifdef USE_X86_SIMD
+#include <immintrin.h>
+#include "simd.h"
+
+int64_t intersectTrianglesAVX2(const float *blocks, size_t blockCount, const float *origin, const float *direction, float *t) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0F);
+    const __m256 ox = _mm256_set1_ps(origin[0]);
+    const __m256 oy = _mm256_set1_ps(origin[1]);
+    const __m256 oz = _mm256_set1_ps(origin[2]);
+    const __m256 dx = _mm256_set1_ps(direction[0]);
+    const __m256 dy = _mm256_set1_ps(direction[1]);
+    const __m256 dz = _mm256_set1_ps(direction[2]);
+    __m256 bestT = _mm256_set1_ps(*t);
+    __m256i bestBlock = _mm256_set1_epi32(-1);
+
+    for (size_t b = 0; b < blockCount; b++) {
+        const float *v = blocks + 72 * b;
+        const __m256 v0x = _mm256_loadu_ps(v);
+        const __m256 v0y = _mm256_loadu_ps(v + 8);
+        const __m256 v0z = _mm256_loadu_ps(v + 16);
+        const __m256 e1x = _mm256_loadu_ps(v + 24);
+        const __m256 e1y = _mm256_loadu_ps(v + 32);
+        const __m256 e1z = _mm256_loadu_ps(v + 40);
+        const __m256 e2x = _mm256_loadu_ps(v + 48);
+        const __m256 e2y = _mm256_loadu_ps(v + 56);
+        const __m256 e2z = _mm256_loadu_ps(v + 64);
+
+        // p = d x e2, det = e1 . p
+        const __m256 px = _mm256_sub_ps(_mm256_mul_ps(dy, e2z), _mm256_mul_ps(dz, e2y));
+        const __m256 py = _mm256_sub_ps(_mm256_mul_ps(dz, e2x), _mm256_mul_ps(dx, e2z));
+        const __m256 pz = _mm256_sub_ps(_mm256_mul_ps(dx, e2y), _mm256_mul_ps(dy, e2x));
+        const __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+        const __m256 inv = _mm256_div_ps(one, det);
+        // s = o - v0, u = (s . p) / det
+        const __m256 sx = _mm256_sub_ps(ox, v0x);
+        const __m256 sy = _mm256_sub_ps(oy, v0y);
+        const __m256 sz = _mm256_sub_ps(oz, v0z);
+        const __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), inv);
+        // q = s x e1, w = (d . q) / det, t = (e2 . q) / det
+        const __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+        const __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+        const __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+        const __m256 w = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, qx), _mm256_mul_ps(dy, qy)), _mm256_mul_ps(dz, qz)), inv);
+        const __m256 distance = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv);
+
+        __m256 mask = _mm256_cmp_ps(det, zero, _CMP_NEQ_UQ);
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(w, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, w), one, _CMP_LE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, bestT, _CMP_LE_OQ));
+        bestT = _mm256_blendv_ps(bestT, distance, mask);
+        bestBlock = _mm256_blendv_epi8(bestBlock, _mm256_set1_epi32(int(b)), _mm256_castps_si256(mask));
+    }
+
+    alignas(32) float laneT[8];
+    alignas(32) int32_t laneBlock[8];
+    _mm256_store_ps(laneT, bestT);
+    _mm256_store_si256(reinterpret_cast<__m256i *>(laneBlock), bestBlock);
+    return closestLaneHit(laneT, laneBlock, 8, t);
+}
+#endif
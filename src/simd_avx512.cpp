@@ -0,0 +1,63 @@
+#ifdef USE_X86_SIMD
+#include <immintrin.h>
+#include "simd.h"
+
+int64_t intersectTrianglesAVX512(const float *blocks, size_t blockCount, const float *origin, const float *direction, float *t) {
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one = _mm512_set1_ps(1.0F);
+    const __m512 ox = _mm512_set1_ps(origin[0]);
+    const __m512 oy = _mm512_set1_ps(origin[1]);
+    const __m512 oz = _mm512_set1_ps(origin[2]);
+    const __m512 dx = _mm512_set1_ps(direction[0]);
+    const __m512 dy = _mm512_set1_ps(direction[1]);
+    const __m512 dz = _mm512_set1_ps(direction[2]);
+    __m512 bestT = _mm512_set1_ps(*t);
+    __m512i bestBlock = _mm512_set1_epi32(-1);
+
+    for (size_t b = 0; b < blockCount; b++) {
+        const float *v = blocks + 144 * b;
+        const __m512 v0x = _mm512_loadu_ps(v);
+        const __m512 v0y = _mm512_loadu_ps(v + 16);
+        const __m512 v0z = _mm512_loadu_ps(v + 32);
+        const __m512 e1x = _mm512_loadu_ps(v + 48);
+        const __m512 e1y = _mm512_loadu_ps(v + 64);
+        const __m512 e1z = _mm512_loadu_ps(v + 80);
+        const __m512 e2x = _mm512_loadu_ps(v + 96);
+        const __m512 e2y = _mm512_loadu_ps(v + 112);
+        const __m512 e2z = _mm512_loadu_ps(v + 128);
+
+        // p = d x e2, det = e1 . p
+        const __m512 px = _mm512_sub_ps(_mm512_mul_ps(dy, e2z), _mm512_mul_ps(dz, e2y));
+        const __m512 py = _mm512_sub_ps(_mm512_mul_ps(dz, e2x), _mm512_mul_ps(dx, e2z));
+        const __m512 pz = _mm512_sub_ps(_mm512_mul_ps(dx, e2y), _mm512_mul_ps(dy, e2x));
+        const __m512 det = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(e1x, px), _mm512_mul_ps(e1y, py)), _mm512_mul_ps(e1z, pz));
+        const __m512 inv = _mm512_div_ps(one, det);
+        // s = o - v0, u = (s . p) / det
+        const __m512 sx = _mm512_sub_ps(ox, v0x);
+        const __m512 sy = _mm512_sub_ps(oy, v0y);
+        const __m512 sz = _mm512_sub_ps(oz, v0z);
+        const __m512 u = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(sx, px), _mm512_mul_ps(sy, py)), _mm512_mul_ps(sz, pz)), inv);
+        // q = s x e1, w = (d . q) / det, t = (e2 . q) / det
+        const __m512 qx = _mm512_sub_ps(_mm512_mul_ps(sy, e1z), _mm512_mul_ps(sz, e1y));
+        const __m512 qy = _mm512_sub_ps(_mm512_mul_ps(sz, e1x), _mm512_mul_ps(sx, e1z));
+        const __m512 qz = _mm512_sub_ps(_mm512_mul_ps(sx, e1y), _mm512_mul_ps(sy, e1x));
+        const __m512 w = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, qx), _mm512_mul_ps(dy, qy)), _mm512_mul_ps(dz, qz)), inv);
+        const __m512 distance = _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(e2x, qx), _mm512_mul_ps(e2y, qy)), _mm512_mul_ps(e2z, qz)), inv);
+
+        __mmask16 mask = _mm512_cmp_ps_mask(det, zero, _CMP_NEQ_UQ);
+        mask &= _mm512_cmp_ps_mask(u, zero, _CMP_GE_OQ);
+        mask &= _mm512_cmp_ps_mask(w, zero, _CMP_GE_OQ);
+        mask &= _mm512_cmp_ps_mask(_mm512_add_ps(u, w), one, _CMP_LE_OQ);
+        mask &= _mm512_cmp_ps_mask(distance, zero, _CMP_GE_OQ);
+        mask &= _mm512_cmp_ps_mask(distance, bestT, _CMP_LE_OQ);
+        bestT = _mm512_mask_blend_ps(mask, bestT, distance);
+        bestBlock = _mm512_mask_blend_epi32(mask, bestBlock, _mm512_set1_epi32(int(b)));
+    }
+
+    alignas(64) float laneT[16];
+    alignas(64) int32_t laneBlock[16];
+    _mm512_store_ps(laneT, bestT);
+    _mm512_store_si512(laneBlock, bestBlock);
+    return closestLaneHit(laneT, laneBlock, 16, t);
+}
+#endif
@@ -0,0 +1,63 @@
+#ifdef USE_X86_SIMD
+#include <immintrin.h>
+#include "simd.h"
+
+int64_t intersectTrianglesSSE42(const float *blocks, size_t blockCount, const float *origin, const float *direction, float *t) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0F);
+    const __m128 ox = _mm_set1_ps(origin[0]);
+    const __m128 oy = _mm_set1_ps(origin[1]);
+    const __m128 oz = _mm_set1_ps(origin[2]);
+    const __m128 dx = _mm_set1_ps(direction[0]);
+    const __m128 dy = _mm_set1_ps(direction[1]);
+    const __m128 dz = _mm_set1_ps(direction[2]);
+    __m128 bestT = _mm_set1_ps(*t);
+    __m128i bestBlock = _mm_set1_epi32(-1);
+
+    for (size_t b = 0; b < blockCount; b++) {
+        const float *v = blocks + 36 * b;
+        const __m128 v0x = _mm_loadu_ps(v);
+        const __m128 v0y = _mm_loadu_ps(v + 4);
+        const __m128 v0z = _mm_loadu_ps(v + 8);
+        const __m128 e1x = _mm_loadu_ps(v + 12);
+        const __m128 e1y = _mm_loadu_ps(v + 16);
+        const __m128 e1z = _mm_loadu_ps(v + 20);
+        const __m128 e2x = _mm_loadu_ps(v + 24);
+        const __m128 e2y = _mm_loadu_ps(v + 28);
+        const __m128 e2z = _mm_loadu_ps(v + 32);
+
+        // p = d x e2, det = e1 . p
+        const __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+        const __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+        const __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+        const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+        const __m128 inv = _mm_div_ps(one, det);
+        // s = o - v0, u = (s . p) / det
+        const __m128 sx = _mm_sub_ps(ox, v0x);
+        const __m128 sy = _mm_sub_ps(oy, v0y);
+        const __m128 sz = _mm_sub_ps(oz, v0z);
+        const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inv);
+        // q = s x e1, w = (d . q) / det, t = (e2 . q) / det
+        const __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+        const __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+        const __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+        const __m128 w = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inv);
+        const __m128 distance = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inv);
+
+        __m128 mask = _mm_cmpneq_ps(det, zero);
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(w, zero));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, w), one));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(distance, zero));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(distance, bestT));
+        bestT = _mm_blendv_ps(bestT, distance, mask);
+        bestBlock = _mm_blendv_epi8(bestBlock, _mm_set1_epi32(int(b)), _mm_castps_si128(mask));
+    }
+
+    alignas(16) float laneT[4];
+    alignas(16) int32_t laneBlock[4];
+    _mm_store_ps(laneT, bestT);
+    _mm_store_si128(reinterpret_cast<__m128i *>(laneBlock), bestBlock);
+    return closestLaneHit(laneT, laneBlock, 4, t);
+}
+#endif
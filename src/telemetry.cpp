@@ -0,0 +1,108 @@
+#include <iostream>
+#include <stdexcept>
+#include "telemetry.h"
+#ifdef USE_OPENMP
+#include <omp.h>
+#endif
+
+double ProgressSample::fraction() const {
+    return totalPixels > 0 ? double(pixels) / double(totalPixels) : 1.0;
+}
+
+double ProgressSample::etaSeconds() const {
+    return pixels > 0 ? seconds * double(totalPixels - pixels) / double(pixels) : 0.0;
+}
+
+double ProgressSample::raysPerSecond() const {
+    return seconds > 0.0 ? double(rays) / seconds : 0.0;
+}
+
+double ProgressSample::samplesPerSecond() const {
+    return seconds > 0.0 ? double(samples) / seconds : 0.0;
+}
+
+static size_t threadSlots() {
+#ifdef USE_OPENMP
+    return size_t(omp_get_max_threads());
+#else
+    return 1;
+#endif
+}
+
+RenderProgress::RenderProgress(size_t pixelCount, size_t pathsPerPixel) : threads(threadSlots()), totalPixels(pixelCount), samplesPerPixel(pathsPerPixel), start(std::chrono::steady_clock::now()) {}
+
+void RenderProgress::add(size_t pixels, size_t rays) {
+#ifdef USE_OPENMP
+    const size_t thread = size_t(omp_get_thread_num());
+#else
+    const size_t thread = 0;
+#endif
+    // Only shared if there are more threads than at the start
+    Counters &counters = threads[thread % threads.size()];
+    counters.pixels.fetch_add(pixels, std::memory_order_relaxed);
+    counters.rays.fetch_add(rays, std::memory_order_relaxed);
+}
+
+ProgressSample RenderProgress::sample() const {
+    ProgressSample sample{std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), 0, totalPixels, 0, 0};
+    for (const Counters &counters : threads) {
+        sample.pixels += counters.pixels.load(std::memory_order_relaxed);
+        sample.rays += counters.rays.load(std::memory_order_relaxed);
+    }
+    sample.samples = sample.pixels * samplesPerPixel;
+    return sample;
+}
+
+ProgressReporter::ProgressReporter(const RenderProgress &counters, const ProgressOutput &reportOutput) : progress(counters), output(reportOutput) {
+    if (!output.log.empty()) {
+        log.open(output.log);
+        if (!log) {
+            throw std::runtime_error("Progress log " + output.log.string() + " could not be opened.");
+        }
+    }
+    thread = std::thread([this]() { run(); });
+}
+
+ProgressReporter::~ProgressReporter() {
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    stopped.notify_one();
+    thread.join();
+}
+
+void ProgressReporter::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopped.wait_for(lock, output.interval, [this]() { return stop; })) {
+        report(progress.sample(), false);
+    }
+    report(progress.sample(), true);
+}
+
+void ProgressReporter::report(const ProgressSample &sample, bool last) {
+    if (output.console) {
+        std::cerr << "\r\033[2K" << output.label << ": " << 100.0 * sample.fraction() << "%, " << sample.raysPerSecond() / 1e6 << " Mrays/s, "
+                  << sample.samplesPerSecond() << " samples/s";
+        if (last) {
+            std::cerr << ", " << sample.seconds << " s" << std::endl;
+        } else {
+            std::cerr << ", ETA " << sample.etaSeconds() << " s" << std::flush;
+        }
+    }
+    if (log.is_open()) {
+        log << "{\"seconds\": " << sample.seconds << ", "
+            << "\"pixels\": " << sample.pixels << ", "
+            << "\"total_pixels\": " << sample.totalPixels << ", "
+            << "\"progress\": " << sample.fraction() << ", "
+            << "\"eta_seconds\": " << sample.etaSeconds() << ", "
+            << "\"rays\": " << sample.rays << ", "
+            << "\"rays_per_second\": " << sample.raysPerSecond() << ", "
+            << "\"samples\": " << sample.samples << ", "
+            << "\"samples_per_second\": " << sample.samplesPerSecond() << ", "
+            << "\"done\": " << (last ? "true" : "false") << "}" << std::endl;
+    }
+    if (output.callback) {
+        output.callback(sample);
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What a render has done so far
+struct ProgressSample {
+    double seconds; // Since the render started
+    size_t pixels;
+    size_t totalPixels;
+    size_t samples; // Paths started at the camera, pixels times the paths per pixel
+    size_t rays;
+
+    double fraction() const;
+    // Time left if the render goes on at its average speed, 0 before the first pixel is done
+    double etaSeconds() const;
+    double raysPerSecond() const;
+    double samplesPerSecond() const;
+};
+
+// Where a reporter sends the progress
+struct ProgressOutput {
+    bool console = true; // One line on stderr, updated in place
+    std::string label = "Progress"; // Start of the console line
+    std::filesystem::path log; // A JSON object per line and interval, not written if empty
+    std::function<void(const ProgressSample &)> callback; // Called from the reporter thread, e.g. for the window
+    std::chrono::milliseconds interval { 250 };
+};
+
+// Counters of a render with a cache line per thread, so the render threads never write to the same line.
+class RenderProgress {
+public:
+    RenderProgress(size_t pixelCount, size_t pathsPerPixel);
+
+    // Called by the render threads when they finished some pixels, e.g. a row
+    void add(size_t pixels, size_t rays);
+
+    ProgressSample sample() const;
+
+private:
+    struct alignas(64) Counters {
+        std::atomic<size_t> pixels { 0 };
+        std::atomic<size_t> rays { 0 };
+    };
+
+    std::vector<Counters> threads;
+    size_t totalPixels;
+    size_t samplesPerPixel;
+    std::chrono::steady_clock::time_point start;
+};
+
+// Reads the counters on a thread of its own at a fixed interval until it is destroyed, and once more at the end.
+class ProgressReporter {
+public:
+    ProgressReporter(const RenderProgress &counters, const ProgressOutput &reportOutput);
+    ~ProgressReporter();
+
+    ProgressReporter(const ProgressReporter &) = delete;
+    ProgressReporter &operator=(const ProgressReporter &) = delete;
+
+private:
+    void run();
+    void report(const ProgressSample &sample, bool last);
+
+    const RenderProgress &progress;
+    ProgressOutput output;
+    std::ofstream log;
+    std::mutex mutex;
+    std::condition_variable stopped;
+    bool stop = false;
+    std::thread thread;
+};
@@ -0,0 +1,376 @@
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/geometric.hpp>
+DISABLE_WARNINGS_POP()
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "profiler.h"
+#include "wavefront.h"
+
+static constexpr float PI = 3.14159265358979323846F;
+static constexpr float OFFSET = 0.01F;
+static constexpr size_t INVALID_INDEX = SIZE_MAX;
+// Vertices, point light terms and next-event estimates of the path trees of one batch
+static constexpr size_t WAVEFRONT_BATCH_ENTRIES = 1 << 20;
+static constexpr size_t WAVEFRONT_MAX_BATCH = 4096;
+
+// Depth of the hemisphere samples of a vertex, as in get_color
+static size_t sampleDepth(const ShadingData &data, size_t depth) {
+    const size_t next = depth + 1;
+    return data.max_traces < 2 ? next : std::max(next, size_t(data.max_traces) - 2);
+}
+
+// Entries of the path tree below a ray of this depth if every ray hits a mirror
+static size_t treeSize(const ShadingData &data, size_t depth) {
+    if (depth >= size_t(std::max(data.max_traces, 0))) {
+        return 0;
+    }
+    const size_t samples = size_t(std::max(data.samples, 0));
+    return 1 + size_t(std::max(data.light_samples, 1)) + treeSize(data, depth + 1) + samples * (1 + treeSize(data, sampleDepth(data, depth)));
+}
+
+WavefrontTracer::WavefrontTracer(const Scene &tracedScene, const BoundingVolumeHierarchy &sceneBvh, const ShadingData &shadingData, const glm::vec3 &cameraPosition)
+    : scene(&tracedScene), bvh(&sceneBvh), data(&shadingData), camera(cameraPosition) {
+    areaLights = shadingData.lights != nullptr && !shadingData.lights->empty();
+    pointLightTree = shadingData.point_lights != nullptr && tracedScene.pointLights.size() > size_t(shadingData.light_samples);
+}
+
+bool WavefrontTracer::supports(const ShadingData &data) {
+    return !data.debug && data.photons == nullptr && data.irradiance_cache == nullptr && !data.guide_training;
+}
+
+size_t WavefrontTracer::batchSize(const ShadingData &data) {
+    return std::clamp(WAVEFRONT_BATCH_ENTRIES / std::max(treeSize(data, 0), size_t(1)), size_t(1), WAVEFRONT_MAX_BATCH);
+}
+
+void WavefrontTracer::trace(std::vector<CameraPath> &paths, std::vector<glm::vec3> &colors, std::vector<PrimaryHit> &primaries) {
+    origins.clear();
+    directions.clear();
+    ts.clear();
+    samplers.clear();
+    eyes.clear();
+    parents.clear();
+    types.clear();
+    depths.clear();
+    meshes.clear();
+    normals.clear();
+    pdfs.clear();
+    sampleIndices.clear();
+    mirrors.clear();
+    firstChildren.clear();
+    childCounts.clear();
+    firstLights.clear();
+    lightCounts.clear();
+    firstEstimates.clear();
+    radiance.clear();
+    terms.clear();
+    rays.clear();
+    next.clear();
+
+    // Camera rays are the first vertices, in the order of the paths
+    primaries.assign(paths.size(), PrimaryHit{});
+    for (size_t i = 0; i < paths.size(); i++) {
+        primaries[i].hitInfo.meshIdx = INVALID_INDEX;
+        primaries[i].direct = glm::vec3(0.0F);
+        primaries[i].indirect = glm::vec3(0.0F);
+        const uint32_t vertex = addVertex(paths[i].ray, paths[i].sampler, camera, NONE, VertexType::Camera, 0);
+        if (data->max_traces > 0) {
+            rays.push_back(vertex);
+        }
+    }
+
+    // Every wave traces the rays spawned by the previous one
+    while (!rays.empty()) {
+        extend(paths, primaries);
+        shade(paths);
+        shadow();
+        rays.swap(next);
+        next.clear();
+    }
+
+    resolve(paths, colors, primaries);
+}
+
+uint32_t WavefrontTracer::addVertex(const Ray &ray, const PathSampler &sampler, const glm::vec3 &eye, uint32_t parent, VertexType type, size_t depth) {
+    const uint32_t vertex = uint32_t(origins.size());
+    origins.push_back(ray.origin);
+    directions.push_back(ray.direction);
+    ts.push_back(ray.t);
+    samplers.push_back(sampler);
+    eyes.push_back(eye);
+    parents.push_back(parent);
+    types.push_back(type);
+    depths.push_back(uint32_t(depth));
+    meshes.push_back(INVALID_INDEX);
+    normals.push_back(glm::vec3(0.0F));
+    pdfs.push_back(0.0F);
+    sampleIndices.push_back(NONE);
+    mirrors.push_back(NONE);
+    firstChildren.push_back(0);
+    childCounts.push_back(0);
+    firstLights.push_back(0);
+    lightCounts.push_back(0);
+    firstEstimates.push_back(0);
+    radiance.push_back(glm::vec3(0.0F));
+    return vertex;
+}
+
+void WavefrontTracer::addTerm(const glm::vec3 &value, const Ray *shadow) {
+    if (shadow != nullptr) {
+        shadowOrigins.push_back(shadow->origin);
+        shadowDirections.push_back(shadow->direction);
+        shadowLengths.push_back(shadow->t);
+        shadowTerms.push_back(uint32_t(terms.size()));
+    }
+    terms.push_back(value);
+}
+
+// The same visibility as point_light_shadow, with the shadow ray left to the shadow stage
+void WavefrontTracer::addPointLight(uint32_t vertex, size_t light, const glm::vec3 &point, const glm::vec3 &value) {
+    const glm::vec3 &position = scene->pointLights[light].position;
+    const glm::vec3 normal = normals[vertex];
+    if (data->shadow_maps != nullptr && glm::dot(position - point, normal) >= 0.0F) {
+        const ShadowMaps::Visibility visibility = data->shadow_maps->lookup(light, position, point, normal, meshes[vertex]);
+        if (visibility != ShadowMaps::Visibility::Unknown) {
+            addTerm(visibility == ShadowMaps::Visibility::Shadowed ? glm::vec3(0.0F) : value, nullptr);
+            return;
+        }
+    }
+    Ray ray;
+    if (!shadow_ray(point, position, normal, ray)) {
+        addTerm(glm::vec3(0.0F), nullptr);
+    } else {
+        addTerm(value, &ray);
+    }
+}
+
+void WavefrontTracer::extend(std::vector<CameraPath> &paths, std::vector<PrimaryHit> &primaries) {
+    PROFILE_SCOPE("extend");
+    hits.clear();
+    for (const uint32_t vertex : rays) {
+        const bool cameraVertex = types[vertex] == VertexType::Camera;
+        HitInfo hitInfo;
+        bool hit;
+        if (cameraVertex && paths[vertex].knownHit != nullptr) {
+            hitInfo = *paths[vertex].knownHit;
+            hit = hitInfo.meshIdx != INVALID_INDEX;
+        } else {
+            Ray ray{origins[vertex], directions[vertex], ts[vertex]};
+            const RayType type = cameraVertex ? RayType::Camera : types[vertex] == VertexType::Mirror ? RayType::Reflection : RayType::Indirect;
+            hit = ::trace(*bvh, ray, hitInfo, type);
+            ts[vertex] = ray.t;
+        }
+        if (cameraVertex) {
+            paths[vertex].ray.t = ts[vertex];
+        }
+        if (!hit) {
+            complete(vertex);
+            continue;
+        }
+        meshes[vertex] = hitInfo.meshIdx;
+        normals[vertex] = hitInfo.normal;
+        if (cameraVertex) {
+            primaries[vertex].hitInfo = hitInfo;
+        }
+        hits.push_back(vertex);
+    }
+}
+
+void WavefrontTracer::shade(const std::vector<CameraPath> &paths) {
+    PROFILE_SCOPE("shade");
+    // One material after the other
+    std::stable_sort(hits.begin(), hits.end(), [&](uint32_t a, uint32_t b) { return meshes[a] < meshes[b]; });
+
+    for (const uint32_t vertex : hits) {
+        const Material &material = scene->meshes[meshes[vertex]].material;
+        const glm::vec3 normal = normals[vertex];
+        const glm::vec3 direction = directions[vertex];
+        const glm::vec3 position = origins[vertex] + direction * ts[vertex];
+
+        // Point lights as in shader(), unless they were resampled for the first hit already
+        const bool resampled = types[vertex] == VertexType::Camera && paths[vertex].direct != nullptr;
+        firstLights[vertex] = uint32_t(terms.size());
+        if (resampled) {
+            // Added by resolve()
+        } else if (pointLightTree) {
+            for (int i = 0; i < data->light_samples; i++) {
+                float pdf;
+                const size_t light = data->point_lights->sample(position, normal, samplers[vertex].next2D().x, pdf);
+                if (pdf > 0.0F) {
+                    const glm::vec3 value = point_light_contribution(position, normal, material, scene->pointLights[light], eyes[vertex]);
+                    addPointLight(vertex, light, position, value / (pdf * float(data->light_samples)));
+                }
+            }
+        } else {
+            for (size_t light = 0; light < scene->pointLights.size(); light++) {
+                addPointLight(vertex, light, position, point_light_contribution(position, normal, material, scene->pointLights[light], eyes[vertex]));
+            }
+        }
+        lightCounts[vertex] = uint32_t(terms.size()) - firstLights[vertex];
+
+        // The mirror ray continues with the sampler of this vertex
+        const size_t depth = depths[vertex] + 1;
+        if (glm::length(material.ks) > 0.0F && depth < size_t(data->max_traces)) {
+            const glm::vec3 reflectionDir = glm::normalize(direction - 2.0F * glm::dot(direction, normal) * normal);
+            const uint32_t mirror = addVertex(Ray{position + reflectionDir * OFFSET, reflectionDir}, samplers[vertex], position, vertex, VertexType::Mirror, depth);
+            mirrors[vertex] = mirror;
+            next.push_back(mirror);
+        } else {
+            complete(vertex);
+        }
+    }
+}
+
+void WavefrontTracer::complete(uint32_t vertex) {
+    if (meshes[vertex] != INVALID_INDEX) {
+        const glm::vec3 normal = normals[vertex];
+        const glm::vec3 position = origins[vertex] + directions[vertex] * ts[vertex];
+        const size_t depth = sampleDepth(*data, depths[vertex]);
+        const bool traced = depth < size_t(data->max_traces);
+        // ks is reflected by the mirror ray, the same diffuse lobe as in get_color
+        const BSDF bsdf = BSDF{Material{}, normal, -directions[vertex]};
+        const DirectionSampler sampler = DirectionSampler{bsdf, data->guide, position, normal};
+
+        firstEstimates[vertex] = uint32_t(terms.size());
+        firstChildren[vertex] = uint32_t(origins.size());
+        for (int i = 0; i < data->samples; i++) {
+            PathSampler sampleSampler = samplers[vertex].branch(uint32_t(i), uint32_t(data->samples));
+            const BSDFSample sample = sampler.sample(sampleSampler.next2D());
+            const glm::vec3 dir = sample.direction;
+            if (areaLights) {
+                glm::vec3 estimate;
+                glm::vec3 light;
+                Ray ray;
+                if (!area_light_estimate(*data, position, normal, sampleSampler, traced ? &sampler : nullptr, estimate, light) || !shadow_ray(position, light, normal, ray)) {
+                    addTerm(glm::vec3(0.0F), nullptr);
+                } else {
+                    addTerm(estimate, &ray);
+                }
+            }
+
+            // Samples below the surface and samples that would be too deep bring no light
+            if (sample.pdf <= 0.0F || !traced) {
+                continue;
+            }
+            const uint32_t child = addVertex(Ray{position + dir * OFFSET, dir}, sampleSampler, position, vertex, VertexType::Sample, depth);
+            pdfs[child] = sample.pdf;
+            sampleIndices[child] = uint32_t(i);
+            childCounts[vertex]++;
+            next.push_back(child);
+        }
+        if (data->samples == 0 && areaLights) {
+            // Without hemisphere samples the vertex estimates the area lights with its own sampler
+            glm::vec3 estimate;
+            glm::vec3 light;
+            Ray ray;
+            if (!area_light_estimate(*data, position, normal, samplers[vertex], nullptr, estimate, light) || !shadow_ray(position, light, normal, ray)) {
+                addTerm(glm::vec3(0.0F), nullptr);
+            } else {
+                addTerm(estimate, &ray);
+            }
+        }
+    }
+
+    if (types[vertex] == VertexType::Mirror) {
+        const uint32_t parent = parents[vertex];
+        samplers[parent] = samplers[vertex];
+        complete(parent);
+    }
+}
+
+void WavefrontTracer::shadow() {
+    PROFILE_SCOPE("shadow rays");
+    for (size_t i = 0; i < shadowTerms.size(); i++) {
+        Ray ray{shadowOrigins[i], shadowDirections[i], shadowLengths[i]};
+        HitInfo hitInfo;
+        if (::trace(*bvh, ray, hitInfo, RayType::Shadow)) {
+            terms[shadowTerms[i]] = glm::vec3(0.0F);
+        }
+    }
+    shadowOrigins.clear();
+    shadowDirections.clear();
+    shadowLengths.clear();
+    shadowTerms.clear();
+}
+
+// get_color from the leaves up, every sum in the same order
+void WavefrontTracer::resolve(const std::vector<CameraPath> &paths, std::vector<glm::vec3> &colors, std::vector<PrimaryHit> &primaries) {
+    PROFILE_SCOPE("resolve");
+    for (size_t vertex = origins.size(); vertex-- > 0;) {
+        const size_t mesh = meshes[vertex];
+        if (mesh == INVALID_INDEX) {
+            radiance[vertex] = glm::vec3(0.0F);
+            continue;
+        }
+        const Material &material = scene->meshes[mesh].material;
+        const glm::vec3 normal = normals[vertex];
+        const bool cameraVertex = types[vertex] == VertexType::Camera;
+
+        glm::vec3 direct = glm::vec3(0.0F);
+        if (cameraVertex && paths[vertex].direct != nullptr) {
+            direct = *paths[vertex].direct;
+        } else {
+            for (uint32_t i = 0; i < lightCounts[vertex]; i++) {
+                direct += terms[firstLights[vertex] + i];
+            }
+            direct = glm::clamp(direct, 0.0F, 1.0F);
+        }
+        if (glm::length(material.ks) > 0.0F) {
+            const glm::vec3 reflColor = mirrors[vertex] != NONE ? radiance[mirrors[vertex]] : glm::vec3(0.0F);
+            direct += material.ks * reflColor;
+        }
+
+        glm::vec3 emitted = glm::vec3(0.0F);
+        glm::vec3 indirect = glm::vec3(0.0F);
+        if (data->samples > 0) {
+            const BSDF bsdf = BSDF{Material{}, normal, -directions[vertex]};
+            uint32_t child = firstChildren[vertex];
+            const uint32_t end = child + childCounts[vertex];
+            for (int i = 0; i < data->samples; i++) {
+                if (areaLights) {
+                    emitted += terms[firstEstimates[vertex] + uint32_t(i)];
+                }
+                if (child == end || sampleIndices[child] != uint32_t(i)) {
+                    continue;
+                }
+                const glm::vec3 dir = directions[child];
+                const float pdf = pdfs[child];
+                const size_t childMesh = meshes[child];
+                glm::vec3 color = radiance[child];
+                const float factor = glm::dot(normal, dir);
+                if (childMesh != INVALID_INDEX && glm::length(scene->meshes[childMesh].material.ke) > 0.0F) {
+                    float weight = 1.0F;
+                    if (areaLights) {
+                        const float light_pdf = data->lights->pdf(childMesh) * ts[child] * ts[child] / std::fabs(glm::dot(normals[child], dir));
+                        weight = mis_weight(pdf, light_pdf);
+                    }
+                    emitted += weight * scene->meshes[childMesh].material.ke * factor / pdf;
+                }
+                if (childMesh != INVALID_INDEX) {
+                    const auto &[scalar, offset] = (*data->transforms)[childMesh][mesh];
+                    color = scalar * color + offset;
+                }
+                indirect += bsdf.eval(dir) * color / pdf;
+                child++;
+            }
+        }
+        if (data->samples != 0) {
+            indirect /= data->samples;
+            indirect *= PI;
+            emitted /= data->samples;
+        } else if (areaLights) {
+            emitted = terms[firstEstimates[vertex]];
+        }
+        direct += material.kd * emitted;
+
+        const glm::vec3 ownEmission = types[vertex] != VertexType::Sample ? material.ke : glm::vec3(0.0F);
+        if (cameraVertex) {
+            primaries[vertex].direct = direct / PI + ownEmission;
+            primaries[vertex].indirect = indirect / PI;
+        }
+        radiance[vertex] = glm::clamp((direct + indirect) / PI + ownEmission, 0.0F, 1.0F);
+    }
+
+    colors.assign(radiance.begin(), radiance.begin() + std::ptrdiff_t(paths.size()));
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "disable_all_warnings.h"
+DISABLE_WARNINGS_PUSH()
+#include <glm/vec3.hpp>
+DISABLE_WARNINGS_POP()
+#include <cstdint>
+#include <vector>
+#include "bounding_volume_hierarchy.h"
+#include "illumination.h"
+#include "sampler.h"
+#include "scene.h"
+
+// The paths of get_color traced breadth first, in the style of "Megakernels Considered Harmful" (Laine et al. 2013).
+// get_color follows one path tree per pixel depth first. This tracer keeps the vertices of the path trees of a whole batch of pixels in
+// a structure of arrays and runs one stage at a time over all of them: extend traces the queued rays, shade evaluates the point lights
+// and spawns the mirror rays (sorted by mesh, so one material is shaded after the other), complete spawns the hemisphere samples and
+// their next-event estimation, and shadow traces all shadow rays of the wave. Once no rays are left the colors are combined from the
+// leaves up, in the order get_color adds them, so the image is bit-identical to get_color with the same samples.
+// Mirror rays share the sampler of their vertex, so a vertex only spawns its samples once its mirror path is done.
+// Photon mapping, the irradiance cache, training path guiding and debug rays are not supported, see supports().
+class WavefrontTracer {
+public:
+    // Camera ray of one pixel. The first hit may already be known, the ray must then end at the hit. The light of the point lights at
+    // the first hit may have been resampled for the whole image already.
+    struct CameraPath {
+        Ray ray;
+        PathSampler sampler;
+        const HitInfo *knownHit = nullptr;
+        const glm::vec3 *direct = nullptr;
+    };
+
+    WavefrontTracer(const Scene &tracedScene, const BoundingVolumeHierarchy &sceneBvh, const ShadingData &shadingData, const glm::vec3 &cameraPosition);
+
+    static bool supports(const ShadingData &data);
+
+    // Pixels per batch, so that a batch of full path trees stays within a few hundred thousand vertices and shadow rays
+    static size_t batchSize(const ShadingData &data);
+
+    // Light arriving through the camera rays, the same as get_color. The rays end at their first hit afterwards.
+    void trace(std::vector<CameraPath> &paths, std::vector<glm::vec3> &colors, std::vector<PrimaryHit> &primaries);
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    enum class VertexType : uint8_t {
+        Camera,
+        Mirror, // Shares the sampler with its parent, which waits for it before spawning its samples
+        Sample // Hemisphere sample of its parent
+    };
+
+    uint32_t addVertex(const Ray &ray, const PathSampler &sampler, const glm::vec3 &eye, uint32_t parent, VertexType type, size_t depth);
+    // Light that arrives if the shadow ray, if any, is not blocked
+    void addTerm(const glm::vec3 &value, const Ray *shadow);
+    void addPointLight(uint32_t vertex, size_t light, const glm::vec3 &point, const glm::vec3 &value);
+
+    void extend(std::vector<CameraPath> &paths, std::vector<PrimaryHit> &primaries);
+    void shade(const std::vector<CameraPath> &paths);
+    // The sampler of the vertex is final: spawns its hemisphere samples, then completes the parent if this is its mirror ray
+    void complete(uint32_t vertex);
+    void shadow();
+    void resolve(const std::vector<CameraPath> &paths, std::vector<glm::vec3> &colors, std::vector<PrimaryHit> &primaries);
+
+    const Scene *scene;
+    const BoundingVolumeHierarchy *bvh;
+    const ShadingData *data;
+    glm::vec3 camera;
+    bool areaLights;
+    bool pointLightTree;
+
+    // Path vertices, children always come after their parent
+    std::vector<glm::vec3> origins;
+    std::vector<glm::vec3> directions;
+    std::vector<float> ts;
+    std::vector<PathSampler> samplers;
+    std::vector<glm::vec3> eyes; // Where the vertex is seen from, for the specular highlights of point lights
+    std::vector<uint32_t> parents;
+    std::vector<VertexType> types;
+    std::vector<uint32_t> depths;
+    std::vector<size_t> meshes; // (size_t) -1 if the ray missed or was never traced
+    std::vector<glm::vec3> normals;
+    std::vector<float> pdfs; // Of the direction of a hemisphere sample
+    std::vector<uint32_t> sampleIndices; // Which of the samples of the parent
+    std::vector<uint32_t> mirrors; // Mirror child, NONE if the ray would be too deep
+    std::vector<uint32_t> firstChildren; // The hemisphere samples that were traced are contiguous
+    std::vector<uint32_t> childCounts;
+    std::vector<uint32_t> firstLights; // Point light terms, in the order shader() adds them
+    std::vector<uint32_t> lightCounts;
+    std::vector<uint32_t> firstEstimates; // Next-event estimation of every hemisphere sample, or of the vertex itself without samples
+    std::vector<glm::vec3> radiance; // What get_color returns for the vertex
+
+    // Point lights and next-event estimates, zeroed by the shadow stage if their shadow ray is blocked
+    std::vector<glm::vec3> terms;
+
+    // Queues of the stages
+    std::vector<uint32_t> rays;
+    std::vector<uint32_t> hits;
+    std::vector<uint32_t> next;
+    std::vector<glm::vec3> shadowOrigins;
+    std::vector<glm::vec3> shadowDirections;
+    std::vector<float> shadowLengths;
+    std::vector<uint32_t> shadowTerms;
+};